@@ -33,6 +33,31 @@ out_name     = "character_low"
 #texture_path = models_path / 'pika_clown3_512.png'
 #out_name    = "pika"
 
+# Set to a manifest to build asset bundles (one file holding many models
+# and textures, see src/AssetBundle.hpp) from already converted files
+# instead of converting the model and texture above. Writes
+# 3D_Converted_Models/{big,little}_endian_{bundle_out_name}.pkBundle
+bundle_manifest = None
+#bundle_manifest = script_path / "bundle_manifest.txt"
+bundle_out_name = "assets"
+
+# Version of the model files. 2 stores positions and uvs as 16b values
+# quantized against their bounding box and 16b indices when there are less
+# than 65536 vertices and uv coords: about half the memory of version 1.
+mesh_format_version = 2
+
+# Texel format of the texture files, "RGB888" (32b) or "RGB565" (16b).
+# RGB565 is the ClassPad framebuffer format: half the memory and no
+# conversion when drawing. The PC build keeps full 24b colors.
+# "INDEX8" (8b) and "INDEX4" (4b) quantize the texture to a palette of
+# 256 or 16 colors: 2x / 4x less than RGB565, fine for small stylized
+# textures. Lighting then shades the palette instead of every texel.
+texture_format_big_endian    = "RGB565"
+texture_format_little_endian = "RGB888"
+# Store the mip chain (sizes halved down to 1x1, +1/3 memory). Models far
+# away sample the small levels, which is faster and does not shimmer.
+texture_mip_levels = True
+
 ########################## DETAILS #########################
 ## Writes *.obj out as custom binary format *.pkObj which
 ## speeds up processing *obj (suzanne.obj from 9 min to few ms)
@@ -46,12 +71,50 @@ out_name     = "character_low"
 ##         [uv faces cnt] (32b(uv0) + 32b(uv1) + 32b(uv2) of type uint32_t)
 ##         [uv coord cnt] (32b( u ) + 32b( v )            of type Fix16)
 ##
+## Format version 2:
+##         [      1     ] 32b magic "PKO2" (0x504B4F32)
+##         [      1     ] 32b vertex count
+##         [      1     ] 32b face count
+##         [      1     ] 32b uv faces count
+##         [      1     ] 32b uv coord count
+##         [      1     ] 32b index size in bytes (2 or 4)
+##         [      1     ] 3x 32b vertex offset, 3x 32b vertex scale (Fix16)
+##         [      1     ] 2x 32b uv offset,     2x 32b uv scale     (Fix16)
+##         [vertex count] (16b( x ) + 16b( y ) + 16b( z ) of type int16_t)
+##         [ face count ] (v0 + v1 + v2 of index size)
+##         [uv faces cnt] (uv0 + uv1 + uv2 of index size)
+##         [uv coord cnt] (16b( u ) + 16b( v )            of type int16_t)
+##         Value = offset + scale * q / 65536: offset is the center of
+##         the bounding box and scale its size, q is in [-32768, 32767].
+##         Every array starts at a multiple of 4 bytes (zero padded).
+##
 ## Writes *.png texture out as custom binary format *.texture
 ## to ease and speed up reading the png on calculator.
 ##
-## Format: [     1     ] 32b size x
+## Format: [     1     ] 32b magic "PKTX" (0x504B5458)
+##         [     1     ] 32b size x
 ##         [     1     ] 32b size y
-##         [   x * y   ] 32b pixels of type uint32_t
+##         [     1     ] 32b texel format (0 = RGB888, 1 = RGB565)
+##         [     1     ] 32b mip level count
+##         [     1     ] 32b palette size (INDEX8 and INDEX4 only)
+##         [palette sz.] 32b palette colors 0x00RRGGBB (INDEX8 and INDEX4 only)
+##         [  levels   ] pixels of each level, level l is (x>>l) * (y>>l)
+##                       (at least 1x1). 32b pixels of type uint32_t
+##                       (0x00RRGGBB), 16b of type uint16_t (RRRRRGGGGGGBBBBB),
+##                       8b palette indices or 4b palette indices (two
+##                       pixels per byte, first in the low bits, rows not
+##                       padded, each level starts on a byte)
+## Files without the magic (older versions of this script) have only
+## size x, size y and the 32b pixels. The loader still reads those.
+##
+## Bundle format: [     1     ] 32b magic "PKBN" (0x504B424E)
+##                [     1     ] 32b entry count
+##                [entry count] 20 bytes name (zero padded), 32b type
+##                              (0 = mesh, 1 = texture), 32b offset, 32b size
+##                [  entries  ] the files, each starting at a multiple of 8
+## Manifest: one "name type file" per line (type mesh or texture). file is
+## in 3D_Converted_Models, {endian} in it is replaced by big_endian or
+## little_endian. Lines starting with # are skipped.
 ##
 ## Saves file both in little and big endian
 ## (ClassPad - big endian) (Computer - most likely little endian)
@@ -72,6 +135,44 @@ def write_out_32b(fBig, fLit, value):
     fBig.write(value.to_bytes(4, 'big'))
     fLit.write(value.to_bytes(4, 'little'))
 
+def write_out_16b(fBig, fLit, value):
+    value = value + (1<<16 if value < 0 else 0)
+    fBig.write(value.to_bytes(2, 'big'))
+    fLit.write(value.to_bytes(2, 'little'))
+
+def write_out_padding(fBig, fLit):
+    padding = (4 - fBig.tell() % 4) % 4
+    fBig.write(bytes(padding))
+    fLit.write(bytes(padding))
+
+MESH_MAGIC_V2 = 0x504B4F32 # "PKO2"
+
+# Offset and scale (Fix16 raw values) quantizing one axis of values
+def quantization(values):
+    if len(values) == 0:
+        return 0, 1<<16
+    lo, hi = min(values), max(values)
+    offset = round((lo + hi) / 2 * (1<<16))
+    # Covers both ends from the rounded offset, never zero
+    scale = max(1, 2 * max(round(hi * (1<<16)) - offset, offset - round(lo * (1<<16))))
+    return offset, scale
+
+def quantize(value, offset, scale):
+    q = round((value * (1<<16) - offset) * (1<<16) / scale)
+    return max(-32768, min(32767, q))
+
+def raw_to_u32(raw):
+    return raw + (1<<32 if raw < 0 else 0)
+
+TEXTURE_MAGIC   = 0x504B5458 # "PKTX"
+TEXTURE_FORMATS = {"RGB888": 0, "RGB565": 1, "INDEX8": 2, "INDEX4": 3}
+TEXTURE_PALETTE_SIZES = {"INDEX8": 256, "INDEX4": 16}
+
+# 1 based index of a face corner, negative ones count back from the last
+def obj_index(value, count):
+    index = int(value)
+    return index if index > 0 else count + index + 1
+
 def process_obj(path, out_big_endian, out_little_endian):
     obj_rows = ""
     with open(path) as f:
@@ -96,19 +197,17 @@ def process_obj(path, out_big_endian, out_little_endian):
             v = 1.0 - float(coordinates[1])
             uv_coords.append((u,v))
         elif row[0:2] == "f ":
-            face = row.split()[1::]
-            v0_data = face[0].split("/")
-            v1_data = face[1].split("/")
-            v2_data = face[2].split("/")
-            v0 = int(v0_data[0])
-            v1 = int(v1_data[0])
-            v2 = int(v2_data[0])
-            if(len(v0_data) > 1):
-                vt0 = int(v0_data[1])
-                vt1 = int(v1_data[1])
-                vt2 = int(v2_data[1])
-                uv_face.append((vt0,vt1,vt2))
-            faces.append((v0,v1,v2))
+            corners = [corner.split("/") for corner in row.split()[1::]]
+            # Quads and polygons as a fan of triangles around the first corner
+            for i in range(1, len(corners) - 1):
+                triangle = (corners[0], corners[i], corners[i+1])
+                faces.append(tuple(obj_index(c[0], len(vertices)) for c in triangle))
+                if len(corners[0]) > 1 and corners[0][1] != "":
+                    uv_face.append(tuple(obj_index(c[1], len(uv_coords)) for c in triangle))
+
+    # The loader takes uv faces for all faces or none
+    if len(uv_face) != len(faces):
+        uv_face = []
 
     print("Vertices:        ", len(vertices))
     print("faces_count:     ", len(faces))
@@ -127,6 +226,12 @@ def process_obj(path, out_big_endian, out_little_endian):
     # Classpad wants little-endian
     fLit = open(out_little_endian, "wb")
 
+    if mesh_format_version == 2:
+        write_obj_v2(fBig, fLit, vertices, faces, uv_face, uv_coords)
+        fBig.close()
+        fLit.close()
+        return
+
     # Write info about length of our data
     write_out_32b(fBig, fLit, vert_count)
     write_out_32b(fBig, fLit, face_count)
@@ -153,9 +258,39 @@ def process_obj(path, out_big_endian, out_little_endian):
     fBig.close()
     fLit.close()
 
+def write_obj_v2(fBig, fLit, vertices, faces, uv_face, uv_coords):
+    index_size = 2 if len(vertices) <= 65536 and len(uv_coords) <= 65536 else 4
+    vert_quant = [quantization([v[i] for v in vertices]) for i in range(3)]
+    uv_quant   = [quantization([uv[i] for uv in uv_coords]) for i in range(2)]
+
+    write_out_32b(fBig, fLit, MESH_MAGIC_V2)
+    for value in (len(vertices), len(faces), len(uv_face), len(uv_coords), index_size):
+        write_out_32b(fBig, fLit, value)
+    for quant in (vert_quant, uv_quant):
+        for offset, _ in quant:
+            write_out_32b(fBig, fLit, raw_to_u32(offset))
+        for _, scale in quant:
+            write_out_32b(fBig, fLit, raw_to_u32(scale))
+
+    write_index = write_out_16b if index_size == 2 else write_out_32b
+    for v in vertices:
+        for i in range(3):
+            write_out_16b(fBig, fLit, quantize(v[i], *vert_quant[i]))
+    write_out_padding(fBig, fLit)
+    for f in faces:
+        for i in range(3):
+            write_index(fBig, fLit, f[i]-1)
+    write_out_padding(fBig, fLit)
+    for uvf in uv_face:
+        for i in range(3):
+            write_index(fBig, fLit, uvf[i]-1)
+    write_out_padding(fBig, fLit)
+    for uv in uv_coords:
+        for i in range(2):
+            write_out_16b(fBig, fLit, quantize(uv[i], *uv_quant[i]))
+
 def process_texture(texture_path, out_big_endian, out_little_endian):
-    def png_to_hextable(texture_path):
-        im = Image.open(texture_path) # Can be many different formats.
+    def image_to_hextable(im):
         png = im.load()
         png_array = []
         for y in range(im.size[1]):
@@ -167,29 +302,106 @@ def process_texture(texture_path, out_big_endian, out_little_endian):
                 rgb_hex = hex(rgb_hex)
                 tmp.append(rgb_hex)
             png_array.append(tmp)
-        return png_array, im.size[0], im.size[1]
+        return png_array
 
-    texture, size_x, size_y = png_to_hextable(texture_path)
+    im = Image.open(texture_path).convert("RGB") # Can be many different formats.
+    size_x, size_y = im.size
     if (size_x != size_y):
         print(f"Error: Texture must be square for now! size x = {size_x} size y = {size_y} ")
         raise TypeError("Non-square texture may not be supported. Too lazy to check if I added support...")
     else:
         print(f"Generating binary texture\nsize x {size_x}\nsize y {size_y}")
 
-    fBig = open(out_big_endian, "wb")
-    fLit = open(out_little_endian, "wb")
+    # Mip chain, each level box filtered from the full size image
+    images = [im]
+    while texture_mip_levels and (size_x >> len(images) > 0 or size_y >> len(images) > 0):
+        level_size = (max(1, size_x >> len(images)), max(1, size_y >> len(images)))
+        images.append(im.resize(level_size, Image.BOX))
+    levels = [image_to_hextable(level) for level in images]
+    print(f"mip levels {len(levels)}")
 
-    # Write info about length of our data
-    write_out_32b(fBig, fLit, size_x)
-    write_out_32b(fBig, fLit, size_y)
-    # Write vertices in uint32 format
-    for row in texture:
-        for pix in row:
-            write_out_32b(fBig, fLit, int(pix, base=16))
-    fBig.close()
-    fLit.close()
+    # One palette for all levels, taken from the full size image
+    def indexed_levels(colors):
+        palette_image = im.quantize(colors=colors, method=Image.Quantize.MEDIANCUT, dither=Image.Dither.NONE)
+        palette = palette_image.getpalette()[:3*colors]
+        indices = [list(level.quantize(palette=palette_image, dither=Image.Dither.NONE).getdata()) for level in images]
+        palette_size = max(max(level) for level in indices) + 1
+        palette = [palette[3*i] << 16 | palette[3*i+1] << 8 | palette[3*i+2] for i in range(palette_size)]
+        print(f"palette colors {palette_size}")
+        return palette, indices
+
+    def write_texture(out_path, texture_format, byteorder):
+        with open(out_path, "wb") as f:
+            # Header
+            for value in (TEXTURE_MAGIC, size_x, size_y, TEXTURE_FORMATS[texture_format], len(levels)):
+                f.write(value.to_bytes(4, byteorder))
+            if texture_format in TEXTURE_PALETTE_SIZES:
+                palette, indices = indexed_levels(TEXTURE_PALETTE_SIZES[texture_format])
+                f.write(len(palette).to_bytes(4, byteorder))
+                for rgb in palette:
+                    f.write(rgb.to_bytes(4, byteorder))
+                for level in indices:
+                    if texture_format == "INDEX4":
+                        level = level + [0] * (len(level) % 2)
+                        level = [level[i] | level[i+1] << 4 for i in range(0, len(level), 2)]
+                    f.write(bytes(level))
+                return
+            # Pixels, largest level first
+            for texture in levels:
+                for row in texture:
+                    for pix in row:
+                        rgb = int(pix, base=16)
+                        if texture_format == "RGB565":
+                            rgb565 = ((rgb >> 8) & 0xf800) | ((rgb >> 5) & 0x07e0) | ((rgb >> 3) & 0x001f)
+                            f.write(rgb565.to_bytes(2, byteorder))
+                        else:
+                            f.write(rgb.to_bytes(4, byteorder))
+
+    write_texture(out_big_endian,    texture_format_big_endian,    'big')
+    write_texture(out_little_endian, texture_format_little_endian, 'little')
+
+BUNDLE_MAGIC      = 0x504B424E # "PKBN"
+BUNDLE_NAME_SIZE  = 20
+BUNDLE_TYPES      = {"mesh": 0, "texture": 1}
+BUNDLE_ENTRY_SIZE = BUNDLE_NAME_SIZE + 3*4
+
+def build_bundle(manifest_path, endian, out_path):
+    entries = []
+    with open(manifest_path) as f:
+        for row in f.read().split("\n"):
+            row = row.strip()
+            if len(row) == 0 or row[0] == "#": continue
+            name, asset_type, file_name = row.split()
+            if len(name) >= BUNDLE_NAME_SIZE:
+                raise ValueError(f"Bundle entry name {name} longer than {BUNDLE_NAME_SIZE-1} characters")
+            path = project_root / "3D_Converted_Models" / file_name.replace("{endian}", f"{endian}_endian")
+            with open(path, "rb") as asset:
+                entries.append((name, BUNDLE_TYPES[asset_type], asset.read()))
+
+    byteorder = endian
+    offset = 8 + BUNDLE_ENTRY_SIZE * len(entries)
+    with open(out_path, "wb") as f:
+        f.write(BUNDLE_MAGIC.to_bytes(4, byteorder))
+        f.write(len(entries).to_bytes(4, byteorder))
+        offsets = []
+        for name, asset_type, data in entries:
+            offset = (offset + 7) & ~7
+            offsets.append(offset)
+            f.write(name.encode().ljust(BUNDLE_NAME_SIZE, b"\0"))
+            for value in (asset_type, offset, len(data)):
+                f.write(value.to_bytes(4, byteorder))
+            offset += len(data)
+        for (name, asset_type, data), offset in zip(entries, offsets):
+            f.write(bytes(offset - f.tell()))
+            f.write(data)
+        print(f"Bundle {out_path}: {len(entries)} entries, {f.tell()} bytes")
 
 def main():
+    if bundle_manifest != None:
+        for endian in ("big", "little"):
+            build_bundle(bundle_manifest, endian,
+                project_root / "3D_Converted_Models" / f"{endian}_endian_{bundle_out_name}.pkBundle")
+        return
     if model_path != None:
         process_obj(model_path, obj_out_big_endian, obj_out_little_endian)
     if texture_path != None:
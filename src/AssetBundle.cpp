@@ -0,0 +1,105 @@
+#include "AssetBundle.hpp"
+
+#include "constants.hpp"
+
+#ifndef PC
+#   include <sdk/os/file.hpp>
+#   include <sdk/os/mem.hpp>
+#   include <sdk/os/string.hpp>
+#else
+#   include <cstdlib>   // malloc & free
+#   include <cstring>   // strcmp, strlen & strcpy
+#   include <iostream>
+#   include <unistd.h>  // File read & close
+#   include <fcntl.h>   // File open
+#endif
+
+static void asset_bundle_clear(AssetBundle& bundle)
+{
+    bundle.path = nullptr;
+    bundle.fd = -1;
+    bundle.entry_count = 0;
+    bundle.entries = nullptr;
+}
+
+// Names are terminated and entries inside of the file
+static bool entries_valid(const AssetBundle& bundle, unsigned file_size)
+{
+    for (unsigned i = 0; i < bundle.entry_count; i++) {
+        const AssetBundleEntry& e = bundle.entries[i];
+        if (e.name[ASSET_BUNDLE_NAME_SIZE - 1] != '\0' ||
+            e.offset > file_size || e.size > file_size - e.offset)
+            return false;
+    }
+    return true;
+}
+
+bool asset_bundle_open(AssetBundle& bundle, const char* path)
+{
+    asset_bundle_clear(bundle);
+
+    int fd = open(path, UNIVERSIAL_FILE_READ);
+    if (fd < 0){
+#ifdef PC
+        std::cout << "Could not open " << path << std::endl;
+#endif
+        return false;
+    }
+
+    uint32_t header[2] = {0};
+    read(fd, header, sizeof(header));
+    const int size = file_size(fd);
+    const unsigned max_count = size > 0 ? size / sizeof(AssetBundleEntry) : 0;
+    bool valid = header[0] == ASSET_BUNDLE_MAGIC && header[1] <= max_count;
+
+    // Whole table of contents in one read
+    const unsigned toc_bytes = header[1] * sizeof(AssetBundleEntry);
+    if (valid){
+        bundle.entries = (AssetBundleEntry*) malloc(toc_bytes > 0 ? toc_bytes : 1);
+        lseek(fd, sizeof(header), SEEK_SET);
+        valid = bundle.entries != nullptr && read(fd, bundle.entries, toc_bytes) == (int) toc_bytes;
+        bundle.entry_count = header[1];
+    }
+    valid = valid && entries_valid(bundle, size);
+    if (valid){
+        bundle.path = (char*) malloc(strlen(path) + 1);
+        valid = bundle.path != nullptr;
+        if (valid)
+            strcpy(bundle.path, path);
+    }
+    if (!valid){
+#ifdef PC
+        std::cout << "Could not read " << path << ", not a bundle of this byte order or entries outside of the file" << std::endl;
+#endif
+        free(bundle.entries);
+        close(fd);
+        asset_bundle_clear(bundle);
+        return false;
+    }
+    bundle.fd = fd;
+    return true;
+}
+
+void asset_bundle_close(AssetBundle& bundle)
+{
+    if (bundle.fd >= 0)
+        close(bundle.fd);
+    free(bundle.entries);
+    free(bundle.path);
+    asset_bundle_clear(bundle);
+}
+
+const AssetBundleEntry* asset_bundle_find(const AssetBundle& bundle, const char* name, uint32_t type)
+{
+    for (unsigned i = 0; i < bundle.entry_count; i++) {
+        const AssetBundleEntry& e = bundle.entries[i];
+        if (e.type == type && strcmp(e.name, name) == 0)
+            return &e;
+    }
+    return nullptr;
+}
+
+FileRegion asset_bundle_region(const AssetBundle& bundle, const AssetBundleEntry& entry)
+{
+    return {bundle.fd, entry.offset, entry.size};
+}
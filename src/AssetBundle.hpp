@@ -0,0 +1,58 @@
+#pragma once
+
+// Many meshes and textures in one file, found by name through a table of
+// contents read when the bundle is opened. Only one file open instead of one
+// per asset (slow on the ClassPad flash file system), and the assets are
+// read from one place. Built by python/ObjTexConverter.py from a manifest.
+//
+// File format: [1] 32b magic ASSET_BUNDLE_MAGIC
+//              [1] 32b entry count
+//              [entry count] ASSET_BUNDLE_NAME_SIZE bytes name (zero padded),
+//                            32b type (ASSET_TYPE_*), 32b offset, 32b size
+//              Asset files (.pkObj, .texture) as they are, each starting
+//              at a multiple of 8 bytes. Offsets are from the start of the
+//              bundle.
+// The bundle has the byte order of its assets. The magic reads swapped in
+// a bundle of the other byte order, it is not loaded.
+
+#include <stdint.h>
+
+#include "FileBlob.hpp"
+
+#define ASSET_BUNDLE_MAGIC 0x504B424E // "PKBN"
+
+#define ASSET_BUNDLE_NAME_SIZE 20
+
+#define ASSET_TYPE_MESH    0
+#define ASSET_TYPE_TEXTURE 1
+
+struct AssetBundleEntry
+{
+    char     name[ASSET_BUNDLE_NAME_SIZE];
+    uint32_t type;
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct AssetBundle
+{
+    // Path the bundle was opened from, what identifies its assets (see
+    // AssetCache) after it is closed or when it is opened again
+    char* path;
+    int fd;
+    unsigned entry_count;
+    AssetBundleEntry* entries;
+};
+
+// Opens the bundle at path and reads its table of contents. Returns false
+// if it could not be read or an entry is outside of the file, the bundle
+// is then closed.
+bool asset_bundle_open(AssetBundle& bundle, const char* path);
+// Assets loaded from the bundle stay loaded
+void asset_bundle_close(AssetBundle& bundle);
+
+// Entry of given name and type, nullptr if there is none
+const AssetBundleEntry* asset_bundle_find(const AssetBundle& bundle, const char* name, uint32_t type);
+// Where the loaders read the entry from (see mesh_load_region and
+// texture_load_region)
+FileRegion asset_bundle_region(const AssetBundle& bundle, const AssetBundleEntry& entry);
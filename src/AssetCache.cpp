@@ -0,0 +1,176 @@
+#include "AssetCache.hpp"
+
+#ifndef PC
+#   include <sdk/os/mem.hpp>
+#   include <sdk/os/string.hpp>
+#else
+#   include <cstdlib>   // malloc & free
+#   include <cstring>   // strcmp, strlen & strcpy
+#   include <iostream>
+#endif
+
+static char* copy_path(const char* path)
+{
+    char* copy = (char*) malloc(strlen(path) + 1);
+    strcpy(copy, path);
+    return copy;
+}
+
+static char* copy_bundle_path(const AssetBundle* bundle)
+{
+    return bundle != nullptr ? copy_path(bundle->path) : nullptr;
+}
+
+// Entry loaded from the same bundle file, or both not from a bundle
+static bool same_bundle(const char* bundle_path, const AssetBundle* bundle)
+{
+    if (bundle_path == nullptr || bundle == nullptr)
+        return bundle_path == nullptr && bundle == nullptr;
+    return strcmp(bundle_path, bundle->path) == 0;
+}
+
+static bool load_mesh(Mesh& mesh, const char* path, bool center, const AssetBundle* bundle)
+{
+    if (bundle == nullptr)
+        return mesh_load(mesh, path, center);
+    const AssetBundleEntry* entry = asset_bundle_find(*bundle, path, ASSET_TYPE_MESH);
+    if (entry == nullptr){
+#ifdef PC
+        std::cout << "No mesh " << path << " in the bundle" << std::endl;
+#endif
+        mesh = Mesh();
+        return false;
+    }
+    return mesh_load_region(mesh, asset_bundle_region(*bundle, *entry), path, center);
+}
+
+static bool load_texture(Texture& texture, const char* path, int maxSize, const AssetBundle* bundle)
+{
+    if (bundle == nullptr)
+        return texture_load(texture, path, maxSize);
+    const AssetBundleEntry* entry = asset_bundle_find(*bundle, path, ASSET_TYPE_TEXTURE);
+    if (entry == nullptr){
+#ifdef PC
+        std::cout << "No texture " << path << " in the bundle" << std::endl;
+#endif
+        return false;
+    }
+    return texture_load_region(texture, asset_bundle_region(*bundle, *entry), path, maxSize);
+}
+
+static unsigned blob_bytes(const FileBlob& b)
+{
+    return b.size + b.extra_size;
+}
+
+AssetCache::AssetCache()
+{
+
+}
+
+AssetCache::~AssetCache()
+{
+    // Models are deleted before the cache, anything left was not released
+    for (unsigned i=0; i<meshes.getSize(); i++){
+        mesh_free(*meshes[i].mesh);
+        delete meshes[i].mesh;
+        free(meshes[i].path);
+        free(meshes[i].bundle_path);
+    }
+    for (unsigned i=0; i<textures.getSize(); i++){
+        texture_free(*textures[i].texture);
+        delete textures[i].texture;
+        free(textures[i].path);
+        free(textures[i].bundle_path);
+    }
+}
+
+Mesh* AssetCache::acquireMesh(const char* path, bool center, const AssetBundle* bundle)
+{
+    for (unsigned i=0; i<meshes.getSize(); i++){
+        MeshEntry& e = meshes[i];
+        if (e.center == center && same_bundle(e.bundle_path, bundle) && strcmp(e.path, path) == 0){
+            e.refs++;
+            return e.mesh;
+        }
+    }
+    Mesh* mesh = new Mesh;
+    if (!load_mesh(*mesh, path, center, bundle)){
+        delete mesh;
+        return nullptr;
+    }
+    meshes.push_back({copy_path(path), copy_bundle_path(bundle), center, 1, mesh});
+    return mesh;
+}
+
+Texture* AssetCache::acquireTexture(const char* path, int maxSize, const AssetBundle* bundle)
+{
+    for (unsigned i=0; i<textures.getSize(); i++){
+        TextureEntry& e = textures[i];
+        if (e.max_size == maxSize && same_bundle(e.bundle_path, bundle) && strcmp(e.path, path) == 0){
+            e.refs++;
+            return e.texture;
+        }
+    }
+    Texture* texture = new Texture;
+    if (!load_texture(*texture, path, maxSize, bundle)){
+        delete texture;
+        return nullptr;
+    }
+    textures.push_back({copy_path(path), copy_bundle_path(bundle), maxSize, 1, texture});
+    return texture;
+}
+
+void AssetCache::release(Mesh* mesh)
+{
+    for (unsigned i=0; i<meshes.getSize(); i++){
+        MeshEntry& e = meshes[i];
+        if (e.mesh != mesh)
+            continue;
+        if (--e.refs == 0){
+            mesh_free(*e.mesh);
+            delete e.mesh;
+            free(e.path);
+            free(e.bundle_path);
+            meshes.remove_unordered(i);
+        }
+        return;
+    }
+}
+
+void AssetCache::release(Texture* texture)
+{
+    for (unsigned i=0; i<textures.getSize(); i++){
+        TextureEntry& e = textures[i];
+        if (e.texture != texture)
+            continue;
+        if (--e.refs == 0){
+            texture_free(*e.texture);
+            delete e.texture;
+            free(e.path);
+            free(e.bundle_path);
+            textures.remove_unordered(i);
+        }
+        return;
+    }
+}
+
+unsigned AssetCache::getMeshCount()
+{
+    return meshes.getSize();
+}
+
+unsigned AssetCache::getTextureCount()
+{
+    return textures.getSize();
+}
+
+unsigned AssetCache::getBytes()
+{
+    unsigned bytes = 0;
+    for (unsigned i=0; i<meshes.getSize(); i++)
+        bytes += blob_bytes(meshes[i].mesh->file);
+    for (unsigned i=0; i<textures.getSize(); i++)
+        bytes += blob_bytes(textures[i].texture->file);
+    return bytes;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+// Meshes and textures shared between the models drawing the same files.
+// A file is loaded on its first acquire and freed when the last model
+// using it releases it, so copies of a mesh cost only their per-model
+// state (see Model.hpp) instead of another load of the file.
+
+#include "Mesh.hpp"
+
+#include "Texture.hpp"
+
+#include "AssetBundle.hpp"
+
+#include "DynamicArray.hpp"
+
+class AssetCache
+{
+private:
+    struct MeshEntry
+    {
+        char*    path;
+        char*    bundle_path;   // nullptr when not from a bundle
+        bool     center;
+        unsigned refs;
+        Mesh*    mesh;
+    };
+    struct TextureEntry
+    {
+        char*    path;
+        char*    bundle_path;   // nullptr when not from a bundle
+        int      max_size;
+        unsigned refs;
+        Texture* texture;
+    };
+    DynamicArray<MeshEntry>    meshes;
+    DynamicArray<TextureEntry> textures;
+
+public:
+    // Mesh of the file at path loaded with center (see mesh_load), nullptr
+    // if it could not be loaded. Every acquire of a mesh needs a release.
+    // With bundle path is the name of an entry of the open bundle instead
+    // (see AssetBundle.hpp), the bundle is only needed while acquiring.
+    // Entries of a bundle are told apart by the bundle's path.
+    Mesh* acquireMesh(const char* path, bool center, const AssetBundle* bundle = nullptr);
+    // Texture of the file at path with mip levels up to maxSize (see
+    // texture_load), nullptr if it could not be loaded. bundle as above.
+    Texture* acquireTexture(const char* path, int maxSize, const AssetBundle* bundle = nullptr);
+    void release(Mesh* mesh);
+    void release(Texture* texture);
+
+    // Loaded files
+    unsigned getMeshCount();
+    unsigned getTextureCount();
+    // Bytes of the loaded meshes and textures (heap or mapped)
+    unsigned getBytes();
+
+    AssetCache();
+    ~AssetCache();
+};
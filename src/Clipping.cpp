@@ -0,0 +1,110 @@
+#include "Clipping.hpp"
+
+#include "RenderUtils.hpp"
+
+#include "constants.hpp"
+
+ClipFrustum makeClipFrustum(Fix16 FOV)
+{
+    // Right and bottom planes go through the last pixel, not past it
+    return ClipFrustum({
+        FOV,
+        Fix16((int16_t)(SCREEN_X/2))     / FOV,
+        Fix16((int16_t)(SCREEN_X/2 - 1)) / FOV,
+        Fix16((int16_t)(SCREEN_Y/2))     / FOV,
+        Fix16((int16_t)(SCREEN_Y/2 - 1)) / FOV,
+    });
+}
+
+int16_t_vec2 projectInside(Fix16 FOV, const fix16_vec3& p)
+{
+    // fov/z
+    auto focal = FOV/p.z;
+    int16_t x = (int16_t)(Fix16((int16_t) (SCREEN_X/2)) + p.x*focal);
+    int16_t y = (int16_t)(Fix16((int16_t) (SCREEN_Y/2)) + p.y*focal);
+    if (x < 0)          x = 0;
+    if (x > SCREEN_X-1) x = SCREEN_X-1;
+    if (y < 0)          y = 0;
+    if (y > SCREEN_Y-1) y = SCREEN_Y-1;
+    return int16_t_vec2({x, y});
+}
+
+// Signed distance to the plane, negative = outside
+static inline Fix16 plane_distance(const ClipFrustum& f, uint8_t plane, const fix16_vec3& p)
+{
+    switch (plane) {
+        case CLIP_NEAR:   return p.z - Fix16(CLIP_NEAR_Z);
+        case CLIP_LEFT:   return p.x + p.z*f.left;
+        case CLIP_RIGHT:  return p.z*f.right - p.x;
+        case CLIP_TOP:    return p.y + p.z*f.top;
+        default:          return p.z*f.bottom - p.y;
+    }
+}
+
+static inline ClipVertex lerp_vertex(const ClipVertex& a, const ClipVertex& b, Fix16 t)
+{
+    return ClipVertex({
+        {
+            a.p.x + (b.p.x - a.p.x)*t,
+            a.p.y + (b.p.y - a.p.y)*t,
+            a.p.z + (b.p.z - a.p.z)*t,
+        },
+        a.u + (b.u - a.u)*t,
+        a.v + (b.v - a.v)*t,
+    });
+}
+
+unsigned clip_triangle(
+    const ClipFrustum& f, const ClipVertex in[3], const uint8_t codes[3],
+    int16_t_Point2d out[], bool edges[]
+) {
+    // Sutherland-Hodgman, ping-ponging between two polygon buffers
+    ClipVertex poly_a[CLIP_MAX_VERTICES], poly_b[CLIP_MAX_VERTICES];
+    bool edges_a[CLIP_MAX_VERTICES], edges_b[CLIP_MAX_VERTICES];
+    ClipVertex* src = poly_a;
+    ClipVertex* dst = poly_b;
+    bool* src_edges = edges_a;
+    bool* dst_edges = edges_b;
+    unsigned n = 3;
+    for (unsigned i = 0; i < 3; i++) {
+        src[i] = in[i];
+        src_edges[i] = true;
+    }
+
+    const uint8_t planes = codes[0] | codes[1] | codes[2];
+    for (uint8_t plane = CLIP_NEAR; plane <= CLIP_BOTTOM; plane <<= 1) {
+        if (!(planes & plane))
+            continue;
+        unsigned m = 0;
+        for (unsigned i = 0; i < n; i++) {
+            const ClipVertex& a = src[i];
+            const ClipVertex& b = src[(i + 1) % n];
+            const Fix16 da = plane_distance(f, plane, a.p);
+            const Fix16 db = plane_distance(f, plane, b.p);
+            const bool a_in = da >= 0.0f;
+            const bool b_in = db >= 0.0f;
+            if (a_in) {
+                dst[m] = a;
+                dst_edges[m++] = src_edges[i];
+            }
+            if (a_in != b_in) {
+                // Edge from the intersection continues the original edge
+                // only when entering, leaving edge runs along the plane.
+                dst[m] = lerp_vertex(a, b, da / (da - db));
+                dst_edges[m++] = a_in ? false : src_edges[i];
+            }
+        }
+        n = m;
+        if (n < 3)
+            return 0;
+        ClipVertex* tmp = src; src = dst; dst = tmp;
+        bool* tmp_edges = src_edges; src_edges = dst_edges; dst_edges = tmp_edges;
+    }
+
+    for (unsigned i = 0; i < n; i++) {
+        const int16_t_vec2 s = projectInside(f.FOV, src[i].p);
+        out[i] = {s.x, s.y, (int16_t) src[i].u, (int16_t) src[i].v, depth_to_uint16(src[i].p.z)};
+        edges[i] = src_edges[i];
+    }
+    return n;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "RenderFP3D.hpp"
+
+// View frustum clipping. Triangles are clipped in camera space against the
+// near plane and the 4 planes through the screen edges, so every projected
+// point lands on the screen and the rasterizers can write pixels unchecked.
+
+// Outcode bits, set when a camera space point is outside of the plane
+#define CLIP_NEAR   0x01
+#define CLIP_LEFT   0x02
+#define CLIP_RIGHT  0x04
+#define CLIP_TOP    0x08
+#define CLIP_BOTTOM 0x10
+
+// Camera space z of the near plane
+#define CLIP_NEAR_Z 0.25f
+
+// Triangle clipped by 5 planes has at most 3+5 vertices
+#define CLIP_MAX_VERTICES 8
+
+// Screen edge planes of the frustum for given FOV. Point is inside when
+//   x + z*left >= 0, z*right - x >= 0, y + z*top >= 0, z*bottom - y >= 0
+struct ClipFrustum
+{
+    Fix16 FOV;
+    Fix16 left;
+    Fix16 right;
+    Fix16 top;
+    Fix16 bottom;
+};
+
+// Camera space point with texture coordinates
+struct ClipVertex
+{
+    fix16_vec3 p;
+    Fix16 u;
+    Fix16 v;
+};
+
+ClipFrustum makeClipFrustum(Fix16 FOV);
+
+inline uint8_t clip_code(const ClipFrustum& f, const fix16_vec3& p)
+{
+    uint8_t code = 0;
+    if (p.z < Fix16(CLIP_NEAR_Z))  code |= CLIP_NEAR;
+    if (p.x + p.z*f.left < 0.0f)   code |= CLIP_LEFT;
+    if (p.z*f.right - p.x < 0.0f)  code |= CLIP_RIGHT;
+    if (p.y + p.z*f.top < 0.0f)    code |= CLIP_TOP;
+    if (p.z*f.bottom - p.y < 0.0f) code |= CLIP_BOTTOM;
+    return code;
+}
+
+// Projects a point inside the frustum. Result is clamped to the screen
+// (rounding can push points on the frustum planes one pixel out).
+int16_t_vec2 projectInside(Fix16 FOV, const fix16_vec3& p);
+
+// Clips triangle with outcodes codes[3] against the planes set in the codes.
+// out gets the projected convex polygon (depth set with depth_to_uint16),
+// edges[i] tells if edge out[i] -> out[i+1] is part of the original triangle
+// (false for edges along a clip plane). Returns number of points, 0 if
+// nothing is left. out and edges must hold CLIP_MAX_VERTICES items.
+unsigned clip_triangle(
+    const ClipFrustum& f, const ClipVertex in[3], const uint8_t codes[3],
+    int16_t_Point2d out[], bool edges[]
+);
@@ -0,0 +1,65 @@
+#include "DepthSort.hpp"
+
+// Maps Fix16 to an unsigned key where ascending key = descending depth
+static inline uint32_t radix_key(Fix16 depth)
+{
+    return ~(((uint32_t) depth.value) ^ 0x80000000u);
+}
+
+void radix_sort_depth(uint_fix16_t a[], uint_fix16_t tmp[], unsigned n)
+{
+    if (n < 2)
+        return;
+
+    // Histograms of all 4 bytes in one pass over the data
+    unsigned count[4][256] = {{0}};
+    for (unsigned i = 0; i < n; i++) {
+        uint32_t k = radix_key(a[i].fix16);
+        count[0][(k >>  0) & 0xff]++;
+        count[1][(k >>  8) & 0xff]++;
+        count[2][(k >> 16) & 0xff]++;
+        count[3][(k >> 24) & 0xff]++;
+    }
+
+    uint_fix16_t* src = a;
+    uint_fix16_t* dst = tmp;
+    for (unsigned pass = 0; pass < 4; pass++) {
+        unsigned shift = pass * 8;
+        unsigned* c = count[pass];
+        // Every key has the same byte -> pass would not change the order
+        if (c[(radix_key(src[0].fix16) >> shift) & 0xff] == n)
+            continue;
+        // Counts to start offsets
+        unsigned offset = 0;
+        for (unsigned b = 0; b < 256; b++) {
+            unsigned cnt = c[b];
+            c[b] = offset;
+            offset += cnt;
+        }
+        for (unsigned i = 0; i < n; i++) {
+            uint32_t k = radix_key(src[i].fix16);
+            dst[c[(k >> shift) & 0xff]++] = src[i];
+        }
+        uint_fix16_t* t = src;
+        src = dst;
+        dst = t;
+    }
+
+    // Odd number of executed passes leaves the result in tmp
+    if (src != a) {
+        for (unsigned i = 0; i < n; i++)
+            a[i] = src[i];
+    }
+}
+
+void sort_depth(uint_fix16_t a[], uint_fix16_t tmp[], unsigned n)
+{
+    if (n <= DEPTH_SORT_INSERTION_MAX) {
+        insertion_sort_depth(a, n, n * n);
+        return;
+    }
+    if (n <= DEPTH_SORT_COHERENT_MAX &&
+        insertion_sort_depth(a, n, n * DEPTH_SORT_COHERENT_MOVES))
+        return;
+    radix_sort_depth(a, tmp, n);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "RenderFP3D.hpp"
+
+#include "Pair.hpp"
+
+// Depth sorting for the painter's algorithm. Everything is sorted
+// farthest first (descending key), same order as the old bubble sort.
+// All sorts are stable, so equal depths keep their previous order.
+
+// Below this many items insertion sort always wins over radix sort
+#define DEPTH_SORT_INSERTION_MAX 48
+// Insertion sort gives up after (n * this) element moves and the rest
+// is finished with radix sort. Keeps coherent frames O(n) while a
+// camera cut cannot degrade into O(n^2).
+#define DEPTH_SORT_COHERENT_MOVES 2
+// Above this many items the depth order changes too much between frames
+// (many faces share almost the same depth) and radix sort is used directly.
+#define DEPTH_SORT_COHERENT_MAX 1024
+
+class Model;
+
+inline Fix16 depth_key(const uint_fix16_t& a)         { return a.fix16;  }
+inline Fix16 depth_key(const Pair<Model*, Fix16>& a)  { return a.second; }
+
+// Insertion sort (farthest first). Close to O(n) when the array is already
+// nearly sorted, e.g. when it holds last frame's order.
+// Returns false if more than max_moves moves were needed. The array is then
+// only partially sorted (but still holds every item once).
+template <typename T>
+bool insertion_sort_depth(T a[], unsigned n, unsigned max_moves)
+{
+    unsigned moves = 0;
+    for (unsigned i = 1; i < n; i++) {
+        if (!(depth_key(a[i - 1]) < depth_key(a[i])))
+            continue;
+        T item = a[i];
+        unsigned j = i;
+        while (j > 0 && depth_key(a[j - 1]) < depth_key(item)) {
+            a[j] = a[j - 1];
+            j--;
+        }
+        a[j] = item;
+        moves += i - j;
+        if (moves > max_moves)
+            return false;
+    }
+    return true;
+}
+
+// LSD radix sort (4 passes of 8 bits) on the Fix16 key, farthest first.
+// tmp must hold n items. Passes where every key has the same byte are skipped.
+void radix_sort_depth(uint_fix16_t a[], uint_fix16_t tmp[], unsigned n);
+
+// Sorts faces by depth. Exploits frame-to-frame coherence when a[] is still
+// in last frame's order, falls back to radix sort otherwise.
+// tmp must hold n items.
+void sort_depth(uint_fix16_t a[], uint_fix16_t tmp[], unsigned n);
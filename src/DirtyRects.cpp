@@ -0,0 +1,115 @@
+#include "DirtyRects.hpp"
+
+// FRAMEBUFFER
+#include "RenderUtils.hpp"
+
+#include "constants.hpp"
+
+#ifndef PC
+#   include <sdk/calc/calc.hpp>
+#else
+#   include "PC_SDL_screen.hpp"
+#endif
+
+static inline unsigned rect_area(const ScreenRect& r)
+{
+    return (unsigned)(r.x1 - r.x0) * (unsigned)(r.y1 - r.y0);
+}
+
+static inline ScreenRect rect_union(const ScreenRect& a, const ScreenRect& b)
+{
+    return {
+        a.x0 < b.x0 ? a.x0 : b.x0, a.y0 < b.y0 ? a.y0 : b.y0,
+        a.x1 > b.x1 ? a.x1 : b.x1, a.y1 > b.y1 ? a.y1 : b.y1
+    };
+}
+
+DirtyRects::DirtyRects()
+:   count(0)
+{
+
+}
+
+void DirtyRects::clear()
+{
+    count = 0;
+}
+
+void DirtyRects::add(int x0, int y0, int x1, int y1)
+{
+    if (x0 < 0)        x0 = 0;
+    if (y0 < 0)        y0 = 0;
+    if (x1 > SCREEN_X) x1 = SCREEN_X;
+    if (y1 > SCREEN_Y) y1 = SCREEN_Y;
+    if (x0 >= x1 || y0 >= y1)
+        return;
+    ScreenRect r = {(int16_t)x0, (int16_t)y0, (int16_t)x1, (int16_t)y1};
+
+    // Merge into the existing rects while that does not cost extra pixels.
+    // A merged rect can swallow others, start over after every merge.
+    bool merged = true;
+    while (merged){
+        merged = false;
+        for (unsigned i=0; i<count; i++){
+            const ScreenRect u = rect_union(rects[i], r);
+            if (rect_area(u) <= rect_area(rects[i]) + rect_area(r)){
+                r = u;
+                rects[i] = rects[--count];
+                merged = true;
+                break;
+            }
+        }
+    }
+    if (count < DIRTY_RECTS_MAX){
+        rects[count++] = r;
+        if (pixels() > DIRTY_RECTS_FULL_SCREEN_PIXELS){
+            rects[0] = {0, 0, SCREEN_X, SCREEN_Y};
+            count = 1;
+        }
+        return;
+    }
+    // Full, grow the rect that needs the least extra pixels
+    unsigned best = 0;
+    unsigned best_cost = 0xffffffff;
+    for (unsigned i=0; i<count; i++){
+        const unsigned cost = rect_area(rect_union(rects[i], r)) - rect_area(rects[i]);
+        if (cost < best_cost){
+            best_cost = cost;
+            best = i;
+        }
+    }
+    const ScreenRect u = rect_union(rects[best], r);
+    rects[best] = rects[--count];
+    add(u);
+}
+
+void DirtyRects::add(const ScreenRect& r)
+{
+    add(r.x0, r.y0, r.x1, r.y1);
+}
+
+void DirtyRects::add(const DirtyRects& other)
+{
+    for (unsigned i=0; i<other.count; i++)
+        add(other.rects[i]);
+}
+
+unsigned DirtyRects::pixels() const
+{
+    unsigned n = 0;
+    for (unsigned i=0; i<count; i++)
+        n += rect_area(rects[i]);
+    return n;
+}
+
+void DirtyRects::fill(color_t color) const
+{
+    for (unsigned i=0; i<count; i++){
+        const ScreenRect& r = rects[i];
+        for (int y=r.y0; y<r.y1; y++){
+            color_t* row = &FRAMEBUFFER[y * SCREEN_X];
+            for (int x=r.x0; x<r.x1; x++)
+                row[x] = color;
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+// Screen areas that changed during a frame. Everything drawn in a frame lies
+// inside its dirty rects, the rest of the screen is background. So the rects
+// are what has to be cleared before the next frame, and together with the
+// rects cleared after the previous frame, what changed on screen since the
+// last present (the PC build uploads only those, see main.cpp).
+
+#include "RenderFP3D.hpp"
+
+#include "constants.hpp"
+
+// color_t
+#include "Renderer.hpp"
+
+// More rects than this are merged together
+#define DIRTY_RECTS_MAX 8
+// Rects covering more pixels than this become one full screen rect, a
+// single copy / fill is faster then
+#define DIRTY_RECTS_FULL_SCREEN_PIXELS (SCREEN_X * SCREEN_Y * 3 / 4)
+
+struct DirtyRects
+{
+    ScreenRect rects[DIRTY_RECTS_MAX];
+    unsigned count;
+
+    DirtyRects();
+
+    void clear();
+    // Adds [x0, x1) x [y0, y1), clamped to the screen. Rects that overlap
+    // the others are merged with them when the union is not larger than
+    // the two apart.
+    void add(int x0, int y0, int x1, int y1);
+    void add(const ScreenRect& r);
+    void add(const DirtyRects& other);
+
+    // Pixels covered, overlapping rects counted twice
+    unsigned pixels() const;
+
+    // Fills the rects of the framebuffer with color
+    void fill(color_t color) const;
+};
@@ -66,6 +66,18 @@ public:
         return size;
     }
 
+    // Removes all items, keeps the memory for reuse
+    void clear()
+    {
+        size = 0;
+    }
+
+    // Removes item at index, the last item takes its place (order is not kept)
+    void remove_unordered(unsigned int index)
+    {
+        array[index] = array[--size];
+    }
+
     // Warning: Not checking bounds -> Unsafe to access out of bounds!
     T& operator[](unsigned int index)
     {
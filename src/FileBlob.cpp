@@ -0,0 +1,124 @@
+#include "FileBlob.hpp"
+
+#ifndef PC
+#   include <sdk/os/file.hpp>
+#   include <sdk/os/mem.hpp>
+#else
+#   include <cstdlib>   // malloc & free
+#   include <unistd.h>  // File read, lseek & sysconf
+#   include <sys/mman.h>
+#endif
+
+// Scratch memory starts at this alignment after the file bytes
+#define FILE_BLOB_EXTRA_ALIGN 8
+
+#ifdef PC
+static bool use_mmap = false;
+
+void file_blob_set_mmap(bool enabled)
+{
+    use_mmap = enabled;
+}
+
+bool file_blob_mmap_enabled()
+{
+    return use_mmap;
+}
+#endif
+
+static void file_blob_clear(FileBlob& blob)
+{
+    blob.data = nullptr;
+    blob.size = 0;
+    blob.extra = nullptr;
+    blob.extra_size = 0;
+#ifdef PC
+    blob.mapping = nullptr;
+    blob.mapping_size = 0;
+#endif
+}
+
+int file_size(int fd)
+{
+    return lseek(fd, 0, SEEK_END);
+}
+
+FileRegion file_region(int fd)
+{
+    const int size = file_size(fd);
+    return {fd, 0, size > 0 ? (unsigned) size : 0};
+}
+
+bool file_blob_read(FileBlob& blob, int fd, unsigned offset, unsigned size, unsigned extra_size)
+{
+    file_blob_clear(blob);
+    const int end = file_size(fd);
+    if (end < 0 || offset > (unsigned) end || size > (unsigned) end - offset)
+        return false;
+
+#ifdef PC
+    if (use_mmap && size > 0){
+        // Private (copy on write) mapping, loaders may fix the data up in
+        // place. Mappings start on a page.
+        const unsigned page = sysconf(_SC_PAGESIZE);
+        const unsigned skip = offset % page;
+        void* mapping = mmap(nullptr, skip + size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, offset - skip);
+        if (mapping != MAP_FAILED){
+            uint8_t* extra = nullptr;
+            if (extra_size > 0){
+                extra = (uint8_t*) malloc(extra_size);
+                if (extra == nullptr){
+                    munmap(mapping, skip + size);
+                    return false;
+                }
+            }
+            blob.data = (uint8_t*) mapping + skip;
+            blob.size = size;
+            blob.extra = extra;
+            blob.extra_size = extra_size;
+            blob.mapping = mapping;
+            blob.mapping_size = skip + size;
+            return true;
+        }
+        // Not mappable, read it instead
+    }
+#endif
+
+    if (!file_blob_alloc(blob, size, extra_size))
+        return false;
+    lseek(fd, offset, SEEK_SET);
+    if (read(fd, blob.data, size) != (int) size){
+        file_blob_free(blob);
+        return false;
+    }
+    return true;
+}
+
+bool file_blob_alloc(FileBlob& blob, unsigned size, unsigned extra_size)
+{
+    file_blob_clear(blob);
+    const unsigned extra_offset = (size + FILE_BLOB_EXTRA_ALIGN - 1) & ~(FILE_BLOB_EXTRA_ALIGN - 1);
+    uint8_t* block = (uint8_t*) malloc(extra_offset + extra_size);
+    if (block == nullptr)
+        return false;
+    blob.data = block;
+    blob.size = size;
+    blob.extra = block + extra_offset;
+    blob.extra_size = extra_size;
+    return true;
+}
+
+void file_blob_free(FileBlob& blob)
+{
+#ifdef PC
+    if (blob.mapping != nullptr){
+        munmap(blob.mapping, blob.mapping_size);
+        free(blob.extra);
+        file_blob_clear(blob);
+        return;
+    }
+#endif
+    // Scratch memory is part of the same block
+    free(blob.data);
+    file_blob_clear(blob);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+// Bytes of a file in one block, the loaders point their arrays into it
+// instead of reading every array into an allocation of its own. Read into
+// a malloc'd block, or on the PC build optionally mapped (mmap, see
+// file_blob_set_mmap): the pages then come straight from the OS file cache.
+
+#include <stdint.h>
+
+struct FileBlob
+{
+    uint8_t* data;   // Bytes [offset, offset + size) of the file
+    unsigned size;
+    // extra_size bytes of scratch memory for the loader (e.g. arrays
+    // computed from the file), same block as data when read
+    uint8_t* extra;
+    unsigned extra_size;
+#ifdef PC
+    // Mapping holding data, nullptr when read
+    void*    mapping;
+    unsigned mapping_size;
+#endif
+};
+
+// Part of an open file holding one asset: a whole file, or an entry of a
+// bundle (see AssetBundle.hpp). Loaders read the asset's bytes
+// [0, size) from offset.
+struct FileRegion
+{
+    int fd;
+    unsigned offset;
+    unsigned size;
+};
+
+// Size of the open file fd, -1 on error. Leaves the position at the end.
+int file_size(int fd);
+
+// The whole open file fd, empty on error
+FileRegion file_region(int fd);
+
+// Reads (or maps) size bytes from offset of the open file fd with
+// extra_size bytes of scratch memory. Returns false if the file is shorter
+// or memory ran out, blob is then empty.
+bool file_blob_read(FileBlob& blob, int fd, unsigned offset, unsigned size, unsigned extra_size);
+// Block of size bytes plus extra_size bytes of scratch memory for a loader
+// that fills it itself (e.g. parsing a text file). Returns false if memory
+// ran out, blob is then empty.
+bool file_blob_alloc(FileBlob& blob, unsigned size, unsigned extra_size);
+void file_blob_free(FileBlob& blob);
+
+#ifdef PC
+// Map files instead of reading them (default off). Affects the blobs read
+// after the call.
+void file_blob_set_mmap(bool enabled);
+bool file_blob_mmap_enabled();
+#endif
@@ -0,0 +1,79 @@
+#include "FrameArena.hpp"
+
+FrameArena::FrameArena()
+:   buffer(nullptr), capacity(0), used(0), peak(0),
+    overflow(nullptr), overflow_bytes(0),
+    heap_allocations(0)
+{
+
+}
+
+FrameArena::~FrameArena()
+{
+    free_overflow();
+    if (buffer)
+        free(buffer);
+}
+
+void FrameArena::free_overflow()
+{
+    while (overflow) {
+        void* next = *(void**) overflow;
+        free(overflow);
+        overflow = next;
+    }
+    overflow_bytes = 0;
+}
+
+bool FrameArena::reserve(unsigned bytes)
+{
+    bytes = align(bytes);
+    if (bytes <= capacity)
+        return true;
+
+    uint8_t* newBuffer = static_cast<uint8_t*>(malloc(bytes));
+    if (!newBuffer)
+        return false;
+    heap_allocations++;
+
+    if (buffer)
+        free(buffer);
+    buffer = newBuffer;
+    capacity = bytes;
+    used = 0;
+    return true;
+}
+
+void FrameArena::reset()
+{
+    free_overflow();
+    used = 0;
+    // Last frame did not fit -> grow so the next one does
+    if (peak > capacity)
+        reserve(peak);
+    peak = 0;
+}
+
+void* FrameArena::alloc(unsigned bytes)
+{
+    bytes = align(bytes);
+    if (used + overflow_bytes + bytes > peak)
+        peak = used + overflow_bytes + bytes;
+
+    if (used + bytes <= capacity) {
+        void* p = buffer + used;
+        used += bytes;
+        return p;
+    }
+
+    // Out of space: heap block with a link to the previous overflow block
+    const unsigned header = align(sizeof(void*));
+    uint8_t* block = static_cast<uint8_t*>(malloc(header + bytes));
+    if (!block)
+        return nullptr;
+    heap_allocations++;
+    *(void**) block = overflow;
+    overflow = block;
+    overflow_bytes += bytes;
+    return block + header;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+// Bump allocator for per-frame scratch buffers. One malloc'd block that is
+// handed out linearly and reset at the start of every frame, so the render
+// loop does not malloc/free every frame.
+//
+// If a frame needs more than the reserved capacity, the extra requests are
+// served from the heap (and counted). They are released on the next reset()
+// which also grows the block to the peak usage -> only the first frame(s)
+// after a new model was added touch the heap.
+
+#ifndef PC
+#   include <sdk/os/mem.hpp>
+#else
+#   include <cstdlib>
+#endif
+
+#include <stdint.h>
+
+// Every allocation is aligned to this many bytes
+#define FRAME_ARENA_ALIGN 8
+
+class FrameArena {
+private:
+    uint8_t* buffer;
+    unsigned capacity;
+    unsigned used;
+    // Peak bytes requested during the frame (including overflow)
+    unsigned peak;
+    // Singly linked list of heap blocks used when buffer ran out
+    void* overflow;
+    unsigned overflow_bytes;
+    // Number of heap allocations done by the arena since construction
+    unsigned heap_allocations;
+
+    static unsigned align(unsigned bytes)
+    {
+        return (bytes + FRAME_ARENA_ALIGN - 1) & ~(FRAME_ARENA_ALIGN - 1);
+    }
+
+    void free_overflow();
+
+public:
+    FrameArena();
+    ~FrameArena();
+
+    // Makes sure at least bytes can be allocated without touching the heap.
+    // Must not be called while allocations of the current frame are in use.
+    bool reserve(unsigned bytes);
+
+    // Releases every allocation of the frame.
+    void reset();
+
+    // Returns nullptr only if also the heap fallback fails
+    void* alloc(unsigned bytes);
+
+    template <typename T>
+    T* alloc_array(unsigned count)
+    {
+        return static_cast<T*>(alloc(sizeof(T) * count));
+    }
+
+    // Allocations made after mark() can be released with rewind(mark)
+    unsigned mark() const { return used; }
+    void rewind(unsigned marker) { if (marker <= used) used = marker; }
+
+    // Bytes needed to hold count items of T (with alignment padding)
+    template <typename T>
+    static unsigned bytes_for(unsigned count)
+    {
+        return align(sizeof(T) * count);
+    }
+
+    unsigned getCapacity() const { return capacity; }
+    unsigned getHeapAllocations() const { return heap_allocations; }
+};
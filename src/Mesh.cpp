@@ -0,0 +1,278 @@
+#include "Mesh.hpp"
+
+#include "constants.hpp"
+
+#include "Fix16_Utils.hpp"
+
+#include "ObjLoader.hpp"
+
+#ifndef PC
+#   include <sdk/os/file.hpp>
+#else
+#   include <iostream>
+#   include <unistd.h>  // File open & close
+#   include <fcntl.h>   // File open & close
+#endif
+
+// Translate vertices to their geometric center. Moves the offset of the
+// stored positions, the file data is never written.
+static void center_vertices(Mesh& mesh)
+{
+    const unsigned vertex_count = mesh.vertex_count;
+    // Find the current center of the model
+    fix16_vec3 center = {0.0f, 0.0f, 0.0f};
+    for (unsigned int i = 0; i < vertex_count; ++i) {
+        const fix16_vec3 p = mesh_position(mesh, i);
+        center.x += (p.x) / ((int16_t) vertex_count);
+        center.y += (p.y) / ((int16_t) vertex_count);
+        center.z += (p.z) / ((int16_t) vertex_count);
+    }
+    // Translate all vertices by the negative of the center
+    mesh.vertex_offset.x -= center.x;
+    mesh.vertex_offset.y -= center.y;
+    mesh.vertex_offset.z -= center.z;
+}
+
+// Distance between the two vertices furthest apart
+static Fix16 vertices_width(const Mesh& mesh)
+{
+    if (mesh.vertex_count == 0)
+        return 0.0f;
+    // Find two vertices that are furthest apart
+    fix16_vec3 min_vert = mesh_position(mesh, 0);
+    Fix16 last_min_sum = min_vert.x + min_vert.y + min_vert.z;
+    fix16_vec3 max_vert = min_vert;
+    Fix16 last_max_sum = last_min_sum;
+    //
+    // Simply add together all coordinates and one with highest sum
+    // is "furthest" and one with lowest sum is "closest"
+    for (unsigned int i = 1; i < mesh.vertex_count; ++i) {
+        const fix16_vec3 p = mesh_position(mesh, i);
+        Fix16 sum = p.x + p.y + p.z;
+        if (sum < last_min_sum)
+        {
+            last_min_sum = sum;
+            min_vert = p;
+        }
+        else if (sum > last_max_sum)
+        {
+            last_max_sum = sum;
+            max_vert = p;
+        }
+    }
+    Fix16 dx = max_vert.x - min_vert.x;
+    Fix16 dy = max_vert.y - min_vert.y;
+    Fix16 dz = max_vert.z - min_vert.z;
+    return (dx * dx + dy * dy + dz * dz).sqrt();
+}
+
+// n scaled to length 1. Cross products of unscaled models are large, the
+// squares of the components would overflow Fix16: the largest component is
+// brought to 1 first. Zero (degenerate face) stays zero, the face is dark.
+static fix16_vec3 unit_normal(fix16_vec3 n)
+{
+    Fix16 largest = fix16_max(fix16_abs(n.x), fix16_max(fix16_abs(n.y), fix16_abs(n.z)));
+    if (largest == 0.0f)
+        return n;
+    n.x /= largest;
+    n.y /= largest;
+    n.z /= largest;
+    normalize_fix16_vec3(n);
+    return n;
+}
+
+// Unit vector component to 1/MESH_NORMAL_ONE, rounded
+static int16_t normal_component(Fix16 c)
+{
+    const int shift = 16 - MESH_NORMAL_SHIFT;
+    return (int16_t) (((fix16_t) c + (1 << (shift - 1))) >> shift);
+}
+
+// Every index of the triples below count
+template <typename Triple>
+static bool indices_valid(const Triple* triples, unsigned n, unsigned count)
+{
+    for (unsigned i = 0; i < n; ++i) {
+        if (triples[i].First >= count || triples[i].Second >= count || triples[i].Third >= count)
+            return false;
+    }
+    return true;
+}
+
+// Arrays of version 2 files start at multiples of 4 bytes
+static unsigned align4(unsigned offset)
+{
+    return (offset + 3) & ~3u;
+}
+
+fix16_mat3x4 mesh_vertex_matrix(const Mesh& mesh, const fix16_mat3x4& model_to_x)
+{
+    // model_to_x * (offset + scale * p): columns scaled, offset moved into
+    // the translation
+    const Fix16 s[3] = {mesh.vertex_scale.x, mesh.vertex_scale.y, mesh.vertex_scale.z};
+    const fix16_vec3 t = transformPoint(model_to_x, mesh.vertex_offset);
+    const Fix16 tr[3] = {t.x, t.y, t.z};
+    fix16_mat3x4 out;
+    for (int r=0; r<3; r++){
+        for (int c=0; c<3; c++)
+            out.m[r][c] = model_to_x.m[r][c] * s[c];
+        out.m[r][3] = tr[r];
+    }
+    return out;
+}
+
+// File name ends with ".obj" (any case)
+static bool is_obj_path(const char* path)
+{
+    unsigned n = 0;
+    while (path[n] != '\0')
+        n++;
+    const char* ext = ".obj";
+    for (unsigned i = 0; i < 4; i++) {
+        char c = n >= 4 ? path[n - 4 + i] : '\0';
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        if (c != ext[i])
+            return false;
+    }
+    return true;
+}
+
+bool mesh_load(Mesh& mesh, const char* path, bool center)
+{
+    if (is_obj_path(path))
+        return mesh_load_obj(mesh, path, center);
+    mesh = Mesh();
+
+    int fd = open(path, UNIVERSIAL_FILE_READ );
+    if (fd < 0){
+#ifdef PC
+        std::cout << "Could not open " << path << std::endl;
+#endif
+        return false;
+    }
+    const bool loaded = mesh_load_region(mesh, file_region(fd), path, center);
+    close(fd);
+    return loaded;
+}
+
+bool mesh_load_region(Mesh& mesh, const FileRegion& region, const char* name, bool center)
+{
+    (void) name; // Printed only on PC
+    mesh = Mesh();
+
+    // Long enough for either version, a short file leaves zeros
+    uint32_t header[16] = {0};
+    lseek(region.fd, region.offset, SEEK_SET);
+    read(region.fd, header, region.size < sizeof(header) ? region.size : sizeof(header));
+    const bool v2 = header[0] == MESH_MAGIC_V2;
+    const uint32_t* counts = v2 ? header + 1 : header;
+    const uint32_t vert_count    = counts[0];
+    const uint32_t face_count    = counts[1];
+    const uint32_t uvface_count  = counts[2];
+    const uint32_t uvcoord_count = counts[3];
+    const uint32_t index_size    = v2 ? header[5] : sizeof(unsigned);
+
+    const unsigned header_size   = v2 ? sizeof(header) : 4 * sizeof(uint32_t);
+    const unsigned vertex_size   = v2 ? sizeof(int16_vec3) : sizeof(fix16_vec3);
+    const unsigned uv_size       = v2 ? sizeof(int16_vec2) : sizeof(fix16_vec2);
+
+    // Counts must fit the file, every item takes at least 4 bytes (also
+    // keeps the byte counts below from overflowing). 16b indices only
+    // reach 65536 items.
+    const uint32_t max_count = region.size / 4;
+    bool valid = vert_count <= max_count && face_count <= max_count &&
+                 uvface_count <= max_count && uvcoord_count <= max_count &&
+                 (uvface_count == 0 || uvface_count == face_count) &&
+                 (index_size == 4 || (index_size == 2 && vert_count <= 65536 && uvcoord_count <= 65536));
+
+    unsigned lseek_vert_start    = header_size;
+    unsigned lseek_face_start    = align4(lseek_vert_start   + vert_count   * vertex_size);
+    unsigned lseek_uvface_start  = align4(lseek_face_start   + face_count   * 3 * index_size);
+    unsigned lseek_uvcoord_start = align4(lseek_uvface_start + uvface_count * 3 * index_size);
+    unsigned lseek_end           = lseek_uvcoord_start + uvcoord_count * uv_size;
+
+    // Whole file in one block, face normals in its scratch memory
+    valid = valid && lseek_end <= region.size &&
+            file_blob_read(mesh.file, region.fd, region.offset, lseek_end, sizeof(int16_vec3) * face_count);
+    if (!valid){
+#ifdef PC
+        std::cout << "Could not read " << name << ", counts do not match the file size" << std::endl;
+#endif
+        mesh = Mesh();
+        return false;
+    }
+
+    uint8_t* data = mesh.file.data;
+    mesh.vertex_count   = vert_count;
+    mesh.faces_count    = face_count;
+    mesh.uv_face_count  = uvface_count;
+    mesh.uv_coord_count = uvcoord_count;
+    if (v2){
+        const fix16_t* q = (const fix16_t*) (header + 6);
+        mesh.qvertices     = (int16_vec3*) (data + lseek_vert_start);
+        mesh.vertex_offset = {Fix16(q[0]), Fix16(q[1]), Fix16(q[2])};
+        mesh.vertex_scale  = {Fix16(q[3]), Fix16(q[4]), Fix16(q[5])};
+        mesh.quv_coords    = (int16_vec2*) (data + lseek_uvcoord_start);
+        mesh.uv_offset     = {Fix16(q[6]), Fix16(q[7])};
+        mesh.uv_scale      = {Fix16(q[8]), Fix16(q[9])};
+    }
+    else{
+        mesh.vertices      = (fix16_vec3*) (data + lseek_vert_start);
+        mesh.vertex_offset = {0.0f, 0.0f, 0.0f};
+        mesh.vertex_scale  = {1.0f, 1.0f, 1.0f};
+        mesh.uv_coords     = (fix16_vec2*) (data + lseek_uvcoord_start);
+        mesh.uv_offset     = {0.0f, 0.0f};
+        mesh.uv_scale      = {1.0f, 1.0f};
+    }
+    bool indices_ok;
+    if (index_size == 2){
+        mesh.faces16    = (u16_triple*) (data + lseek_face_start);
+        mesh.uv_faces16 = (u16_triple*) (data + lseek_uvface_start);
+        indices_ok = indices_valid(mesh.faces16, face_count, vert_count) &&
+                     indices_valid(mesh.uv_faces16, uvface_count, uvcoord_count);
+    }
+    else{
+        mesh.faces    = (u_triple*) (data + lseek_face_start);
+        mesh.uv_faces = (u_triple*) (data + lseek_uvface_start);
+        indices_ok = indices_valid(mesh.faces, face_count, vert_count) &&
+                     indices_valid(mesh.uv_faces, uvface_count, uvcoord_count);
+    }
+    mesh.face_normals   = (int16_vec3*) mesh.file.extra;
+
+    if (!indices_ok){
+#ifdef PC
+        std::cout << "Could not read " << name << ", index out of range" << std::endl;
+#endif
+        mesh_free(mesh);
+        return false;
+    }
+    mesh_finish_load(mesh, center);
+    return true;
+}
+
+void mesh_finish_load(Mesh& mesh, bool center)
+{
+    // Face normals for lighting. Centering and uniform scaling the model
+    // later on does not turn them.
+    for (unsigned i = 0; i < mesh.faces_count; ++i) {
+        const u_triple f = mesh_face(mesh, i);
+        const fix16_vec3 n = unit_normal(calculateNormal(
+            mesh_position(mesh, f.First),
+            mesh_position(mesh, f.Second),
+            mesh_position(mesh, f.Third)
+        ));
+        mesh.face_normals[i] = {normal_component(n.x), normal_component(n.y), normal_component(n.z)};
+    }
+
+    // Center model
+    if(center)
+        center_vertices(mesh);
+    mesh.width = vertices_width(mesh);
+}
+
+void mesh_free(Mesh& mesh)
+{
+    file_blob_free(mesh.file);
+    mesh = Mesh();
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+// Vertex, face and uv data of a model file. Never changed once loaded, so
+// every model drawing the same file shares one Mesh (see AssetCache.hpp).
+
+#include "RenderFP3D.hpp"
+
+#include "FileBlob.hpp"
+
+struct u_pair {
+    unsigned First;
+    unsigned Second;
+};
+
+struct u_triple {
+    unsigned First;
+    unsigned Second;
+    unsigned Third;
+};
+
+struct u16_triple {
+    uint16_t First;
+    uint16_t Second;
+    uint16_t Third;
+};
+
+// Quantized vectors, units depend on the array (see Mesh)
+struct int16_vec3 {
+    int16_t x;
+    int16_t y;
+    int16_t z;
+};
+
+struct int16_vec2 {
+    int16_t x;
+    int16_t y;
+};
+
+// "PKO2", first in version 2 .pkObj files
+#define MESH_MAGIC_V2 0x504B4F32
+
+// Face normal components are stored in 1/MESH_NORMAL_ONE
+#define MESH_NORMAL_SHIFT 14
+#define MESH_NORMAL_ONE   (1 << MESH_NORMAL_SHIFT)
+
+struct Mesh
+{
+    unsigned vertex_count;
+    unsigned faces_count;
+    unsigned uv_face_count;
+    unsigned uv_coord_count;
+
+    // Vertex positions as stored in the file: Fix16 (version 1) or 16b
+    // quantized in 1/65536 (version 2), the other one is nullptr. The model
+    // space position is vertex_offset + vertex_scale * stored position (see
+    // mesh_position), the renderer folds that into its vertex transform
+    // (see mesh_vertex_matrix).
+    fix16_vec3* vertices;
+    int16_vec3* qvertices;
+    fix16_vec3  vertex_offset;
+    fix16_vec3  vertex_scale;
+
+    // Vertex and uv coord indices of the faces, 32b or 16b (the other
+    // one is nullptr)
+    u_triple*   faces;
+    u16_triple* faces16;
+    u_triple*   uv_faces;
+    u16_triple* uv_faces16;
+
+    // Uv coords, stored like the vertex positions
+    fix16_vec2* uv_coords;
+    int16_vec2* quv_coords;
+    fix16_vec2  uv_offset;
+    fix16_vec2  uv_scale;
+
+    // Unit normal of every face in model space in 1/MESH_NORMAL_ONE,
+    // computed when loaded
+    int16_vec3* face_normals;
+
+    // Distance between the two furthest apart vertices (see
+    // Model::_scaleModelTo)
+    Fix16 width;
+
+    // The file, the arrays above point into it (face_normals into its
+    // scratch memory)
+    FileBlob file;
+};
+
+inline u_triple mesh_face(const Mesh& mesh, unsigned f_id)
+{
+    if (mesh.faces16 != nullptr){
+        const u16_triple& f = mesh.faces16[f_id];
+        return {f.First, f.Second, f.Third};
+    }
+    return mesh.faces[f_id];
+}
+
+inline u_triple mesh_uv_face(const Mesh& mesh, unsigned f_id)
+{
+    if (mesh.uv_faces16 != nullptr){
+        const u16_triple& f = mesh.uv_faces16[f_id];
+        return {f.First, f.Second, f.Third};
+    }
+    return mesh.uv_faces[f_id];
+}
+
+// Vertex position as stored, quantized ones in [-0.5, 0.5)
+inline fix16_vec3 mesh_stored_vertex(const Mesh& mesh, unsigned v_id)
+{
+    if (mesh.qvertices != nullptr){
+        const int16_vec3& q = mesh.qvertices[v_id];
+        return {Fix16((fix16_t) q.x), Fix16((fix16_t) q.y), Fix16((fix16_t) q.z)};
+    }
+    return mesh.vertices[v_id];
+}
+
+// Vertex position in model space
+inline fix16_vec3 mesh_position(const Mesh& mesh, unsigned v_id)
+{
+    const fix16_vec3 p = mesh_stored_vertex(mesh, v_id);
+    return {
+        mesh.vertex_offset.x + mesh.vertex_scale.x * p.x,
+        mesh.vertex_offset.y + mesh.vertex_scale.y * p.y,
+        mesh.vertex_offset.z + mesh.vertex_scale.z * p.z
+    };
+}
+
+inline fix16_vec2 mesh_uv(const Mesh& mesh, unsigned uv_id)
+{
+    if (mesh.quv_coords != nullptr){
+        const int16_vec2& q = mesh.quv_coords[uv_id];
+        return {
+            mesh.uv_offset.x + mesh.uv_scale.x * Fix16((fix16_t) q.x),
+            mesh.uv_offset.y + mesh.uv_scale.y * Fix16((fix16_t) q.y)
+        };
+    }
+    return mesh.uv_coords[uv_id];
+}
+
+inline fix16_vec3 mesh_face_normal(const Mesh& mesh, unsigned f_id)
+{
+    const int16_vec3& n = mesh.face_normals[f_id];
+    const int shift = 16 - MESH_NORMAL_SHIFT;
+    return {Fix16((fix16_t) n.x << shift), Fix16((fix16_t) n.y << shift), Fix16((fix16_t) n.z << shift)};
+}
+
+// Transform taking the stored vertex positions where model_to_x takes the
+// model space ones
+fix16_mat3x4 mesh_vertex_matrix(const Mesh& mesh, const fix16_mat3x4& model_to_x);
+
+// Loads a .pkObj file (run obj through python script to generate the
+// binary format), vertices moved to their geometric center with center.
+//
+// Version 1: [1] 32b vertex count, face count, uv face count, uv coord count
+//            [vertex count]   3x 32b Fix16 x, y, z
+//            [face count]     3x 32b vertex index
+//            [uv face count]  3x 32b uv coord index (0 or one per face)
+//            [uv coord count] 2x 32b Fix16 u, v
+// Version 2: [1] 32b MESH_MAGIC_V2
+//            [1] 32b vertex count, face count, uv face count, uv coord count
+//            [1] 32b index size in bytes, 2 or 4
+//            [1] 3x 32b Fix16 vertex offset, 3x 32b Fix16 vertex scale
+//            [1] 2x 32b Fix16 uv offset, 2x 32b Fix16 uv scale
+//            [vertex count]   3x 16b quantized x, y, z
+//            [face count]     3x index
+//            [uv face count]  3x index
+//            [uv coord count] 2x 16b quantized u, v
+//            Every array starts at a multiple of 4 bytes (zero padded).
+// The whole file is read as one block (see FileBlob.hpp). Returns false if
+// it could not be read or the counts and indices do not match the file,
+// the mesh is then empty. Paths ending with .obj are parsed as text
+// instead (see mesh_load_obj).
+bool mesh_load(Mesh& mesh, const char* path, bool center);
+// Same from a region of an open file (e.g. a bundle entry), name is only
+// used in messages
+bool mesh_load_region(Mesh& mesh, const FileRegion& region, const char* name, bool center);
+
+// Face normals, centering (with center) and width of a mesh whose arrays
+// were just filled by a loader
+void mesh_finish_load(Mesh& mesh, bool center);
+
+void mesh_free(Mesh& mesh);
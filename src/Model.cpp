@@ -1,184 +1,87 @@
 #include "Model.hpp"
 
-#include "StringUtils.hpp"
-
-#include "constants.hpp"
+#include "AssetCache.hpp"
 
 #ifndef PC
-#   include <sdk/os/file.hpp>
 #   include <sdk/os/mem.hpp>
-#   include <sdk/os/debug.hpp>
-#   include <sdk/os/lcd.hpp>
 #else
-#   include <SDL2/SDL.h>
+#   include <cstdlib>   // malloc & free
 #   include <iostream>
-#   include <unistd.h>  // File open & close
-#   include <fcntl.h>   // File open & close
 #endif
 
 Model::~Model()
 {
-    if(loaded_from_file)
-    {
-        free(vertices);
-        free(faces);
-        free(uv_faces);
-        free(uv_coords);
-        if(has_texture){
-            free(gen_uv_tex);
-        }
+    free(face_draw_order);
+    free(screen_coords);
+    free(vert_z_depths);
+    free(clip_codes);
+    if (mesh != nullptr)
+        assets->release(mesh);
+    if(has_texture){
+        assets->release(texture);
     }
 }
 
 Model::Model(
+    AssetCache& assets,
     char* fname,
     char* ftexture,
-    bool centerVertices
-) : loaded_from_file(false),
+    bool centerVertices,
+    int textureMaxSize,
+    const AssetBundle* bundle
+) : assets(&assets),
     position({0.0f, 0.0f, 0.0f}), rotation({0.0f, 0.0f}), scale({1.0f,1.0f,1.0f}),
-    vertices(nullptr), vertex_count(0),
-    faces(nullptr), faces_count(0),
+    mesh(nullptr),
+    face_draw_order(nullptr),
+    screen_coords(nullptr),
+    vert_z_depths(nullptr),
+    clip_codes(nullptr),
     has_texture(false),
-    gen_textureWidth(0), gen_textureHeight(0),
-    render_mode(0)
-{
-    loaded_from_file = this->load_from_binary_obj_file(fname, ftexture, centerVertices);
-}
-
-fix16_vec3& Model::getPosition_ref()
+    texture(nullptr),
+    render_mode(0),
+    backface_culling(true)
 {
-    return this->position;
-}
-
-fix16_vec2& Model::getRotation_ref()
-{
-    return this->rotation;
-}
-
-fix16_vec3& Model::getScale_ref()
-{
-    return this->scale;
-}
-
-// Transform original model vertices to the geometric center
-void Model::_centerModel()
-{
-    // Find the current center of the model
-    fix16_vec3 center = {0.0f, 0.0f, 0.0f};
-    for (unsigned int i = 0; i < vertex_count; ++i) {
-        center.x += (vertices[i].x) / ((int16_t) vertex_count);
-        center.y += (vertices[i].y) / ((int16_t) vertex_count);
-        center.z += (vertices[i].z) / ((int16_t) vertex_count);
-    }
-    // Translate all vertices by the negative of the center
-    for (unsigned int  i = 0; i < vertex_count; ++i) {
-        vertices[i].x -= center.x;
-        vertices[i].y -= center.y;
-        vertices[i].z -= center.z;
-    }
-}
-
-// Transform raw model vertices to the geometric center
-void Model::_scaleModel(Fix16 factor)
-{
-    // Translate all vertices by the negative of the center
-    for (unsigned int  i = 0; i < vertex_count; ++i) {
-        vertices[i].x *= factor;
-        vertices[i].y *= factor;
-        vertices[i].z *= factor;
+    invalidateTransform();
+
+    this->mesh = assets.acquireMesh(fname, centerVertices, bundle);
+    if (this->mesh == nullptr)
+        return;
+    const unsigned vertex_count = this->mesh->vertex_count;
+    const unsigned faces_count  = this->mesh->faces_count;
+
+    // Per-model buffers: draw order and the transformed vertices, filled
+    // by the renderer
+    this->face_draw_order = (uint_fix16_t*) malloc(sizeof(uint_fix16_t) * faces_count);
+    this->screen_coords   = (int16_t_vec2*) malloc(sizeof(int16_t_vec2) * vertex_count);
+    this->vert_z_depths   = (Fix16*)        malloc(sizeof(Fix16)        * vertex_count);
+    this->clip_codes      = (uint8_t*)      malloc(sizeof(uint8_t)      * vertex_count);
+    // malloc(0) may return nullptr too
+    const bool faces_ok    = this->face_draw_order != nullptr || faces_count == 0;
+    const bool vertices_ok = (this->screen_coords != nullptr && this->vert_z_depths != nullptr &&
+                              this->clip_codes != nullptr) || vertex_count == 0;
+    if (!faces_ok || !vertices_ok){
+        // Out of memory: same as a mesh that could not be loaded
+        free(this->face_draw_order);
+        free(this->screen_coords);
+        free(this->vert_z_depths);
+        free(this->clip_codes);
+        this->face_draw_order = nullptr;
+        this->screen_coords   = nullptr;
+        this->vert_z_depths   = nullptr;
+        this->clip_codes      = nullptr;
+        assets.release(this->mesh);
+        this->mesh = nullptr;
+#ifdef PC
+        std::cout << "Out of memory for a model of " << fname << std::endl;
+#endif
+        return;
     }
-}
 
-// Scales model such that max distance between to furthest
-void Model::_scaleModelTo(Fix16 maxWidth)
-{
-    // Find two vertices that are furthest apart
-    fix16_vec3 min_vert = {vertices[0].x, vertices[0].y ,vertices[0].z};
-    Fix16 last_min_sum = vertices[0].x + vertices[0].y + vertices[0].z;
-    fix16_vec3 max_vert = {vertices[0].x, vertices[0].y ,vertices[0].z};
-    Fix16 last_max_sum = vertices[0].x + vertices[0].y + vertices[0].z;
-    //
-    // Simply add together all coordinates and one with highest sum
-    // is "furthest" and one with lowest sum is "closest"
-    for (unsigned int i = 1; i < vertex_count; ++i) {
-        Fix16 sum = vertices[i].x + vertices[i].y + vertices[i].z;
-        if (sum < last_min_sum)
-        {
-            last_min_sum = sum;
-            min_vert = {vertices[i].x, vertices[i].y ,vertices[i].z};
-        }
-        else if (sum > last_max_sum)
-        {
-            last_max_sum = sum;
-            max_vert = {vertices[i].x, vertices[i].y ,vertices[i].z};
-        }
+    // Initial draw order is the file order
+    for (unsigned i = 0; i < faces_count; ++i) {
+        this->face_draw_order[i].uint  = i;
+        this->face_draw_order[i].fix16 = 0.0f;
     }
-    Fix16 dx = max_vert.x - min_vert.x;
-    Fix16 dy = max_vert.y - min_vert.y;
-    Fix16 dz = max_vert.z - min_vert.z;
-    Fix16 currentMaxWidth = (dx * dx + dy * dy + dz * dz).sqrt();
-    Fix16 scaleFactor = maxWidth/currentMaxWidth;
-
-    _scaleModel(scaleFactor);
-}
-
-// Scale raw model vertices
-bool Model::load_from_binary_obj_file(char* fname, char* ftexture, bool center)
-{
-    // ~~~~~~~~~~~~~~~~~~~~~ Object ~~~~~~~~~~~~~~~~~~~~~
-
-    int fd = open(fname, UNIVERSIAL_FILE_READ );
-    char buff[32] = {0};
-
-    read(fd, buff, 31);
-    uint32_t vert_count = *((uint32_t*)(buff+0));
-    uint32_t face_count = *((uint32_t*)(buff+4));
-    uint32_t uvface_count  = *((uint32_t*)(buff+8));
-    uint32_t uvcoord_count = *((uint32_t*)(buff+12));
-
-    //
-    this->vertex_count = vert_count;
-    this->faces_count = face_count;
-    this->uv_face_count = uvface_count;
-    this->uv_coord_count = uvcoord_count;
-    //uvface_count
-    unsigned lseek_vert_start    = 16;
-    unsigned lseek_vert_end      = lseek_vert_start + vert_count * 3 * 4;
-
-    unsigned lseek_face_start    = lseek_vert_end;
-    unsigned lseek_face_end      = lseek_face_start + faces_count * 3 * 4;
-
-    unsigned lseek_uvface_start  = lseek_face_end;
-    unsigned lseek_uvface_end    = lseek_uvface_start + uv_face_count * 3 * 4;
-
-    unsigned lseek_uvcoord_start = lseek_uvface_end;
-
-    // Read binary to vertices
-    lseek(fd, lseek_vert_start, SEEK_SET);
-    this->vertices = (fix16_vec3*) malloc(sizeof(fix16_vec3) * this->vertex_count);
-    read(fd, this->vertices, vert_count*3*4);   // vert_count(?x) * x,y,z(3x) * 32b Fix16 (4bytes)
-
-    // Read binary to faces
-    lseek(fd, lseek_face_start, SEEK_SET);
-    this->faces    = (u_triple*)   malloc(sizeof(u_triple)   * this->faces_count);
-    read(fd, this->faces, face_count*3*4);      // face_count(?x) * v0 v1 v2 (3x) * 32b unsigned (4bytes)
-
-    // Read binary to uv faces
-    lseek(fd, lseek_uvface_start, SEEK_SET);
-    this->uv_faces = (u_triple*)   malloc(sizeof(u_triple)   * this->uv_face_count);
-    read(fd, this->uv_faces, uvface_count*3*4); // uv_face_count(?x) * v0 v1 v2 (3x) * 32b unsigned (4bytes)
-
-    // Read binary to uv coords
-    lseek(fd, lseek_uvcoord_start, SEEK_SET);
-    this->uv_coords = (fix16_vec2*) malloc(sizeof(fix16_vec2) * this->uv_coord_count);
-    read(fd, this->uv_coords, uv_coord_count*2*4);   // uv_coord_count(?x) * u,v(2x) * 32b Fix16 (4bytes)
-
-    // File has been completely read
-    close(fd);
-
-    // Center model
-    if(center)
-        _centerModel();
 
     // ~~~~~~~~~~~~~~~~~~~~~ Texture ~~~~~~~~~~~~~~~~~~~~~
 
@@ -186,43 +89,47 @@ bool Model::load_from_binary_obj_file(char* fname, char* ftexture, bool center)
 #ifdef PC
         std::cout << "No texture was provided" << std::endl;
 #endif
-        this->has_texture = false;
-        return true;
+        return;
     }
 
-    if (uv_face_count == 0){
+    if (this->mesh->uv_face_count == 0){
 #ifdef PC
         std::cout << "Model has no texture (No UV coordinates). Not loading texture." << std::endl;
 #endif
-        this->has_texture = false;
-        return true;
+        return;
     }
 
-    // Now load
-    fd = open(ftexture, UNIVERSIAL_FILE_READ);
-    memset(buff, 0, 32);
-    read(fd, buff, 31);
-    uint32_t tex_size_x = *((uint32_t*)(buff+0));
-    uint32_t tex_size_y = *((uint32_t*)(buff+4));
+    this->texture = assets.acquireTexture(ftexture, textureMaxSize, bundle);
+    this->has_texture = (this->texture != nullptr);
+}
 
-    unsigned lseek_texture_start    = 8;
+void Model::invalidateTransform()
+{
+    transform_cache.valid = false;
+    transform_cache.faces = ModelTransformCache::FACES_STALE;
+    transform_cache.faces_backface_culling = backface_culling;
+}
 
-    this->gen_textureWidth  = tex_size_x;
-    this->gen_textureHeight = tex_size_y;
-    this->has_texture = true;
+fix16_vec3& Model::getPosition_ref()
+{
+    return this->position;
+}
 
-#ifdef PC
-        std::cout
-                 << "tex_size_x = " << tex_size_x
-                 << " tex_size_y = " << tex_size_y
-                 << std::endl;
-#endif
-    // Read binary to textuer
-    lseek(fd, lseek_texture_start, SEEK_SET);
-    this->gen_uv_tex = (uint32_t*) malloc(sizeof(uint32_t) * tex_size_x*tex_size_y);
-    read(fd, this->gen_uv_tex, tex_size_x*tex_size_y*4);   // tex_size_x*tex_size_y(?x) * 32b Fix16 (4bytes)
+fix16_vec2& Model::getRotation_ref()
+{
+    return this->rotation;
+}
 
-    close(fd);
+fix16_vec3& Model::getScale_ref()
+{
+    return this->scale;
+}
 
-    return true;
+// Scales model such that max distance between to furthest
+void Model::_scaleModelTo(Fix16 maxWidth)
+{
+    if (mesh->width == 0.0f)
+        return;
+    const Fix16 scaleFactor = maxWidth/mesh->width;
+    scale = {scaleFactor, scaleFactor, scaleFactor};
 }
@@ -3,48 +3,71 @@
 // TODO: Make separate file for fix16 vectors instead. . .
 #include "RenderFP3D.hpp"
 
-struct u_pair {
-    unsigned First;
-    unsigned Second;
-};
+#include "Mesh.hpp"
+
+#include "Texture.hpp"
 
-struct u_triple {
-    unsigned First;
-    unsigned Second;
-    unsigned Third;
+class AssetCache;
+struct AssetBundle;
+
+// Vertex transform of a model kept between frames (see Renderer::update).
+// Valid as long as the model to camera transform and the FOV stay the same,
+// static models are then only rasterized.
+struct ModelTransformCache
+{
+    bool valid;
+    // Transform the vertices were projected with
+    fix16_mat3x4 model_to_camera;
+    Fix16 FOV;
+    // Screen bbox of the projected vertices
+    int16_t_vec2 bbox_max;
+    int16_t_vec2 bbox_min;
+    // What face_draw_order holds for this transform: the faces to draw in
+    // front (culled) and sorted by depth or not
+    enum : uint8_t { FACES_STALE, FACES_CULLED, FACES_SORTED } faces;
+    bool faces_backface_culling; // backface_culling the faces were culled with
+    unsigned faces_visible;
+    unsigned faces_culled;
 };
 
+// One drawn copy of a mesh: transform, render settings and per-frame
+// vertex data. Mesh and texture are shared with the other models of the
+// same files (see AssetCache.hpp).
 class Model
 {
 private:
-    bool loaded_from_file;
-
-    // Transform raw model vertices to the geometric center
-    void _centerModel();
+    AssetCache* assets;
 
 public:
 
-    Model(char* fname, char* ftexture, bool centerVertices);
+    // textureMaxSize > 0 skips texture mip levels larger than that (see
+    // texture_load). With bundle fname and ftexture are names of its
+    // entries (see AssetCache::acquireMesh).
+    Model(AssetCache& assets, char* fname, char* ftexture, bool centerVertices, int textureMaxSize = 0,
+          const AssetBundle* bundle = nullptr);
     ~Model();
 
     fix16_vec3 position;
     fix16_vec2 rotation;
     fix16_vec3 scale;
 
-    fix16_vec3* vertices;
-    unsigned    vertex_count;
-    u_triple*   faces;
-    unsigned    faces_count;
+    Mesh* mesh;   // nullptr if the file could not be loaded or memory ran out
+
+    // Faces in draw order (farthest first). Kept between frames so the
+    // depth sort starts from last frame's order.
+    uint_fix16_t* face_draw_order;
+
+    // Transformed vertices (vertex_count each) and their cache state
+    int16_t_vec2* screen_coords;
+    Fix16*        vert_z_depths;
+    uint8_t*      clip_codes;
+    ModelTransformCache transform_cache;
 
-    fix16_vec2* uv_coords;
-    unsigned    uv_coord_count;
-    u_triple*   uv_faces;
-    unsigned    uv_face_count;
+    // Forget the cached transform
+    void invalidateTransform();
 
     bool has_texture;
-    int gen_textureWidth;
-    int gen_textureHeight;
-    uint32_t * gen_uv_tex; // Malloced array of size: gen_textureWidth * gen_textureHeight
+    Texture* texture;   // nullptr without texture
 
     fix16_vec3& getPosition_ref();
     fix16_vec2& getRotation_ref();
@@ -52,13 +75,12 @@ public:
 
     uint16_t render_mode;
 
-    // Run obj through python script to generate binary format
-    bool load_from_binary_obj_file(char* fname, char* ftexture, bool center=true);
+    // Skip faces facing away from the camera. Disable for open meshes
+    // (e.g. single sided planes) whose back side must stay visible.
+    bool backface_culling;
 
-    // Scale raw model vertices
-    void _scaleModel(Fix16 factor);
-    // Scale raw model vertices such that distance between its 2 furthest
-    // apart vertices is given maxWidth
+    // Sets scale such that distance between the 2 furthest apart vertices
+    // of the mesh is maxWidth. The shared mesh is not changed.
     void _scaleModelTo(Fix16 maxWidth);
 
 };
@@ -0,0 +1,285 @@
+#include "ObjLoader.hpp"
+
+#include "StringUtils.hpp"
+
+#include "constants.hpp"
+
+#ifndef PC
+#   include <sdk/os/file.hpp>
+#   include <sdk/os/mem.hpp>
+#else
+#   include <cstdlib>   // malloc & free
+#   include <iostream>
+#   include <unistd.h>  // File open & close
+#   include <fcntl.h>   // File open & close
+#endif
+
+enum ObjRecord
+{
+    OBJ_RECORD_OTHER,   // Comments, normals, groups, materials, ...
+    OBJ_RECORD_VERTEX,  // v x y z
+    OBJ_RECORD_UV,      // vt u v
+    OBJ_RECORD_FACE     // f v/vt/vn v/vt/vn v/vt/vn ...
+};
+
+struct ObjCounts
+{
+    unsigned vertices;
+    unsigned uv_coords;
+    unsigned faces;     // Triangles
+    unsigned uv_faces;  // Triangles of faces with uv coords
+};
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static const char* skip_spaces(const char* s)
+{
+    while (is_space(*s))
+        s++;
+    return s;
+}
+
+// Record type of the line, s moved past its keyword
+static ObjRecord obj_record(const char*& s)
+{
+    s = skip_spaces(s);
+    if (s[0] == 'v' && is_space(s[1])){
+        s += 1;
+        return OBJ_RECORD_VERTEX;
+    }
+    if (s[0] == 'v' && s[1] == 't' && is_space(s[2])){
+        s += 2;
+        return OBJ_RECORD_UV;
+    }
+    if (s[0] == 'f' && is_space(s[1])){
+        s += 1;
+        return OBJ_RECORD_FACE;
+    }
+    return OBJ_RECORD_OTHER;
+}
+
+// One face corner "v", "v/vt", "v/vt/vn" or "v//vn". vt is 0 without uv.
+// Returns where the corner ended, nullptr if it is malformed.
+static const char* parse_corner(const char* s, int& v, int& vt)
+{
+    const char* end;
+    vt = 0;
+    v = custom_strtol(s, &end);
+    if (end == s || v == 0)
+        return nullptr;
+    if (*end == '/'){
+        s = end + 1;
+        end = s;
+        if (*s != '/'){
+            vt = custom_strtol(s, &end);
+            if (end == s || vt == 0)
+                return nullptr;
+        }
+        if (*end == '/'){
+            s = end + 1;
+            custom_strtol(s, &end);
+            if (end == s)
+                return nullptr;
+        }
+    }
+    if (*end != '\0' && !is_space(*end))
+        return nullptr;
+    return end;
+}
+
+// 1 based OBJ index (negative ones count back from the last item read so
+// far) to 0 based. False when outside of the count items.
+static bool obj_index(int index, unsigned read_so_far, unsigned count, unsigned& out)
+{
+    const int i = index > 0 ? index - 1 : (int) read_so_far + index;
+    out = (unsigned) i;
+    return i >= 0 && (unsigned) i < count;
+}
+
+// Counts the corners of the face, with uv when its first corner has one
+static bool count_face(const char* s, unsigned& corners, bool& has_uv)
+{
+    corners = 0;
+    has_uv = false;
+    for (s = skip_spaces(s); *s != '\0'; s = skip_spaces(s)){
+        int v, vt;
+        s = parse_corner(s, v, vt);
+        if (s == nullptr)
+            return false;
+        if (corners == 0)
+            has_uv = vt != 0;
+        corners++;
+    }
+    return corners >= 3;
+}
+
+// First pass: number of items of every array
+static bool count_records(LineReader& reader, ObjCounts& counts, unsigned& line_number)
+{
+    counts = {0, 0, 0, 0};
+    line_number = 0;
+    for (char* line; (line = line_reader_next(reader)) != nullptr; ){
+        line_number++;
+        const char* s = line;
+        switch (obj_record(s)){
+        case OBJ_RECORD_VERTEX: counts.vertices++;  break;
+        case OBJ_RECORD_UV:     counts.uv_coords++; break;
+        case OBJ_RECORD_FACE: {
+            unsigned corners;
+            bool has_uv;
+            if (!count_face(s, corners, has_uv))
+                return false;
+            counts.faces += corners - 2;
+            if (has_uv)
+                counts.uv_faces += corners - 2;
+            break;
+        }
+        default: break;
+        }
+    }
+    return !reader.too_long;
+}
+
+// n Fix16 numbers
+static bool parse_numbers(const char* s, Fix16* values, int n)
+{
+    for (int i = 0; i < n; i++){
+        const char* end;
+        s = skip_spaces(s);
+        values[i] = Fix16(custom_atofix16(s, &end));
+        if (end == s || (*end != '\0' && !is_space(*end)))
+            return false;
+        s = end;
+    }
+    return true;
+}
+
+// Second pass: arrays of the mesh, sized by the first pass
+static bool fill_records(LineReader& reader, Mesh& mesh, const ObjCounts& counts, unsigned& line_number)
+{
+    ObjCounts read = {0, 0, 0, 0};
+    line_number = 0;
+    for (char* line; (line = line_reader_next(reader)) != nullptr; ){
+        line_number++;
+        const char* s = line;
+        switch (obj_record(s)){
+        case OBJ_RECORD_VERTEX: {
+            Fix16 p[3];
+            if (!parse_numbers(s, p, 3) || read.vertices >= counts.vertices)
+                return false;
+            mesh.vertices[read.vertices++] = {p[0], p[1], p[2]};
+            break;
+        }
+        case OBJ_RECORD_UV: {
+            Fix16 uv[2];
+            if (!parse_numbers(s, uv, 2) || read.uv_coords >= counts.uv_coords)
+                return false;
+            mesh.uv_coords[read.uv_coords++] = {uv[0], Fix16(fix16_one) - uv[1]};
+            break;
+        }
+        case OBJ_RECORD_FACE: {
+            // Fan around the first corner: (0, 1, 2), (0, 2, 3), ...
+            unsigned first = 0, first_uv = 0, prev = 0, prev_uv = 0;
+            unsigned corners = 0;
+            bool has_uv = false;
+            for (s = skip_spaces(s); *s != '\0'; s = skip_spaces(s)){
+                int v, vt;
+                unsigned vi, vti = 0;
+                s = parse_corner(s, v, vt);
+                if (s == nullptr || !obj_index(v, read.vertices, counts.vertices, vi))
+                    return false;
+                if (corners == 0)
+                    has_uv = vt != 0;
+                if (has_uv && (vt == 0 || !obj_index(vt, read.uv_coords, counts.uv_coords, vti)))
+                    return false;
+                if (corners == 0){
+                    first = vi;
+                    first_uv = vti;
+                }
+                else if (corners >= 2){
+                    if (read.faces >= counts.faces)
+                        return false;
+                    mesh.faces[read.faces++] = {first, prev, vi};
+                    if (mesh.uv_face_count > 0)
+                        mesh.uv_faces[read.uv_faces++] = {first_uv, prev_uv, vti};
+                }
+                prev = vi;
+                prev_uv = vti;
+                corners++;
+            }
+            break;
+        }
+        default: break;
+        }
+    }
+    return !reader.too_long && read.vertices == counts.vertices && read.faces == counts.faces;
+}
+
+bool mesh_load_obj(Mesh& mesh, const char* path, bool center)
+{
+    mesh = Mesh();
+
+    int fd = open(path, UNIVERSIAL_FILE_READ);
+    if (fd < 0){
+#ifdef PC
+        std::cout << "Could not open " << path << std::endl;
+#endif
+        return false;
+    }
+    char* buf = (char*) malloc(OBJ_READ_BUFFER_SIZE);
+    if (buf == nullptr){
+        close(fd);
+        return false;
+    }
+
+    LineReader reader;
+    line_reader_init(reader, fd, buf, OBJ_READ_BUFFER_SIZE);
+    ObjCounts counts;
+    unsigned line_number;
+    bool ok = count_records(reader, counts, line_number);
+
+    // Uv faces only when they line up with the faces
+    const unsigned uv_face_count = counts.uv_faces == counts.faces ? counts.faces : 0;
+    const unsigned vertex_bytes  = counts.vertices  * sizeof(fix16_vec3);
+    const unsigned face_bytes    = counts.faces     * sizeof(u_triple);
+    const unsigned uv_face_bytes = uv_face_count    * sizeof(u_triple);
+    const unsigned uv_bytes      = counts.uv_coords * sizeof(fix16_vec2);
+    ok = ok && file_blob_alloc(mesh.file, vertex_bytes + face_bytes + uv_face_bytes + uv_bytes,
+                               counts.faces * sizeof(int16_vec3));
+    if (ok){
+        uint8_t* data = mesh.file.data;
+        mesh.vertex_count   = counts.vertices;
+        mesh.faces_count    = counts.faces;
+        mesh.uv_face_count  = uv_face_count;
+        mesh.uv_coord_count = counts.uv_coords;
+        mesh.vertices       = (fix16_vec3*) data;
+        mesh.faces          = (u_triple*)   (data + vertex_bytes);
+        mesh.uv_faces       = (u_triple*)   (data + vertex_bytes + face_bytes);
+        mesh.uv_coords      = (fix16_vec2*) (data + vertex_bytes + face_bytes + uv_face_bytes);
+        mesh.face_normals   = (int16_vec3*) mesh.file.extra;
+        mesh.vertex_offset  = {0.0f, 0.0f, 0.0f};
+        mesh.vertex_scale   = {1.0f, 1.0f, 1.0f};
+        mesh.uv_offset      = {0.0f, 0.0f};
+        mesh.uv_scale       = {1.0f, 1.0f};
+
+        lseek(fd, 0, SEEK_SET);
+        line_reader_init(reader, fd, buf, OBJ_READ_BUFFER_SIZE);
+        ok = fill_records(reader, mesh, counts, line_number);
+    }
+    free(buf);
+    close(fd);
+
+    if (!ok){
+#ifdef PC
+        std::cout << "Could not read " << path << ", line " << line_number
+                  << ": malformed record, index out of range or line too long" << std::endl;
+#endif
+        mesh_free(mesh);
+        return false;
+    }
+    mesh_finish_load(mesh, center);
+    return true;
+}
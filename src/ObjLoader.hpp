@@ -0,0 +1,20 @@
+#pragma once
+
+// Loads Wavefront .obj models as they are, without converting them to
+// .pkObj first (python/ObjTexConverter.py, tools/pkconv). Slower to load
+// and larger than a .pkObj, meant for trying out models.
+
+#include "Mesh.hpp"
+
+// The file is read through a buffer of this size, longer lines are an error
+#define OBJ_READ_BUFFER_SIZE 8192
+
+// Parses the v, vt and f records of the file in two passes: the first one
+// counts them, the second one fills the arrays, all of them in one block
+// (see FileBlob.hpp) as in a version 1 .pkObj. Numbers are parsed straight
+// into Fix16 (see custom_atofix16), uv v flipped like the converters do.
+// Faces with more than 3 corners are split into a fan of triangles. Uv
+// faces are kept when every face has uv coords. Returns false on a
+// malformed record or an index outside of the arrays, the mesh is then
+// empty.
+bool mesh_load_obj(Mesh& mesh, const char* path, bool center);
@@ -10,9 +10,11 @@
 
 uint32_t * screenPixels;
 
+thread_local ScreenRect clipRect = {0, 0, SCREEN_X, SCREEN_Y};
+
 void setPixel(int x, int y, uint32_t color)
 {
-    if(x>=0 && x < SCREEN_X && y>=0 && y < SCREEN_Y)
+    if(x>=clipRect.x0 && x < clipRect.x1 && y>=clipRect.y0 && y < clipRect.y1)
         screenPixels[y * SCREEN_X + x] = color;
 }
 
@@ -26,6 +28,18 @@ void LCD_ClearScreen()
     memset(screenPixels, 255, SCREEN_X * SCREEN_Y * sizeof(uint32_t));
 }
 
+void copyScreenRect(const ScreenRect& r, void* dst, int pitch)
+{
+    const size_t row_bytes = (r.x1 - r.x0) * sizeof(uint32_t);
+    // Whole rows, in one piece
+    if ((size_t) pitch == row_bytes && r.x1 - r.x0 == SCREEN_X){
+        memcpy(dst, &screenPixels[r.y0 * SCREEN_X], row_bytes * (r.y1 - r.y0));
+        return;
+    }
+    for (int y=r.y0; y<r.y1; y++)
+        memcpy((uint8_t*)dst + (y - r.y0) * pitch, &screenPixels[y * SCREEN_X + r.x0], row_bytes);
+}
+
 // Unlike ClassPad, SDL2 can render all colors as 8bit (24b colors + 8b alpha).
 uint32_t color(uint8_t R, uint8_t G, uint8_t B){
     return ((R<<8*2) | (G<<8*1) | (B<<8*0));
@@ -154,6 +168,7 @@ The triangle has three points P0, P1 and P2 and three lines a, b and c. We go fr
 }
 
 int drawCharacter(char character, int x, int y, uint32_t* screenPixels) {
+    (void) screenPixels; // Drawn through setPixel
     const int SIZE_MULTIPLIER = 2; // Scale the text by integer
     const int BITMAP_SIZE     = 6; // bitmap x and y must be this size
     const char* bitmapNumbers6x6[] = {
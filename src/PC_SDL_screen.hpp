@@ -5,12 +5,22 @@
 
 #include <cstdint>
 
+#include "RenderFP3D.hpp"
+
+// Pixels outside of the clip rectangle are not drawn (setPixel and the
+// triangle rasterizers). Full screen unless a tile is being drawn, each
+// thread has its own (see TileRenderer.hpp).
+extern thread_local ScreenRect clipRect;
+
 void setPixel(int x, int y, uint32_t color);
 
 void setPixel_Unsafe(int x, int y, uint32_t color);
 
 void LCD_ClearScreen();
 
+// Copies rect r of the screen to dst (pixel r.x0, r.y0), pitch bytes per row
+void copyScreenRect(const ScreenRect& r, void* dst, int pitch);
+
 // Unlike ClassPad, SDL2 can render all colors as 8bit (24b colors + 8b alpha).
 uint32_t color(uint8_t R, uint8_t G, uint8_t B);
 
@@ -0,0 +1,331 @@
+#ifdef PC
+// Include guard PC
+
+#include "PC_SpanKernels.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <immintrin.h>
+#   define SPAN_KERNELS_X86
+#endif
+
+// Light level of unlit texels (LIGHT_LEVELS in RenderUtils.cpp)
+#define SPAN_LIGHT_FULL 32
+
+#ifdef SPAN_KERNELS_X86
+
+// Per channel (c*light + 16) >> 5, same as the light tables
+static inline uint32_t shade_texel(uint32_t t, int light)
+{
+    const uint32_t r = ((0xff & (t>>16)) * light + 16) >> 5;
+    const uint32_t g = ((0xff & (t>>8))  * light + 16) >> 5;
+    const uint32_t b = ((0xff & t)       * light + 16) >> 5;
+    return (r << 16) | (g << 8) | b;
+}
+
+// Offset of pixel i of a span, 16.16 steps wrap around like the scalar loop
+static inline int32_t span_step(int32_t start, int32_t step, int i)
+{
+    return (int32_t) ((uint32_t) start + (uint32_t) step * (uint32_t) i);
+}
+
+// Pixels from i to the end of the span, one by one
+static void rgb888_tail(
+    uint32_t* dst, int i, int count,
+    int32_t u, int32_t v, int32_t du, int32_t dv,
+    const uint32_t* texels, int width, int height, int light
+) {
+    u = span_step(u, du, i);
+    v = span_step(v, dv, i);
+    for (; i < count; i++, u += du, v += dv) {
+        const int tu = u >> 16;
+        const int tv = v >> 16;
+        if (tu >= 0 && tu < width && tv >= 0 && tv < height)
+            dst[i] = shade_texel(texels[tv * width + tu], light);
+    }
+}
+
+static void rgb888_depth_tail(
+    uint32_t* dst, uint16_t* depth, int i, int count,
+    int32_t u, int32_t v, int32_t z, int32_t du, int32_t dv, int32_t dz,
+    const uint32_t* texels, int width, int height, int light
+) {
+    u = span_step(u, du, i);
+    v = span_step(v, dv, i);
+    z = span_step(z, dz, i);
+    for (; i < count; i++, u += du, v += dv, z += dz) {
+        if ((z >> 8) > depth[i])
+            continue;
+        const int tu = u >> 16;
+        const int tv = v >> 16;
+        if (tu >= 0 && tu < width && tv >= 0 && tv < height) {
+            depth[i] = z >> 8;
+            dst[i] = shade_texel(texels[tv * width + tu], light);
+        }
+    }
+}
+
+// -- SSE4.1, 4 pixels per step. No gather instruction, texels are loaded
+//    one by one, shading and the masked stores are vectorized.
+
+__attribute__((target("sse4.1")))
+static inline __m128i shade4(__m128i t, __m128i light16)
+{
+    const __m128i round = _mm_set1_epi16(16);
+    __m128i rb = _mm_and_si128(t, _mm_set1_epi32(0x00ff00ff));
+    __m128i g  = _mm_and_si128(_mm_srli_epi32(t, 8), _mm_set1_epi32(0x000000ff));
+    rb = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(rb, light16), round), 5);
+    g  = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(g,  light16), round), 5);
+    return _mm_or_si128(rb, _mm_slli_epi32(g, 8));
+}
+
+// Texels of the lanes in mask (others read texel 0)
+__attribute__((target("sse4.1")))
+static inline __m128i fetch4(const uint32_t* texels, __m128i tu, __m128i tv, __m128i width, __m128i mask)
+{
+    const __m128i index = _mm_and_si128(_mm_add_epi32(_mm_mullo_epi32(tv, width), tu), mask);
+    return _mm_setr_epi32(
+        texels[_mm_extract_epi32(index, 0)], texels[_mm_extract_epi32(index, 1)],
+        texels[_mm_extract_epi32(index, 2)], texels[_mm_extract_epi32(index, 3)]
+    );
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i inside4(__m128i tu, __m128i tv, __m128i width, __m128i height)
+{
+    const __m128i minus1 = _mm_set1_epi32(-1);
+    return _mm_and_si128(
+        _mm_and_si128(_mm_cmpgt_epi32(tu, minus1), _mm_cmpgt_epi32(width, tu)),
+        _mm_and_si128(_mm_cmpgt_epi32(tv, minus1), _mm_cmpgt_epi32(height, tv))
+    );
+}
+
+__attribute__((target("sse4.1")))
+static void rgb888_sse41(
+    uint32_t* dst, int count,
+    int32_t u, int32_t v, int32_t du, int32_t dv,
+    const uint32_t* texels, int width, int height, int light
+) {
+    const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+    __m128i vu = _mm_add_epi32(_mm_set1_epi32(u), _mm_mullo_epi32(lane, _mm_set1_epi32(du)));
+    __m128i vv = _mm_add_epi32(_mm_set1_epi32(v), _mm_mullo_epi32(lane, _mm_set1_epi32(dv)));
+    const __m128i step_u = _mm_set1_epi32(span_step(0, du, 4));
+    const __m128i step_v = _mm_set1_epi32(span_step(0, dv, 4));
+    const __m128i w = _mm_set1_epi32(width);
+    const __m128i h = _mm_set1_epi32(height);
+    const __m128i light16 = _mm_set1_epi16(light);
+    const __m128i rgb = _mm_set1_epi32(0x00ffffff);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i tu = _mm_srai_epi32(vu, 16);
+        const __m128i tv = _mm_srai_epi32(vv, 16);
+        const __m128i inside = inside4(tu, tv, w, h);
+        if (!_mm_testz_si128(inside, inside)) {
+            __m128i t = fetch4(texels, tu, tv, w, inside);
+            t = light == SPAN_LIGHT_FULL ? _mm_and_si128(t, rgb) : shade4(t, light16);
+            __m128i* p = (__m128i*) (dst + i);
+            _mm_storeu_si128(p, _mm_blendv_epi8(_mm_loadu_si128(p), t, inside));
+        }
+        vu = _mm_add_epi32(vu, step_u);
+        vv = _mm_add_epi32(vv, step_v);
+    }
+    rgb888_tail(dst, i, count, u, v, du, dv, texels, width, height, light);
+}
+
+__attribute__((target("sse4.1")))
+static void rgb888_depth_sse41(
+    uint32_t* dst, uint16_t* depth, int count,
+    int32_t u, int32_t v, int32_t z, int32_t du, int32_t dv, int32_t dz,
+    const uint32_t* texels, int width, int height, int light
+) {
+    const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+    __m128i vu = _mm_add_epi32(_mm_set1_epi32(u), _mm_mullo_epi32(lane, _mm_set1_epi32(du)));
+    __m128i vv = _mm_add_epi32(_mm_set1_epi32(v), _mm_mullo_epi32(lane, _mm_set1_epi32(dv)));
+    __m128i vz = _mm_add_epi32(_mm_set1_epi32(z), _mm_mullo_epi32(lane, _mm_set1_epi32(dz)));
+    const __m128i step_u = _mm_set1_epi32(span_step(0, du, 4));
+    const __m128i step_v = _mm_set1_epi32(span_step(0, dv, 4));
+    const __m128i step_z = _mm_set1_epi32(span_step(0, dz, 4));
+    const __m128i w = _mm_set1_epi32(width);
+    const __m128i h = _mm_set1_epi32(height);
+    const __m128i light16 = _mm_set1_epi16(light);
+    const __m128i rgb = _mm_set1_epi32(0x00ffffff);
+    const __m128i low16 = _mm_set1_epi32(0xffff);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i tu = _mm_srai_epi32(vu, 16);
+        const __m128i tv = _mm_srai_epi32(vv, 16);
+        const __m128i zz = _mm_srai_epi32(vz, 8);
+        const __m128i old_depth = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*) (depth + i)));
+        const __m128i pass = _mm_andnot_si128(_mm_cmpgt_epi32(zz, old_depth), inside4(tu, tv, w, h));
+        if (!_mm_testz_si128(pass, pass)) {
+            __m128i t = fetch4(texels, tu, tv, w, pass);
+            t = light == SPAN_LIGHT_FULL ? _mm_and_si128(t, rgb) : shade4(t, light16);
+            __m128i* p = (__m128i*) (dst + i);
+            _mm_storeu_si128(p, _mm_blendv_epi8(_mm_loadu_si128(p), t, pass));
+            // Depth is stored truncated to 16 bits, like the scalar loop
+            const __m128i new_depth = _mm_blendv_epi8(old_depth, _mm_and_si128(zz, low16), pass);
+            _mm_storel_epi64((__m128i*) (depth + i), _mm_packus_epi32(new_depth, new_depth));
+        }
+        vu = _mm_add_epi32(vu, step_u);
+        vv = _mm_add_epi32(vv, step_v);
+        vz = _mm_add_epi32(vz, step_z);
+    }
+    rgb888_depth_tail(dst, depth, i, count, u, v, z, du, dv, dz, texels, width, height, light);
+}
+
+// -- AVX2, 8 pixels per step with gathered texels
+
+__attribute__((target("avx2")))
+static inline __m256i shade8(__m256i t, __m256i light16)
+{
+    const __m256i round = _mm256_set1_epi16(16);
+    __m256i rb = _mm256_and_si256(t, _mm256_set1_epi32(0x00ff00ff));
+    __m256i g  = _mm256_and_si256(_mm256_srli_epi32(t, 8), _mm256_set1_epi32(0x000000ff));
+    rb = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(rb, light16), round), 5);
+    g  = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(g,  light16), round), 5);
+    return _mm256_or_si256(rb, _mm256_slli_epi32(g, 8));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i inside8(__m256i tu, __m256i tv, __m256i width, __m256i height)
+{
+    const __m256i minus1 = _mm256_set1_epi32(-1);
+    return _mm256_and_si256(
+        _mm256_and_si256(_mm256_cmpgt_epi32(tu, minus1), _mm256_cmpgt_epi32(width, tu)),
+        _mm256_and_si256(_mm256_cmpgt_epi32(tv, minus1), _mm256_cmpgt_epi32(height, tv))
+    );
+}
+
+__attribute__((target("avx2")))
+static void rgb888_avx2(
+    uint32_t* dst, int count,
+    int32_t u, int32_t v, int32_t du, int32_t dv,
+    const uint32_t* texels, int width, int height, int light
+) {
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i vu = _mm256_add_epi32(_mm256_set1_epi32(u), _mm256_mullo_epi32(lane, _mm256_set1_epi32(du)));
+    __m256i vv = _mm256_add_epi32(_mm256_set1_epi32(v), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dv)));
+    const __m256i step_u = _mm256_set1_epi32(span_step(0, du, 8));
+    const __m256i step_v = _mm256_set1_epi32(span_step(0, dv, 8));
+    const __m256i w = _mm256_set1_epi32(width);
+    const __m256i h = _mm256_set1_epi32(height);
+    const __m256i light16 = _mm256_set1_epi16(light);
+    const __m256i rgb = _mm256_set1_epi32(0x00ffffff);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i tu = _mm256_srai_epi32(vu, 16);
+        const __m256i tv = _mm256_srai_epi32(vv, 16);
+        const __m256i inside = inside8(tu, tv, w, h);
+        if (!_mm256_testz_si256(inside, inside)) {
+            const __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(tv, w), tu);
+            __m256i t = _mm256_mask_i32gather_epi32(
+                _mm256_setzero_si256(), (const int*) texels, index, inside, 4);
+            t = light == SPAN_LIGHT_FULL ? _mm256_and_si256(t, rgb) : shade8(t, light16);
+            __m256i* p = (__m256i*) (dst + i);
+            _mm256_storeu_si256(p, _mm256_blendv_epi8(_mm256_loadu_si256(p), t, inside));
+        }
+        vu = _mm256_add_epi32(vu, step_u);
+        vv = _mm256_add_epi32(vv, step_v);
+    }
+    rgb888_tail(dst, i, count, u, v, du, dv, texels, width, height, light);
+}
+
+__attribute__((target("avx2")))
+static void rgb888_depth_avx2(
+    uint32_t* dst, uint16_t* depth, int count,
+    int32_t u, int32_t v, int32_t z, int32_t du, int32_t dv, int32_t dz,
+    const uint32_t* texels, int width, int height, int light
+) {
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i vu = _mm256_add_epi32(_mm256_set1_epi32(u), _mm256_mullo_epi32(lane, _mm256_set1_epi32(du)));
+    __m256i vv = _mm256_add_epi32(_mm256_set1_epi32(v), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dv)));
+    __m256i vz = _mm256_add_epi32(_mm256_set1_epi32(z), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dz)));
+    const __m256i step_u = _mm256_set1_epi32(span_step(0, du, 8));
+    const __m256i step_v = _mm256_set1_epi32(span_step(0, dv, 8));
+    const __m256i step_z = _mm256_set1_epi32(span_step(0, dz, 8));
+    const __m256i w = _mm256_set1_epi32(width);
+    const __m256i h = _mm256_set1_epi32(height);
+    const __m256i light16 = _mm256_set1_epi16(light);
+    const __m256i rgb = _mm256_set1_epi32(0x00ffffff);
+    const __m256i low16 = _mm256_set1_epi32(0xffff);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i tu = _mm256_srai_epi32(vu, 16);
+        const __m256i tv = _mm256_srai_epi32(vv, 16);
+        const __m256i zz = _mm256_srai_epi32(vz, 8);
+        const __m256i old_depth = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) (depth + i)));
+        const __m256i pass = _mm256_andnot_si256(_mm256_cmpgt_epi32(zz, old_depth), inside8(tu, tv, w, h));
+        if (!_mm256_testz_si256(pass, pass)) {
+            const __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(tv, w), tu);
+            __m256i t = _mm256_mask_i32gather_epi32(
+                _mm256_setzero_si256(), (const int*) texels, index, pass, 4);
+            t = light == SPAN_LIGHT_FULL ? _mm256_and_si256(t, rgb) : shade8(t, light16);
+            __m256i* p = (__m256i*) (dst + i);
+            _mm256_storeu_si256(p, _mm256_blendv_epi8(_mm256_loadu_si256(p), t, pass));
+            // Depth is stored truncated to 16 bits, like the scalar loop.
+            // packus works within 128 bit halves, the permute joins them.
+            const __m256i new_depth = _mm256_blendv_epi8(old_depth, _mm256_and_si256(zz, low16), pass);
+            const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(new_depth, new_depth), 0x08);
+            _mm_storeu_si128((__m128i*) (depth + i), _mm256_castsi256_si128(packed));
+        }
+        vu = _mm256_add_epi32(vu, step_u);
+        vv = _mm256_add_epi32(vv, step_v);
+        vz = _mm256_add_epi32(vz, step_z);
+    }
+    rgb888_depth_tail(dst, depth, i, count, u, v, z, du, dv, dz, texels, width, height, light);
+}
+
+static const SpanKernels kernels_sse41 = {"sse4.1", rgb888_sse41, rgb888_depth_sse41};
+static const SpanKernels kernels_avx2  = {"avx2",   rgb888_avx2,  rgb888_depth_avx2};
+
+#endif // SPAN_KERNELS_X86
+
+static const SpanKernels* active_kernels = nullptr;
+static bool kernels_selected = false;
+
+bool span_kernels_select(int kernels)
+{
+#ifdef SPAN_KERNELS_X86
+    __builtin_cpu_init();
+    const bool has_avx2  = __builtin_cpu_supports("avx2");
+    const bool has_sse41 = __builtin_cpu_supports("sse4.1");
+    switch (kernels) {
+        case SPAN_KERNELS_AUTO:
+            // SSE4.1 even when AVX2 is there: the AVX2 kernels came out 2-5x
+            // slower than SSE4.1 in --bench-simd (the gather is slow on many
+            // CPUs), they are kept for --span-kernels avx2.
+            active_kernels = has_sse41 ? &kernels_sse41 : nullptr;
+            break;
+        case SPAN_KERNELS_SCALAR:
+            active_kernels = nullptr;
+            break;
+        case SPAN_KERNELS_SSE41:
+            if (!has_sse41)
+                return false;
+            active_kernels = &kernels_sse41;
+            break;
+        case SPAN_KERNELS_AVX2:
+            if (!has_avx2)
+                return false;
+            active_kernels = &kernels_avx2;
+            break;
+        default:
+            return false;
+    }
+#else
+    if (kernels != SPAN_KERNELS_AUTO && kernels != SPAN_KERNELS_SCALAR)
+        return false;
+    active_kernels = nullptr;
+#endif
+    kernels_selected = true;
+    return true;
+}
+
+const SpanKernels* span_kernels()
+{
+    if (!kernels_selected)
+        span_kernels_select(SPAN_KERNELS_AUTO);
+    return active_kernels;
+}
+
+// Include guard PC
+#endif // PC
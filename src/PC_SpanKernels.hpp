@@ -0,0 +1,47 @@
+#pragma once
+
+#ifdef PC
+// Include guard PC
+
+// Vectorized textured span loops for x86 PCs: RGB888 textures in linear
+// layout (the PC default), with and without depth test. Produce the same
+// pixels as the scalar span loops in RenderUtils.cpp, 4 (SSE4.1) or
+// 8 (AVX2) at a time. Picked at runtime by the CPU features.
+//
+// Light level is 0 - 32, channels are scaled as (c*level + 16) >> 5 which
+// is what the light tables of RenderUtils.cpp hold.
+
+#include <cstdint>
+
+#define SPAN_KERNELS_AUTO   0 // SSE4.1 if the CPU supports it, else scalar
+#define SPAN_KERNELS_SCALAR 1 // No vector kernels, scalar span loops
+#define SPAN_KERNELS_SSE41  2
+#define SPAN_KERNELS_AVX2   3
+
+struct SpanKernels
+{
+    const char* name;
+    // count pixels from dst. u, v texel coordinates and du, dv per pixel
+    // steps in 16.16 fixed point. Texels outside width x height are skipped.
+    void (*rgb888)(
+        uint32_t* dst, int count,
+        int32_t u, int32_t v, int32_t du, int32_t dv,
+        const uint32_t* texels, int width, int height, int light
+    );
+    // Same with depth test, z and dz in 24.8 (see texturedSpan_depth)
+    void (*rgb888_depth)(
+        uint32_t* dst, uint16_t* depth, int count,
+        int32_t u, int32_t v, int32_t z, int32_t du, int32_t dv, int32_t dz,
+        const uint32_t* texels, int width, int height, int light
+    );
+};
+
+// Selected kernels, nullptr for the scalar span loops. First call detects
+// the CPU, do it before drawing from several threads.
+const SpanKernels* span_kernels();
+
+// Forces SPAN_KERNELS_*. Returns false if the CPU does not support them.
+bool span_kernels_select(int kernels);
+
+// Include guard PC
+#endif // PC
@@ -0,0 +1,882 @@
+#if defined(PC) && defined(HEADLESS)
+// Include guard PC headless
+
+#include "PC_benchmarks.hpp"
+
+#include "Model.hpp"
+
+#include "AssetCache.hpp"
+
+#include "Renderer.hpp"
+
+#include "DepthSort.hpp"
+
+#include "constants.hpp"
+
+#include "Utils.hpp"
+
+#include "RenderUtils.hpp"
+
+#include "PC_SDL_screen.hpp"
+
+#include "PC_SpanKernels.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double elapsed_us(bench_clock::time_point t0, bench_clock::time_point t1)
+{
+    return std::chrono::duration<double, std::micro>(t1 - t0).count();
+}
+
+// Orbit camera used by all benchmarks, same as the headless frame loop
+static void bench_camera(int frame, fix16_vec3* camera_pos, fix16_vec2* camera_rot)
+{
+    Fix16 angle = Fix16((int16_t) frame) * (0.35f/30.0f);
+    *camera_pos = {angle.sin() * -21.0f, -1.6f, angle.cos() * -21.0f};
+    *camera_rot = {angle, 0.2f};
+}
+
+static bool is_sorted_depth(const uint_fix16_t a[], unsigned n)
+{
+    for (unsigned i = 1; i < n; i++)
+        if (a[i - 1].fix16 < a[i].fix16)
+            return false;
+    return true;
+}
+
+int run_sort_benchmark()
+{
+    char pika_path[]      = "./3D_Converted_Models/little_endian_pika.pkObj";
+    char character_path[] = "./3D_Converted_Models/little_endian_character_low.pkObj";
+    char* paths[] = {pika_path, character_path};
+    const int FRAMES = 100;
+
+    printf("%-20s %7s %12s %12s %12s\n", "model", "faces", "bubble_us", "radix_us", "coherent_us");
+    for (char* path : paths)
+    {
+        AssetCache assets;
+        Model model(assets, path, NO_TEXTURE, true);
+        model._scaleModelTo(7.0f);
+
+        Fix16* vert_z_depths = (Fix16*) malloc(sizeof(Fix16) * model.mesh->vertex_count);
+        uint_fix16_t* keys   = (uint_fix16_t*) malloc(sizeof(uint_fix16_t) * model.mesh->faces_count);
+        uint_fix16_t* tmp    = (uint_fix16_t*) malloc(sizeof(uint_fix16_t) * model.mesh->faces_count);
+        uint_fix16_t* order  = (uint_fix16_t*) malloc(sizeof(uint_fix16_t) * model.mesh->faces_count);
+
+        // Sort time versus face count: prefixes of the mesh up to all faces
+        for (unsigned n = 64; ; n *= 2)
+        {
+            if (n > model.mesh->faces_count)
+                n = model.mesh->faces_count;
+            for (unsigned i = 0; i < n; i++)
+                order[i].uint = i;
+
+            double bubble_us = 0.0, radix_us = 0.0, coherent_us = 0.0;
+            bool ok = true;
+            for (int frame = 0; frame < FRAMES; frame++)
+            {
+                fix16_vec3 camera_pos;
+                fix16_vec2 camera_rot;
+                bench_camera(frame, &camera_pos, &camera_rot);
+                for (unsigned v = 0; v < model.mesh->vertex_count; v++){
+                    bool is_valid;
+                    getScreenCoordinate(
+                        300.0f, mesh_position(*model.mesh, v),
+                        model.position, model.rotation, model.scale,
+                        camera_pos, camera_rot,
+                        &vert_z_depths[v], &is_valid
+                    );
+                }
+                auto face_depth = [&](unsigned f_id) {
+                    const u_triple f = mesh_face(*model.mesh, f_id);
+                    return vert_z_depths[f.First] + vert_z_depths[f.Second] + vert_z_depths[f.Third];
+                };
+
+                // Old: bubble sort from file order every frame
+                for (unsigned i = 0; i < n; i++)
+                    keys[i] = {i, face_depth(i)};
+                auto t0 = bench_clock::now();
+                bubble_sort(keys, n);
+                auto t1 = bench_clock::now();
+                bubble_us += elapsed_us(t0, t1);
+
+                // Radix sort from file order every frame
+                for (unsigned i = 0; i < n; i++)
+                    keys[i] = {i, face_depth(i)};
+                t0 = bench_clock::now();
+                radix_sort_depth(keys, tmp, n);
+                t1 = bench_clock::now();
+                radix_us += elapsed_us(t0, t1);
+                ok = ok && is_sorted_depth(keys, n);
+
+                // Coherent: start from last frame's order
+                for (unsigned i = 0; i < n; i++)
+                    order[i].fix16 = face_depth(order[i].uint);
+                t0 = bench_clock::now();
+                sort_depth(order, tmp, n);
+                t1 = bench_clock::now();
+                coherent_us += elapsed_us(t0, t1);
+                ok = ok && is_sorted_depth(order, n);
+            }
+            if (!ok){
+                fprintf(stderr, "%s: sort result not in depth order!\n", path);
+                return 1;
+            }
+            const char* name = (path == pika_path) ? "pika" : "character_low";
+            printf("%-20s %7u %12.2f %12.2f %12.2f\n", name, n,
+                   bubble_us / FRAMES, radix_us / FRAMES, coherent_us / FRAMES);
+            if (n == model.mesh->faces_count)
+                break;
+        }
+
+        free(order);
+        free(tmp);
+        free(keys);
+        free(vert_z_depths);
+    }
+    return 0;
+}
+
+int run_transform_benchmark()
+{
+    char pika_path[]      = "./3D_Converted_Models/little_endian_pika.pkObj";
+    char character_path[] = "./3D_Converted_Models/little_endian_character_low.pkObj";
+    char* paths[] = {pika_path, character_path};
+    const int FRAMES = 200;
+    const Fix16 FOV = 300.0f;
+
+    printf("%-20s %9s %14s %14s %8s\n", "model", "vertices", "per_vertex_us", "matrix_us", "speedup");
+    for (char* path : paths)
+    {
+        AssetCache assets;
+        Model model(assets, path, NO_TEXTURE, true);
+        model._scaleModelTo(7.0f);
+        model.rotation = {0.3f, 1.2f};
+
+        Fix16* depth_old         = (Fix16*) malloc(sizeof(Fix16) * model.mesh->vertex_count);
+        Fix16* depth_new         = (Fix16*) malloc(sizeof(Fix16) * model.mesh->vertex_count);
+        int16_t_vec2* screen_old = (int16_t_vec2*) malloc(sizeof(int16_t_vec2) * model.mesh->vertex_count);
+        int16_t_vec2* screen_new = (int16_t_vec2*) malloc(sizeof(int16_t_vec2) * model.mesh->vertex_count);
+        uint8_t* clip_codes      = (uint8_t*) malloc(sizeof(uint8_t) * model.mesh->vertex_count);
+        const ClipFrustum frustum = makeClipFrustum(FOV);
+
+        double old_us = 0.0, new_us = 0.0;
+        unsigned max_error = 0;
+        for (int frame = 0; frame < FRAMES; frame++)
+        {
+            fix16_vec3 camera_pos;
+            fix16_vec2 camera_rot;
+            bench_camera(frame, &camera_pos, &camera_rot);
+
+            // Old: trigonometry for every vertex
+            auto t0 = bench_clock::now();
+            for (unsigned v = 0; v < model.mesh->vertex_count; v++){
+                bool is_valid;
+                fix16_vec2 p = getScreenCoordinate(
+                    FOV, mesh_position(*model.mesh, v),
+                    model.position, model.rotation, model.scale,
+                    camera_pos, camera_rot,
+                    &depth_old[v], &is_valid
+                );
+                screen_old[v] = {(int16_t)p.x, (int16_t)p.y};
+            }
+            auto t1 = bench_clock::now();
+            old_us += elapsed_us(t0, t1);
+
+            // New: matrix once per model
+            int16_t_vec2 bbox_max = {0, 0};
+            int16_t_vec2 bbox_min = {SCREEN_X, SCREEN_Y};
+            t0 = bench_clock::now();
+            const fix16_mat3x4 mat = buildTransformMatrix(
+                model.position, model.rotation, model.scale, camera_pos, camera_rot
+            );
+            transformVertices(model.mesh, mesh_vertex_matrix(*model.mesh, mat), frustum, screen_new, depth_new, clip_codes, &bbox_max, &bbox_min);
+            t1 = bench_clock::now();
+            new_us += elapsed_us(t0, t1);
+
+            // Rounding differs slightly, results must still match within a pixel
+            for (unsigned v = 0; v < model.mesh->vertex_count; v++){
+                if (clip_codes[v] != 0)
+                    continue;
+                unsigned dx = abs(screen_old[v].x - screen_new[v].x);
+                unsigned dy = abs(screen_old[v].y - screen_new[v].y);
+                if (dx > max_error) max_error = dx;
+                if (dy > max_error) max_error = dy;
+            }
+        }
+        if (max_error > 1){
+            fprintf(stderr, "%s: matrix transform differs by %u pixels!\n", path, max_error);
+            return 1;
+        }
+        const char* name = (path == pika_path) ? "pika" : "character_low";
+        printf("%-20s %9u %14.2f %14.2f %7.2fx\n", name, model.mesh->vertex_count,
+               old_us / FRAMES, new_us / FRAMES, old_us / new_us);
+
+        free(clip_codes);
+        free(screen_new);
+        free(screen_old);
+        free(depth_new);
+        free(depth_old);
+    }
+    return 0;
+}
+
+// Textured triangle rasterizer before the edge walking rewrite: one division
+// per pixel and two per scanline. Kept as the fill rate baseline.
+static void reference_drawHorizontalLine(
+    int x0, int x1, int y,
+    int u0, int u1, int v0, int v1,
+    uint32_t *texture, int textureWidth, int textureHeight,
+    Fix16 lightInstensity
+) {
+    if (x0 > x1) {
+        swap(x0, x1);
+        swap(u0, u1);
+        swap(v0, v1);
+    }
+    const int dx = (x1 - x0) > 0 ? (x1 - x0) : 1;
+    for (int x = x0; x <= x1; x++) {
+        int alpha = (x - x0) * 65536 / dx;
+        int u = ((u1 - u0) * alpha + u0 * 65536) >> 16;
+        int v = ((v1 - v0) * alpha + v0 * 65536) >> 16;
+
+        if (u >= 0 && u < textureWidth && v >= 0 && v < textureHeight) {
+            auto texel = texture[u + v * textureWidth];
+            uint8_t r = (0xff & (texel>>16));
+            uint8_t g = (0xff & (texel>>8));
+            uint8_t b = (0xff & texel);
+            r = (uint8_t) ((int16_t)(Fix16((int16_t)r) * lightInstensity));
+            g = (uint8_t) ((int16_t)(Fix16((int16_t)g) * lightInstensity));
+            b = (uint8_t) ((int16_t)(Fix16((int16_t)b) * lightInstensity));
+            screenPixels[y * SCREEN_X + x] = color(r,g,b);
+        }
+    }
+}
+
+static void reference_drawTriangle(
+    int16_t_Point2d v0, int16_t_Point2d v1, int16_t_Point2d v2,
+    uint32_t *texture, int textureWidth, int textureHeight,
+    Fix16 lightInstensity
+) {
+    if (v0.y > v1.y) swap(v0, v1);
+    if (v0.y > v2.y) swap(v0, v2);
+    if (v1.y > v2.y) swap(v1, v2);
+
+    int totalHeight = v2.y - v0.y;
+    if (totalHeight == 0) return;
+
+    for (int y = v0.y; y <= v2.y; y++) {
+        bool upper = y <= v1.y;
+        const int16_t_Point2d& a = upper ? v0 : v1;
+        const int16_t_Point2d& b = upper ? v1 : v2;
+        int segmentHeight = b.y - a.y + 1;
+        int alpha = ((y - v0.y) << 16) / totalHeight;
+        int beta = ((y - a.y) << 16) / segmentHeight;
+
+        int x0 = v0.x + ((v2.x - v0.x) * alpha >> 16);
+        int x1 = a.x + ((b.x - a.x) * beta >> 16);
+        int u0 = v0.u + ((v2.u - v0.u) * alpha >> 16);
+        int u1 = a.u + ((b.u - a.u) * beta >> 16);
+        int v0_coord = v0.v + ((v2.v - v0.v) * alpha >> 16);
+        int v1_coord = a.v + ((b.v - a.v) * beta >> 16);
+
+        reference_drawHorizontalLine(x0, x1, y, u0, u1, v0_coord, v1_coord,
+                                     texture, textureWidth, textureHeight, lightInstensity);
+    }
+}
+
+// Palette index of an RGB888 color in the fixed palettes of texture_copy:
+// RGB332 (INDEX8) and RGB121 (INDEX4)
+static uint8_t palette_index(uint32_t c, uint32_t format)
+{
+    if (format == TEXTURE_FORMAT_INDEX4)
+        return (uint8_t) (((c >> 20) & 0x8) | ((c >> 12) & 0x6) | ((c >> 7) & 0x1));
+    return (uint8_t) (((c >> 16) & 0xe0) | ((c >> 11) & 0x1c) | ((c >> 6) & 0x3));
+}
+
+static uint32_t palette_rgb(unsigned index, uint32_t format)
+{
+    if (format == TEXTURE_FORMAT_INDEX4)
+        return ((index >> 3) * 0xff) << 16 | ((index >> 1 & 0x3) * 0x55) << 8 | (index & 0x1) * 0xff;
+    return ((index >> 5) * 0xff / 7) << 16 | ((index >> 2 & 0x7) * 0xff / 7) << 8 | (index & 0x3) * 0x55;
+}
+
+// Copy of an RGB888 texture (all levels loaded) in any format and in given
+// layout. Indexed copies use a fixed palette, good enough to time them.
+// Free with texture_copy_free.
+static Texture texture_copy(const Texture& src, uint32_t format, uint32_t layout)
+{
+    Texture dst = src;
+    dst.format = format;
+    dst.palette = nullptr;
+    dst.palette_size = 0;
+    unsigned bytes = 0;
+    for (unsigned l = 0; l < src.levels; l++)
+        bytes += texture_level_bytes(format, src.level[l].width, src.level[l].height);
+    dst.pixels = calloc(bytes, 1);
+    if (texture_format_indexed(format)){
+        dst.palette_size = 1u << texture_texel_bits(format);
+        dst.palette = (palette_color_t*) malloc(sizeof(palette_color_t) * dst.palette_size);
+        for (unsigned i = 0; i < dst.palette_size; i++)
+            dst.palette[i] = palette_rgb(i, format);
+    }
+    uint8_t* out = (uint8_t*) dst.pixels;
+    for (unsigned l = 0; l < src.levels; l++){
+        dst.level[l].pixels = out;
+        const uint32_t* in = (const uint32_t*) src.level[l].pixels;
+        const int n = src.level[l].width * src.level[l].height;
+        for (int i = 0; i < n; i++){
+            const uint32_t c = in[i];
+            if (format == TEXTURE_FORMAT_RGB565)
+                ((uint16_t*) out)[i] = (uint16_t) (((c >> 8) & 0xf800) | ((c >> 5) & 0x07e0) | ((c >> 3) & 0x001f));
+            else if (format == TEXTURE_FORMAT_INDEX8)
+                out[i] = palette_index(c, format);
+            else if (format == TEXTURE_FORMAT_INDEX4)
+                out[i >> 1] |= palette_index(c, format) << ((i & 1) << 2);
+            else
+                ((uint32_t*) out)[i] = c;
+        }
+        out += texture_level_bytes(format, src.level[l].width, src.level[l].height);
+    }
+    texture_set_layout(dst, layout);
+    return dst;
+}
+
+static void texture_copy_free(Texture& copy)
+{
+    free(copy.pixels);
+    free(copy.palette);
+}
+
+// Texel and palette bytes of the levels
+static unsigned texture_bytes(const Texture& texture)
+{
+    unsigned bytes = texture.palette_size * sizeof(palette_color_t);
+    for (unsigned l = texture.first_level; l < texture.levels; l++)
+        bytes += texture_level_bytes(texture.format, texture.level[l].width, texture.level[l].height);
+    return bytes;
+}
+
+int run_fill_benchmark()
+{
+    char pika_path[]         = "./3D_Converted_Models/little_endian_pika.pkObj";
+    char pika_texture_path[] = "./3D_Converted_Models/little_endian_pika.texture";
+    AssetCache assets;
+    Model model(assets, pika_path, pika_texture_path, true);
+    if (!model.has_texture){
+        fprintf(stderr, "Could not load %s\n", pika_texture_path);
+        return 1;
+    }
+    const int TRIANGLES = 4000;
+    const int sizes[] = {8, 32, 128};
+
+    // RGB888 and RGB565 with all mip levels and with level 0 only
+    const Texture& mip888 = *model.texture;
+    Texture mip565 = texture_copy(mip888, TEXTURE_FORMAT_RGB565, TEXTURE_LAYOUT_TILED);
+    // Indexed, lit through the palette (see texture_copy)
+    Texture mip8 = texture_copy(mip888, TEXTURE_FORMAT_INDEX8, TEXTURE_LAYOUT_TILED);
+    Texture mip4 = texture_copy(mip888, TEXTURE_FORMAT_INDEX4, TEXTURE_LAYOUT_LINEAR);
+    // Reference rasterizer reads row-major level 0
+    Texture linear888 = texture_copy(mip888, TEXTURE_FORMAT_RGB888, TEXTURE_LAYOUT_LINEAR);
+    Texture tex888 = mip888;
+    Texture tex565 = mip565;
+    tex888.levels = 1;
+    tex565.levels = 1;
+    const Texture* textures[] = {&tex888, &tex565, &mip888, &mip565, &mip8, &mip4};
+    const int TEXTURES = 6;
+
+    screenPixels = new uint32_t[SCREEN_X * SCREEN_Y];
+    int16_t_Point2d* tris = (int16_t_Point2d*) malloc(sizeof(int16_t_Point2d) * 3 * TRIANGLES);
+
+    printf("mip levels: %u (random texture coordinates, triangles are minified)\n", mip888.levels);
+    printf("texture KiB: mip888 %.1f  mip565 %.1f  mip8 %.1f  mip4 %.1f\n",
+           texture_bytes(mip888) / 1024.0, texture_bytes(mip565) / 1024.0,
+           texture_bytes(mip8) / 1024.0, texture_bytes(mip4) / 1024.0);
+    printf("%-6s %12s %16s %13s %8s %13s %13s %13s %13s %13s\n", "size", "px/triangle", "reference_Mpx/s",
+           "rgb888_Mpx/s", "speedup", "rgb565_Mpx/s", "mip888_Mpx/s", "mip565_Mpx/s", "mip8_Mpx/s", "mip4_Mpx/s");
+    for (int size : sizes)
+    {
+        // Deterministic random triangles on the screen, random texture coordinates
+        uint32_t seed = 12345;
+        auto rnd = [&seed](int n) { seed = seed * 1103515245u + 12345u; return (int)((seed >> 8) % (unsigned)n); };
+        double pixels = 0.0;
+        for (int i = 0; i < TRIANGLES; i++){
+            int cx = size + rnd(SCREEN_X - 2*size);
+            int cy = size + rnd(SCREEN_Y - 2*size);
+            for (int k = 0; k < 3; k++){
+                int16_t_Point2d& p = tris[i*3 + k];
+                p.x = cx - size + rnd(2*size);
+                p.y = cy - size + rnd(2*size);
+                p.u = rnd(tex888.width);
+                p.v = rnd(tex888.height);
+                p.z = 0;
+            }
+            const int16_t_Point2d* t = &tris[i*3];
+            int32_t area2 = (t[1].x - t[0].x) * (t[2].y - t[0].y) - (t[1].y - t[0].y) * (t[2].x - t[0].x);
+            pixels += (area2 < 0 ? -area2 : area2) / 2.0;
+        }
+
+        double reference_us = 0.0;
+        double texture_us[TEXTURES] = {0.0};
+        for (int pass = 0; pass < 3; pass++){
+            auto t0 = bench_clock::now();
+            for (int i = 0; i < TRIANGLES; i++)
+                reference_drawTriangle(tris[i*3], tris[i*3+1], tris[i*3+2],
+                    (uint32_t*) linear888.pixels, linear888.width, linear888.height, 0.8f);
+            reference_us += elapsed_us(t0, bench_clock::now());
+            for (int k = 0; k < TEXTURES; k++){
+                auto t1 = bench_clock::now();
+                for (int i = 0; i < TRIANGLES; i++)
+                    drawTriangle(tris[i*3], tris[i*3+1], tris[i*3+2], *textures[k], 0.8f);
+                texture_us[k] += elapsed_us(t1, bench_clock::now());
+            }
+        }
+        const double total_pixels = pixels * 3;
+        printf("%-6d %12.1f %16.2f %13.2f %7.2fx %13.2f %13.2f %13.2f %13.2f %13.2f\n", size, pixels / TRIANGLES,
+               total_pixels / reference_us, total_pixels / texture_us[0], reference_us / texture_us[0],
+               total_pixels / texture_us[1], total_pixels / texture_us[2], total_pixels / texture_us[3],
+               total_pixels / texture_us[4], total_pixels / texture_us[5]);
+    }
+
+    free(tris);
+    texture_copy_free(mip565);
+    texture_copy_free(mip8);
+    texture_copy_free(mip4);
+    texture_copy_free(linear888);
+    delete[] screenPixels;
+    return 0;
+}
+
+int run_layout_benchmark()
+{
+    char pika_path[]         = "./3D_Converted_Models/little_endian_pika.pkObj";
+    char pika_texture_path[] = "./3D_Converted_Models/little_endian_pika.texture";
+    AssetCache assets;
+    Model model(assets, pika_path, pika_texture_path, true);
+    if (!model.has_texture){
+        fprintf(stderr, "Could not load %s\n", pika_texture_path);
+        return 1;
+    }
+    const int QUADS = 2000;
+    const int QUAD_SIZE = 48;
+    const int angles[] = {0, 30, 45, 60, 90};
+
+    // Level 0 only, one texel per pixel, so the layout is all that differs
+    Texture textures[4] = {
+        texture_copy(*model.texture, TEXTURE_FORMAT_RGB888, TEXTURE_LAYOUT_LINEAR),
+        texture_copy(*model.texture, TEXTURE_FORMAT_RGB888, TEXTURE_LAYOUT_TILED),
+        texture_copy(*model.texture, TEXTURE_FORMAT_RGB565, TEXTURE_LAYOUT_LINEAR),
+        texture_copy(*model.texture, TEXTURE_FORMAT_RGB565, TEXTURE_LAYOUT_TILED),
+    };
+    for (Texture& t : textures)
+        t.levels = 1;
+    const int size = model.texture->width;
+
+    screenPixels = new uint32_t[SCREEN_X * SCREEN_Y];
+    int16_t_Point2d* quads = (int16_t_Point2d*) malloc(sizeof(int16_t_Point2d) * 4 * QUADS);
+
+    printf("%-6s %15s %14s %8s %15s %14s %8s\n", "angle", "linear888_Mpx/s", "tiled888_Mpx/s", "speedup",
+           "linear565_Mpx/s", "tiled565_Mpx/s", "speedup");
+    for (int angle : angles)
+    {
+        // Screen aligned squares, texture rotated by angle around a random
+        // texel. Spans walk the texture along the rotated x axis.
+        const Fix16 a = Fix16((int16_t) angle) * (3.14159265f / 180.0f);
+        const Fix16 c = a.cos();
+        const Fix16 s = a.sin();
+        uint32_t seed = 12345;
+        auto rnd = [&seed](int n) { seed = seed * 1103515245u + 12345u; return (int)((seed >> 8) % (unsigned)n); };
+        for (int i = 0; i < QUADS; i++){
+            const int x0 = rnd(SCREEN_X - QUAD_SIZE);
+            const int y0 = rnd(SCREEN_Y - QUAD_SIZE);
+            const int tu = QUAD_SIZE + rnd(size - 2*QUAD_SIZE);
+            const int tv = QUAD_SIZE + rnd(size - 2*QUAD_SIZE);
+            const int corners[4][2] = {{0, 0}, {QUAD_SIZE, 0}, {QUAD_SIZE, QUAD_SIZE}, {0, QUAD_SIZE}};
+            for (int k = 0; k < 4; k++){
+                int16_t_Point2d& p = quads[i*4 + k];
+                const Fix16 dx = Fix16((int16_t) corners[k][0]);
+                const Fix16 dy = Fix16((int16_t) corners[k][1]);
+                p.x = x0 + corners[k][0];
+                p.y = y0 + corners[k][1];
+                p.u = tu + (int16_t) (dx*c - dy*s);
+                p.v = tv + (int16_t) (dx*s + dy*c);
+                p.z = 0;
+            }
+        }
+
+        double us[4] = {0.0};
+        for (int pass = 0; pass < 3; pass++){
+            for (int k = 0; k < 4; k++){
+                auto t0 = bench_clock::now();
+                for (int i = 0; i < QUADS; i++){
+                    const int16_t_Point2d* q = &quads[i*4];
+                    drawTriangle(q[0], q[1], q[2], textures[k], 0.8f);
+                    drawTriangle(q[0], q[2], q[3], textures[k], 0.8f);
+                }
+                us[k] += elapsed_us(t0, bench_clock::now());
+            }
+        }
+        const double total_pixels = 3.0 * QUADS * QUAD_SIZE * QUAD_SIZE;
+        printf("%-6d %15.2f %14.2f %7.2fx %15.2f %14.2f %7.2fx\n", angle,
+               total_pixels / us[0], total_pixels / us[1], us[0] / us[1],
+               total_pixels / us[2], total_pixels / us[3], us[2] / us[3]);
+    }
+
+    free(quads);
+    for (Texture& t : textures)
+        texture_copy_free(t);
+    delete[] screenPixels;
+    return 0;
+}
+
+// FNV-1a over the framebuffer, continuing from h
+static uint32_t frame_hash(uint32_t h)
+{
+    const uint8_t* p = (const uint8_t*) screenPixels;
+    for (unsigned i = 0; i < SCREEN_X * SCREEN_Y * sizeof(uint32_t); i++){
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Renders frames of a grid of lit, textured pikas with given thread count
+// (0 = direct drawing). Every run starts from a new renderer, so the face
+// order (depth buffer ties) is the same for all. Returns the time per
+// frame, *hash gets the hash of all frames.
+static double render_grid_frames(unsigned threads, bool depth_buffer, int frames, uint32_t* hash)
+{
+    char pika_path[]         = "./3D_Converted_Models/little_endian_pika.pkObj";
+    char pika_texture_path[] = "./3D_Converted_Models/little_endian_pika.texture";
+    const int GRID = 5;
+    const Fix16 spacing = 6.0f;
+
+    Renderer renderer;
+    renderer.setDepthBufferEnabled(depth_buffer);
+    renderer.setThreadCount(threads);
+    // Model loading prints the texture info of every model
+    std::cout.setstate(std::ios_base::failbit);
+    for (int i = 0; i < GRID * GRID; i++){
+        Model* m = renderer.addModel(pika_path, pika_texture_path);
+        if (m == nullptr)
+            continue;
+        m->getPosition_ref().x = spacing * Fix16((int16_t) (i % GRID - GRID/2));
+        m->getPosition_ref().z = spacing * Fix16((int16_t) (i / GRID - GRID/2));
+        m->getRotation_ref().y = Fix16((int16_t) i) * 0.7f;
+        m->render_mode = 6;
+    }
+    std::cout.clear();
+    renderer.get_lightPos() = {0.0f, -10.0f, -8.0f};
+
+    double us = 0.0;
+    *hash = 2166136261u;
+    for (int frame = 0; frame < frames; frame++){
+        bench_camera(frame * 8, &renderer.get_camera_pos(), &renderer.get_camera_rot());
+        renderer.camera_move_dirty = true;
+        fillScreen(color(190,190,190));
+        int16_t_vec2 bbox_max = {0, 0};
+        int16_t_vec2 bbox_min = {SCREEN_X, SCREEN_Y};
+        auto t0 = bench_clock::now();
+        renderer.update(&bbox_max, &bbox_min);
+        // First frame builds the lighting tables and grows the buffers
+        if (frame > 0)
+            us += elapsed_us(t0, bench_clock::now());
+        *hash = frame_hash(*hash);
+    }
+    return us / (frames - 1);
+}
+
+int run_thread_benchmark(unsigned max_threads)
+{
+    const int FRAMES = 100;
+    screenPixels = new uint32_t[SCREEN_X * SCREEN_Y];
+
+    printf("hardware threads: %u\n", std::thread::hardware_concurrency());
+    printf("%-6s %-8s %12s %8s %6s\n", "depth", "threads", "us/frame", "speedup", "same");
+    bool all_same = true;
+    for (int depth = 0; depth < 2; depth++){
+        uint32_t direct_hash;
+        const double direct_us = render_grid_frames(0, depth, FRAMES, &direct_hash);
+        printf("%-6s %-8s %12.1f %8s %6s\n", depth ? "on" : "off", "direct", direct_us, "", "");
+        double single_us = 0.0;
+        for (unsigned threads = 1; threads <= max_threads; threads++){
+            uint32_t hash;
+            const double us = render_grid_frames(threads, depth, FRAMES, &hash);
+            if (threads == 1)
+                single_us = us;
+            all_same &= hash == direct_hash;
+            printf("%-6s %-8u %12.1f %7.2fx %6s\n", depth ? "on" : "off", threads, us,
+                   single_us / us, hash == direct_hash ? "yes" : "NO");
+        }
+    }
+
+    delete[] screenPixels;
+    return all_same ? 0 : 1;
+}
+
+int run_simd_benchmark()
+{
+    char pika_path[]         = "./3D_Converted_Models/little_endian_pika.pkObj";
+    char pika_texture_path[] = "./3D_Converted_Models/little_endian_pika.texture";
+    AssetCache assets;
+    Model model(assets, pika_path, pika_texture_path, true);
+    if (!model.has_texture){
+        fprintf(stderr, "Could not load %s\n", pika_texture_path);
+        return 1;
+    }
+    const int TRIANGLES = 4000;
+    const int sizes[] = {8, 32, 128};
+    const int kernel_ids[] = {SPAN_KERNELS_SCALAR, SPAN_KERNELS_SSE41, SPAN_KERNELS_AVX2};
+    const char* kernel_names[] = {"scalar", "sse4.1", "avx2"};
+    const int KERNELS = 3;
+    // Unlit, lit and lit with depth test
+    const char* variants[] = {"unlit", "lit", "depth"};
+    const int VARIANTS = 3;
+
+    // Level 0 in linear layout, the case the kernels cover
+    Texture texture = texture_copy(*model.texture, TEXTURE_FORMAT_RGB888, TEXTURE_LAYOUT_LINEAR);
+    texture.levels = 1;
+
+    screenPixels = new uint32_t[SCREEN_X * SCREEN_Y];
+    uint16_t* depthBuffer = (uint16_t*) malloc(sizeof(uint16_t) * SCREEN_X * SCREEN_Y);
+    int16_t_Point2d* tris = (int16_t_Point2d*) malloc(sizeof(int16_t_Point2d) * 3 * TRIANGLES);
+
+    printf("%-6s %-7s", "size", "shading");
+    for (int k = 0; k < KERNELS; k++)
+        printf(" %8s_Mpx/s", kernel_names[k]);
+    printf(" %8s %8s %9s\n", "sse4.1", "avx2", "same");
+    bool all_same = true;
+    for (int size : sizes)
+    {
+        // One texel per pixel around a random texel, random depths
+        uint32_t seed = 12345;
+        auto rnd = [&seed](int n) { seed = seed * 1103515245u + 12345u; return (int)((seed >> 8) % (unsigned)n); };
+        double pixels = 0.0;
+        for (int i = 0; i < TRIANGLES; i++){
+            const int cx = size + rnd(SCREEN_X - 2*size);
+            const int cy = size + rnd(SCREEN_Y - 2*size);
+            const int tu = size + rnd(texture.width - 2*size);
+            const int tv = size + rnd(texture.height - 2*size);
+            for (int k = 0; k < 3; k++){
+                int16_t_Point2d& p = tris[i*3 + k];
+                p.x = cx - size + rnd(2*size);
+                p.y = cy - size + rnd(2*size);
+                p.u = tu + p.x - cx;
+                p.v = tv + p.y - cy;
+                p.z = rnd(DEPTH_BUFFER_FAR);
+            }
+            const int16_t_Point2d* t = &tris[i*3];
+            int32_t area2 = (t[1].x - t[0].x) * (t[2].y - t[0].y) - (t[1].y - t[0].y) * (t[2].x - t[0].x);
+            pixels += (area2 < 0 ? -area2 : area2) / 2.0;
+        }
+
+        for (int variant = 0; variant < VARIANTS; variant++){
+            double us[KERNELS] = {0.0};
+            uint32_t hash[KERNELS] = {0};
+            bool supported[KERNELS];
+            for (int k = 0; k < KERNELS; k++){
+                supported[k] = span_kernels_select(kernel_ids[k]);
+                if (!supported[k])
+                    continue;
+                for (int pass = 0; pass < 3; pass++){
+                    fillScreen(color(190,190,190));
+                    for (int i = 0; i < SCREEN_X * SCREEN_Y; i++)
+                        depthBuffer[i] = (uint16_t) (i * 2654435761u >> 16);
+                    auto t0 = bench_clock::now();
+                    for (int i = 0; i < TRIANGLES; i++){
+                        const int16_t_Point2d* t = &tris[i*3];
+                        if (variant == 2)
+                            drawTriangle_depth(t[0], t[1], t[2], texture, depthBuffer, 0.8f);
+                        else
+                            drawTriangle(t[0], t[1], t[2], texture, variant == 0 ? 1.0f : 0.8f);
+                    }
+                    us[k] += elapsed_us(t0, bench_clock::now());
+                }
+                hash[k] = frame_hash(2166136261u);
+                for (int i = 0; i < SCREEN_X * SCREEN_Y; i++)
+                    hash[k] = (hash[k] ^ depthBuffer[i]) * 16777619u;
+            }
+            const double total_pixels = pixels * 3;
+            bool same = true;
+            printf("%-6d %-7s", size, variants[variant]);
+            for (int k = 0; k < KERNELS; k++){
+                if (supported[k])
+                    printf(" %15.2f", total_pixels / us[k]);
+                else
+                    printf(" %15s", "-");
+                same &= !supported[k] || hash[k] == hash[0];
+            }
+            for (int k = 1; k < KERNELS; k++){
+                if (supported[k])
+                    printf(" %7.2fx", us[0] / us[k]);
+                else
+                    printf(" %8s", "-");
+            }
+            printf(" %9s\n", same ? "yes" : "NO");
+            all_same &= same;
+        }
+    }
+    span_kernels_select(SPAN_KERNELS_AUTO);
+
+    free(tris);
+    free(depthBuffer);
+    texture_copy_free(texture);
+    delete[] screenPixels;
+    return all_same ? 0 : 1;
+}
+
+// Heap bytes of the per-model vertex data (see Model.hpp)
+static size_t model_instance_bytes(const Model& m)
+{
+    if (m.mesh == nullptr)
+        return 0;
+    return sizeof(uint_fix16_t) * m.mesh->faces_count
+         + (sizeof(int16_t_vec2) + sizeof(Fix16) + sizeof(uint8_t)) * m.mesh->vertex_count;
+}
+
+// Loads count models of path (and texture), all from one asset cache or
+// each from a cache of its own (the mesh and texture loaded per model).
+// Returns the load time, *bytes gets the heap bytes held by the models.
+static double load_instances(char* path, char* texture, unsigned count, bool shared, size_t* bytes)
+{
+    const unsigned cache_count = shared ? 1 : count;
+    AssetCache* caches = new AssetCache[cache_count];
+    Model** models = new Model*[count];
+    auto t0 = bench_clock::now();
+    for (unsigned i = 0; i < count; i++)
+        models[i] = new Model(caches[shared ? 0 : i], path, texture, true);
+    auto t1 = bench_clock::now();
+    *bytes = 0;
+    for (unsigned i = 0; i < cache_count; i++)
+        *bytes += caches[i].getBytes();
+    for (unsigned i = 0; i < count; i++){
+        *bytes += model_instance_bytes(*models[i]);
+        delete models[i];
+    }
+    delete[] models;
+    delete[] caches;
+    return elapsed_us(t0, t1);
+}
+
+int run_instance_benchmark()
+{
+    char cube_path[]         = "./3D_Converted_Models/little_endian_cube.pkObj";
+    char character_path[]    = "./3D_Converted_Models/little_endian_character_low.pkObj";
+    char pika_path[]         = "./3D_Converted_Models/little_endian_pika.pkObj";
+    char pika_texture_path[] = "./3D_Converted_Models/little_endian_pika.texture";
+    struct { const char* name; char* path; char* texture; } models[] = {
+        {"cube", cube_path, (char*) NO_TEXTURE},
+        {"character_low", character_path, (char*) NO_TEXTURE},
+        {"pika+texture", pika_path, pika_texture_path},
+    };
+    const unsigned counts[] = {1, 16, 256};
+
+    printf("%-14s %6s %14s %14s %12s %12s\n", "model", "count", "own_load_ms", "shared_load_ms", "own_KiB", "shared_KiB");
+    // Model loading prints the texture info of every model
+    std::cout.setstate(std::ios_base::failbit);
+    for (auto& m : models){
+        for (unsigned count : counts){
+            size_t own_bytes, shared_bytes;
+            const double own_us    = load_instances(m.path, m.texture, count, false, &own_bytes);
+            const double shared_us = load_instances(m.path, m.texture, count, true, &shared_bytes);
+            printf("%-14s %6u %14.2f %14.2f %12.1f %12.1f\n", m.name, count,
+                   own_us / 1000.0, shared_us / 1000.0, own_bytes / 1024.0, shared_bytes / 1024.0);
+        }
+    }
+    std::cout.clear();
+    return 0;
+}
+
+// Best of repeated mesh_load calls of path, in us
+static double best_mesh_load_us(const char* path, Mesh& mesh)
+{
+    double best = 1e30;
+    double total = 0.0;
+    for (int rep = 0; rep < 200 && (rep < 5 || total < 200000.0); rep++){
+        mesh_free(mesh);
+        auto t0 = bench_clock::now();
+        const bool loaded = mesh_load(mesh, path, false);
+        auto t1 = bench_clock::now();
+        if (!loaded)
+            return -1.0;
+        const double us = elapsed_us(t0, t1);
+        best = us < best ? us : best;
+        total += us;
+    }
+    return best;
+}
+
+int run_obj_benchmark()
+{
+    struct { const char* name; const char* obj; const char* pkobj; } models[] = {
+        {"suzanne",       "./3D_models/suzanne.obj",       nullptr},
+        {"character_low", "./3D_models/character_low.obj", "./3D_Converted_Models/little_endian_character_low.pkObj"},
+        {"pika",          "./3D_models/pika_clown3.obj",   "./3D_Converted_Models/little_endian_pika.pkObj"},
+    };
+
+    printf("%-14s %8s %8s %8s %8s %8s %10s %8s %12s %10s\n", "model", "vertices", "faces", "obj_KiB",
+           "obj_ms", "MB/s", "parse_MB/s", "pkObj_ms", "faces_match", "max_diff");
+    for (auto& m : models){
+        FILE* f = fopen(m.obj, "rb");
+        if (f == nullptr){
+            fprintf(stderr, "Could not open %s\n", m.obj);
+            return 1;
+        }
+        fseek(f, 0, SEEK_END);
+        const long bytes = ftell(f);
+        fclose(f);
+
+        Mesh obj = Mesh();
+        const double obj_us = best_mesh_load_us(m.obj, obj);
+        if (obj_us < 0.0){
+            fprintf(stderr, "Could not load %s\n", m.obj);
+            return 1;
+        }
+        // Part of the load spent on face normals and width (fixed point
+        // divisions and square roots), the rest is reading and parsing
+        double finish_us = 1e30;
+        for (int rep = 0; rep < 20; rep++){
+            auto t0 = bench_clock::now();
+            mesh_finish_load(obj, false);
+            const double us = elapsed_us(t0, bench_clock::now());
+            finish_us = us < finish_us ? us : finish_us;
+        }
+        printf("%-14s %8u %8u %8.1f %8.3f %8.1f %10.1f", m.name, obj.vertex_count, obj.faces_count,
+               bytes / 1024.0, obj_us / 1000.0, bytes / obj_us, bytes / (obj_us - finish_us));
+
+        // Same model converted offline: load time, and the parsed data
+        // against it (positions differ by the .pkObj quantization)
+        Mesh pk = Mesh();
+        const double pk_us = m.pkobj != nullptr ? best_mesh_load_us(m.pkobj, pk) : -1.0;
+        if (pk_us >= 0.0 && pk.vertex_count == obj.vertex_count && pk.faces_count == obj.faces_count){
+            bool faces_match = true;
+            fix16_t max_diff = 0;
+            for (unsigned i = 0; i < obj.faces_count; i++){
+                const u_triple a = mesh_face(obj, i), b = mesh_face(pk, i);
+                faces_match = faces_match && a.First == b.First && a.Second == b.Second && a.Third == b.Third;
+            }
+            for (unsigned i = 0; i < obj.vertex_count; i++){
+                const fix16_vec3 a = mesh_position(obj, i), b = mesh_position(pk, i);
+                const fix16_t d[3] = {fix16_abs(a.x - b.x), fix16_abs(a.y - b.y), fix16_abs(a.z - b.z)};
+                for (fix16_t c : d)
+                    max_diff = c > max_diff ? c : max_diff;
+            }
+            printf(" %8.3f %12s %10.6f\n", pk_us / 1000.0, faces_match ? "yes" : "NO", fix16_to_float(max_diff));
+        }
+        else{
+            printf(" %8s %12s %10s\n", "-", "-", "-");
+        }
+        mesh_free(obj);
+        mesh_free(pk);
+    }
+    return 0;
+}
+
+// Include guard PC headless
+#endif // PC && HEADLESS
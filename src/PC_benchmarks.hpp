@@ -0,0 +1,45 @@
+#pragma once
+
+#if defined(PC) && defined(HEADLESS)
+// Include guard PC headless
+
+// Micro benchmarks run by the headless PC build (see PC_headless.cpp).
+// Each prints a table to stdout and returns 0 on success.
+
+// Face depth sort time versus face count: bubble sort (old), radix sort
+// and coherent sort_depth over a camera orbit.
+int run_sort_benchmark();
+
+// Vertex transform time: getScreenCoordinate per vertex (old) versus
+// buildTransformMatrix + transformVertices.
+int run_transform_benchmark();
+
+// Textured triangle fill rate (pixels/sec) for small, medium and large
+// triangles: old per-pixel division rasterizer versus edge walking.
+int run_fill_benchmark();
+
+// Fill rate of squares with the texture rotated at different angles, one
+// texel per pixel: row-major versus tiled texture layout.
+int run_layout_benchmark();
+
+// Frame time of a many-model scene drawn directly and with the tile
+// renderer on 1 to max_threads threads. Checks that every thread count
+// renders the same frames as direct drawing.
+int run_thread_benchmark(unsigned max_threads);
+
+// Textured span fill rate of the scalar loops and the SSE4.1 / AVX2 span
+// kernels (unlit, lit, depth tested). Checks the output is bit-exact.
+int run_simd_benchmark();
+
+// Load time and heap memory of 1 to 256 models of the same files, each
+// model loading its own mesh and texture versus all sharing them through
+// one AssetCache.
+int run_instance_benchmark();
+
+// Parse throughput (MB/s) of loading .obj files directly (mesh_load_obj)
+// versus loading their .pkObj, and the parsed faces and positions against
+// the .pkObj ones.
+int run_obj_benchmark();
+
+// Include guard PC headless
+#endif // PC && HEADLESS
@@ -0,0 +1,534 @@
+#if defined(PC) && defined(HEADLESS)
+// Include guard PC headless
+
+// Headless PC backend. Renders into screenPixels (see PC_SDL_screen.cpp)
+// without creating any SDL window, renderer or texture. Runs a scripted
+// camera path for N frames with a fixed delta-time so every run renders the
+// exact same frames. Prints per-frame timings and throughput and can dump
+// framebuffer snapshots as PPM or raw ARGB8888.
+//
+// Build with "./makeheadless", run "./pc_headless --help".
+
+#include "libfixmath/fix16.hpp"
+
+#include "RenderFP3D.hpp"
+
+#include "constants.hpp"
+
+#include "Model.hpp"
+
+#include "Renderer.hpp"
+
+#include "PC_SDL_screen.hpp"
+
+#include "PC_benchmarks.hpp"
+
+#include "PC_SpanKernels.hpp"
+
+#include "RenderUtils.hpp"
+
+#include "DirtyRects.hpp"
+
+#include "AssetBundle.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+extern uint32_t * screenPixels;
+
+// Counts every malloc of the process (glibc: forwards to __libc_malloc), so
+// the steady-state frame loop can be checked for zero heap allocations.
+// Only built with HEADLESS_COUNT_MALLOC (makeheadless sets it), and not
+// under the sanitizers, which replace malloc themselves. Atomic, the
+// render threads allocate too.
+static std::atomic<unsigned long> heap_allocation_count(0);
+#if defined(HEADLESS_COUNT_MALLOC) && defined(__GLIBC__) && \
+    !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#   define COUNT_MALLOC 1
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* malloc(size_t size)
+{
+    heap_allocation_count.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+#else
+#   define COUNT_MALLOC 0
+#endif
+
+#define FILL_SCREEN_COLOR color(190,190,190)
+
+// Fixed delta-time per frame, keeps camera path and animations deterministic
+#define HEADLESS_DT          (1.0f/30.0f)
+#define CAMERA_PATH_RADIUS   21.0f
+#define CAMERA_PATH_SPEED     0.35f
+
+struct HeadlessOptions
+{
+    int frames;
+    int render_mode;         // Render mode of the main (pika) model
+    int dump_every;          // 0 = no snapshots
+    bool dump_raw;           // false = PPM, true = raw ARGB8888
+    const char* dump_dir;
+    const char* csv_path;    // nullptr = no per-frame csv
+    bool quiet;              // Only print summary
+    bool bench_sort;         // Run depth sort benchmark instead of frames
+    bool bench_transform;    // Run vertex transform benchmark instead of frames
+    bool bench_fill;         // Run triangle fill rate benchmark instead of frames
+    bool bench_layout;       // Run texture layout benchmark instead of frames
+    bool bench_threads;      // Run tile renderer thread scaling benchmark instead of frames
+    bool bench_simd;         // Run span kernel benchmark instead of frames
+    bool bench_instances;    // Run model instance loading benchmark instead of frames
+    bool bench_obj;          // Run .obj loading benchmark instead of frames
+    bool assert_no_alloc;    // Fail if update() allocates after the first frame
+    bool depth_buffer;       // Render with depth buffer instead of sorting
+    bool compare_depth;      // Run frames both sorted and with depth buffer
+    bool no_cull;            // Disable back-face culling on all models
+    bool static_scene;       // Camera and models stay put, only the light moves
+    bool mmap_assets;        // Map model and texture files instead of reading them
+    float orbit_radius;      // Camera path distance from the origin
+    const char* model_path;  // Mesh of the main model (.pkObj or .obj)
+    const char* texture_path; // Texture of the main model
+    int texture_max_size;    // Skip texture mip levels larger than this, 0 = load all
+    int texture_layout;      // TEXTURE_LAYOUT_* of the main model texture, -1 = default
+    int threads;             // Tile renderer threads, 0 = draw directly
+    int span_kernels;        // SPAN_KERNELS_*
+    const char* bundle_path; // Load the scene from this bundle, nullptr = separate files
+};
+
+static void print_usage()
+{
+    printf(
+        "Usage: pc_headless [options]\n"
+        "  --frames N        Number of frames to render (default 300)\n"
+        "  --mode M          Render mode of the main model (default 6)\n"
+        "  --dump-every K    Write framebuffer snapshot every K frames (default 0 = never)\n"
+        "  --dump-dir DIR    Directory for snapshots (default .)\n"
+        "  --raw             Write snapshots as raw ARGB8888 instead of PPM\n"
+        "  --csv FILE        Write per-frame timings as csv into FILE\n"
+        "  --quiet           Do not print per-frame timings to stdout\n"
+        "  --depth-buffer    Use depth buffer instead of sorting faces and models\n"
+        "  --orbit-radius R  Camera path distance from the origin (default 21, cubes at 13)\n"
+        "  --no-cull         Disable back-face culling\n"
+        "  --static-scene    Camera and models do not move (light does), frames reuse the vertex transforms\n"
+        "  --mmap-assets     Map model and texture files into memory instead of reading them\n"
+        "  --model FILE      Mesh of the main model, .pkObj or .obj (default little_endian_pika.pkObj)\n"
+        "  --texture FILE    Texture of the main model (default little_endian_pika.texture)\n"
+        "  --bundle FILE     Load the models from the pika and cube entries of an asset bundle\n"
+        "  --texture-max-size N Load only texture mip levels up to N x N\n"
+        "  --texture-layout L Texture layout of the main model, linear or tiled (default linear)\n"
+        "  --threads N       Draw with the tile renderer on N threads (default 0 = direct drawing)\n"
+        "  --span-kernels K  Textured span loops: auto, scalar, sse4.1 or avx2 (default auto)\n"
+        "  --compare-depth   Render the frames sorted and with depth buffer, compare frame times\n"
+        "  --assert-no-alloc Exit with error if a frame after the first one allocates heap memory\n"
+        "  --bench-sort      Benchmark face depth sorting versus face count and exit\n"
+        "  --bench-transform Benchmark vertex transform (per vertex trig vs matrix) and exit\n"
+        "  --bench-fill      Benchmark textured triangle fill rate and exit\n"
+        "  --bench-layout    Benchmark rotated texture fill rate, linear vs tiled texture layout, and exit\n"
+        "  --bench-threads   Benchmark tile renderer scaling from 1 to --threads (default all cores) threads and exit\n"
+        "  --bench-simd      Benchmark scalar vs SSE4.1 vs AVX2 textured spans, check they match, and exit\n"
+        "  --bench-instances Benchmark loading copies of a model with and without shared assets and exit\n"
+        "  --bench-obj       Benchmark loading .obj files directly versus their .pkObj and exit\n"
+    );
+}
+
+static bool parse_options(int argc, const char* argv[], HeadlessOptions* opt)
+{
+    *opt = {300, 6, 0, false, ".", nullptr, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, CAMERA_PATH_RADIUS,
+            "./3D_Converted_Models/little_endian_pika.pkObj", "./3D_Converted_Models/little_endian_pika.texture", 0, -1, 0, SPAN_KERNELS_AUTO, nullptr};
+    for (int i=1; i<argc; i++){
+        const char* a = argv[i];
+        bool has_value = (i+1 < argc);
+        if      (!strcmp(a, "--frames")     && has_value) opt->frames     = atoi(argv[++i]);
+        else if (!strcmp(a, "--mode")       && has_value) opt->render_mode = atoi(argv[++i]);
+        else if (!strcmp(a, "--dump-every") && has_value) opt->dump_every = atoi(argv[++i]);
+        else if (!strcmp(a, "--dump-dir")   && has_value) opt->dump_dir   = argv[++i];
+        else if (!strcmp(a, "--csv")        && has_value) opt->csv_path   = argv[++i];
+        else if (!strcmp(a, "--orbit-radius") && has_value) opt->orbit_radius = atof(argv[++i]);
+        else if (!strcmp(a, "--model")      && has_value) opt->model_path   = argv[++i];
+        else if (!strcmp(a, "--texture")    && has_value) opt->texture_path = argv[++i];
+        else if (!strcmp(a, "--bundle")     && has_value) opt->bundle_path  = argv[++i];
+        else if (!strcmp(a, "--texture-max-size") && has_value) opt->texture_max_size = atoi(argv[++i]);
+        else if (!strcmp(a, "--threads")    && has_value) opt->threads    = atoi(argv[++i]);
+        else if (!strcmp(a, "--texture-layout") && has_value){
+            const char* layout = argv[++i];
+            if      (!strcmp(layout, "linear")) opt->texture_layout = TEXTURE_LAYOUT_LINEAR;
+            else if (!strcmp(layout, "tiled"))  opt->texture_layout = TEXTURE_LAYOUT_TILED;
+            else return false;
+        }
+        else if (!strcmp(a, "--span-kernels") && has_value){
+            const char* kernels = argv[++i];
+            if      (!strcmp(kernels, "auto"))   opt->span_kernels = SPAN_KERNELS_AUTO;
+            else if (!strcmp(kernels, "scalar")) opt->span_kernels = SPAN_KERNELS_SCALAR;
+            else if (!strcmp(kernels, "sse4.1")) opt->span_kernels = SPAN_KERNELS_SSE41;
+            else if (!strcmp(kernels, "avx2"))   opt->span_kernels = SPAN_KERNELS_AVX2;
+            else return false;
+        }
+        else if (!strcmp(a, "--raw"))   opt->dump_raw = true;
+        else if (!strcmp(a, "--quiet")) opt->quiet    = true;
+        else if (!strcmp(a, "--bench-sort")) opt->bench_sort = true;
+        else if (!strcmp(a, "--bench-transform")) opt->bench_transform = true;
+        else if (!strcmp(a, "--bench-fill")) opt->bench_fill = true;
+        else if (!strcmp(a, "--bench-layout")) opt->bench_layout = true;
+        else if (!strcmp(a, "--bench-threads")) opt->bench_threads = true;
+        else if (!strcmp(a, "--bench-simd")) opt->bench_simd = true;
+        else if (!strcmp(a, "--bench-instances")) opt->bench_instances = true;
+        else if (!strcmp(a, "--bench-obj")) opt->bench_obj = true;
+        else if (!strcmp(a, "--assert-no-alloc")) opt->assert_no_alloc = true;
+        else if (!strcmp(a, "--depth-buffer"))    opt->depth_buffer    = true;
+        else if (!strcmp(a, "--compare-depth"))   opt->compare_depth   = true;
+        else if (!strcmp(a, "--no-cull"))         opt->no_cull         = true;
+        else if (!strcmp(a, "--static-scene"))    opt->static_scene    = true;
+        else if (!strcmp(a, "--mmap-assets"))     opt->mmap_assets     = true;
+        else return false;
+    }
+    return opt->frames > 0 && opt->dump_every >= 0 && opt->threads >= 0 &&
+           opt->render_mode >= 0 && opt->render_mode < RENDER_MODE_COUNT;
+}
+
+static bool dump_framebuffer(const HeadlessOptions& opt, int frame)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/frame_%05d.%s", opt.dump_dir, frame, opt.dump_raw ? "raw" : "ppm");
+    FILE* f = fopen(path, "wb");
+    if (f == nullptr){
+        fprintf(stderr, "Could not open %s for writing\n", path);
+        return false;
+    }
+    if (opt.dump_raw){
+        fwrite(screenPixels, sizeof(uint32_t), SCREEN_X * SCREEN_Y, f);
+    }
+    else{
+        fprintf(f, "P6\n%d %d\n255\n", SCREEN_X, SCREEN_Y);
+        uint8_t row[SCREEN_X * 3];
+        for (int y=0; y<SCREEN_Y; y++){
+            for (int x=0; x<SCREEN_X; x++){
+                uint32_t c = screenPixels[y * SCREEN_X + x];
+                row[x*3 + 0] = 0xff & (c>>16);
+                row[x*3 + 1] = 0xff & (c>>8);
+                row[x*3 + 2] = 0xff & (c>>0);
+            }
+            fwrite(row, 1, sizeof(row), f);
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+// FNV-1a over the framebuffer. Identical hashes -> identical output image.
+static uint32_t framebuffer_hash()
+{
+    uint32_t h = 2166136261u;
+    const uint8_t* p = (const uint8_t*) screenPixels;
+    for (unsigned i=0; i<SCREEN_X * SCREEN_Y * sizeof(uint32_t); i++){
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Camera orbits around the origin while looking at it
+static void update_camera_path(Renderer& renderer, Fix16 t, Fix16 radius)
+{
+    Fix16 angle = t * CAMERA_PATH_SPEED;
+    renderer.get_camera_pos().x = angle.sin() * -radius;
+    renderer.get_camera_pos().y = -1.6f;
+    renderer.get_camera_pos().z = angle.cos() * -radius;
+    renderer.get_camera_rot().x = angle;
+    renderer.get_camera_rot().y = 0.2f;
+    renderer.camera_move_dirty = true;
+}
+
+struct FrameSummary
+{
+    double total_us;
+    double min_us;
+    double max_us;
+    unsigned long long total_faces;
+    unsigned long long total_culled;
+    unsigned long long total_visible;
+    unsigned long long total_vertices;   // Vertices transformed
+    unsigned long long total_reused;     // Models drawn with the cached transform
+    unsigned long long total_skipped;    // Models out of memory for scratch buffers
+    // Heap allocations inside update() after the first (warm-up) frame
+    unsigned long steady_allocations;
+    // Present: bytes the dirty rects upload, time to copy them and the time
+    // of a full frame copy, frames whose presented image was wrong
+    unsigned long long present_bytes;
+    double present_us;
+    double present_full_us;
+    unsigned present_mismatches;
+    uint32_t hash;
+    double load_us;          // Adding the models (loading their files)
+};
+
+// Builds the scene and renders opt.frames frames of the camera path
+static bool run_scene(const HeadlessOptions& opt, bool depth_buffer, FrameSummary* summary)
+{
+    fillScreen(FILL_SCREEN_COLOR);
+
+    char model1_path[512];
+    snprintf(model1_path, sizeof(model1_path), "%s", opt.model_path);
+    char model1_texture_path[512];
+    snprintf(model1_texture_path, sizeof(model1_texture_path), "%s", opt.texture_path);
+    char model2_path[]         = "./3D_Converted_Models/little_endian_cube.pkObj";
+
+    // Same scene as the interactive PC / ClassPad build (main.cpp)
+    Renderer renderer;
+    if (!renderer.setDepthBufferEnabled(depth_buffer))
+        return false;
+    renderer.setThreadCount(opt.threads);
+
+    typedef std::chrono::steady_clock clock;
+    const auto load_t0 = clock::now();
+    // Models from the separate files, or from the entries of a bundle
+    AssetBundle bundle = {nullptr, -1, 0, nullptr}; // Closed
+    if (opt.bundle_path != nullptr && !asset_bundle_open(bundle, opt.bundle_path))
+        return false;
+    char pika_name[] = "pika";
+    char cube_name[] = "cube";
+
+    auto model = opt.bundle_path != nullptr
+        ? renderer.addModel(bundle, pika_name, pika_name, true, opt.texture_max_size)
+        : renderer.addModel(model1_path, model1_texture_path, true, opt.texture_max_size);
+    if (model == nullptr){
+        asset_bundle_close(bundle);
+        return false;
+    }
+    if (model->has_texture && opt.texture_layout >= 0 && !texture_set_layout(*model->texture, opt.texture_layout)){
+        asset_bundle_close(bundle);
+        return false;
+    }
+    model->getRotation_ref().y = Fix16(3.145f/2.0f);
+    model->render_mode = opt.render_mode;
+
+    const int16_t place_count = 4;
+    const Fix16 radius = 13.0f;
+    Model* autoplaced_models[place_count];
+    uint16_t rend_mod = 0;
+    for(int16_t i=0; i<place_count; i++){
+        Fix16 place_in_circle = ((Fix16(fix16_pi)) * 2.0f * Fix16(i) / place_count);
+        auto m = opt.bundle_path != nullptr
+            ? renderer.addModel(bundle, cube_name, NO_TEXTURE)
+            : renderer.addModel(model2_path, NO_TEXTURE);
+        if (m == nullptr){
+            asset_bundle_close(bundle);
+            return false;
+        }
+        autoplaced_models[i] = m;
+        m->getPosition_ref().x = place_in_circle.sin() * radius;
+        m->getPosition_ref().y = +5.0f;
+        m->getPosition_ref().z = place_in_circle.cos() * radius;
+        m->getRotation_ref().y = Fix16(3.145f/2.0f);
+        m->render_mode = (rend_mod++)%RENDER_MODE_COUNT;
+        m->_scaleModelTo(7.0f);
+    }
+    if (opt.bundle_path != nullptr)
+        asset_bundle_close(bundle);
+    const double load_us = std::chrono::duration<double, std::micro>(clock::now() - load_t0).count();
+    for (unsigned i=0; i<renderer.getModelCount(); i++)
+        renderer.getModelArray()[i].first->backface_culling = !opt.no_cull;
+
+    FILE* csv = nullptr;
+    if (opt.csv_path != nullptr){
+        csv = fopen(opt.csv_path, "w");
+        if (csv == nullptr){
+            fprintf(stderr, "Could not open %s for writing\n", opt.csv_path);
+            return false;
+        }
+        fprintf(csv, "frame,render_us,faces_drawn,faces_culled,vertices_transformed,hash\n");
+    }
+
+    const Fix16 dt = HEADLESS_DT;
+    Fix16 t = 0.0f;
+    Fix16 lightRotation = 0.0f;
+
+    *summary = FrameSummary();
+    summary->min_us = 1e30;
+    summary->load_us = load_us;
+
+    // Stand-in for the SDL texture of the windowed build, updated with the
+    // dirty rects only (see present_dirty_rects in main.cpp)
+    uint32_t* texture = new uint32_t[SCREEN_X * SCREEN_Y];
+    uint32_t* texture_full = new uint32_t[SCREEN_X * SCREEN_Y];
+    DirtyRects drawn_rects;
+    DirtyRects cleared_rects;
+    cleared_rects.add(0, 0, SCREEN_X, SCREEN_Y);
+
+    for (int frame=0; frame<opt.frames; frame++)
+    {
+        t += dt;
+        lightRotation += dt * 1.2f;
+        renderer.get_lightPos().x = lightRotation.sin() * -8.0f;
+        renderer.get_lightPos().y = -10.0f;
+        renderer.get_lightPos().z = lightRotation.cos() * -8.0f;
+
+        if (!opt.static_scene || frame == 0){
+            update_camera_path(renderer, t, opt.orbit_radius);
+
+            model->getRotation_ref().x += dt * 0.5f;
+            auto roty = autoplaced_models[0]->getRotation_ref().y + dt * 1.0f;
+            auto rotx = autoplaced_models[0]->getRotation_ref().x + dt * 1.0f;
+            for (int i=0; i<place_count; i++){
+                autoplaced_models[i]->getRotation_ref().y = roty;
+                autoplaced_models[i]->getRotation_ref().x = rotx;
+            }
+        }
+
+        int16_t_vec2 bbox_max = {0, 0};
+        int16_t_vec2 bbox_min = {SCREEN_X, SCREEN_Y};
+
+        unsigned long allocations_before = heap_allocation_count;
+        auto t0 = clock::now();
+        renderer.update(&bbox_max, &bbox_min);
+        auto t1 = clock::now();
+        if (frame > 0)
+            summary->steady_allocations += heap_allocation_count - allocations_before;
+
+        double us = std::chrono::duration<double, std::micro>(t1 - t0).count();
+        summary->total_us += us;
+        if (us < summary->min_us) summary->min_us = us;
+        if (us > summary->max_us) summary->max_us = us;
+        const RenderStats& stats = renderer.get_stats();
+        summary->total_faces += stats.faces_drawn;
+        summary->total_culled += stats.faces_culled;
+        summary->total_visible += stats.faces_visible;
+        summary->total_vertices += stats.vertices_transformed;
+        summary->total_reused += stats.models_reused;
+        summary->total_skipped += stats.models_skipped;
+
+        uint32_t hash = framebuffer_hash();
+        summary->hash = hash;
+        if (!opt.quiet)
+            printf("frame %5d  %9.1f us  faces %6u  hash %08x\n", frame, us, stats.faces_drawn, hash);
+        if (csv != nullptr)
+            fprintf(csv, "%d,%.1f,%u,%u,%u,%08x\n", frame, us, stats.faces_drawn, stats.faces_culled, stats.vertices_transformed, hash);
+        if (opt.dump_every > 0 && frame % opt.dump_every == 0)
+            dump_framebuffer(opt, frame);
+
+        // Present what changed: drawn now or cleared after last frame
+        drawn_rects.clear();
+        drawn_rects.add(bbox_min.x, bbox_min.y, bbox_max.x, bbox_max.y);
+        drawn_rects.add(rotationVisualizerRect());
+        drawn_rects.add(renderer.get_LightLocationRect());
+        cleared_rects.add(drawn_rects);
+        auto p0 = clock::now();
+        for (unsigned i=0; i<cleared_rects.count; i++){
+            const ScreenRect& r = cleared_rects.rects[i];
+            copyScreenRect(r, &texture[r.y0 * SCREEN_X + r.x0], SCREEN_X * sizeof(uint32_t));
+        }
+        auto p1 = clock::now();
+        memcpy(texture_full, screenPixels, SCREEN_X * SCREEN_Y * sizeof(uint32_t));
+        auto p2 = clock::now();
+        summary->present_bytes += cleared_rects.pixels() * sizeof(uint32_t);
+        summary->present_us += std::chrono::duration<double, std::micro>(p1 - p0).count();
+        summary->present_full_us += std::chrono::duration<double, std::micro>(p2 - p1).count();
+        if (memcmp(texture, screenPixels, SCREEN_X * SCREEN_Y * sizeof(uint32_t)) != 0)
+            summary->present_mismatches++;
+
+        // Back to background where the frame drew
+        drawn_rects.fill(FILL_SCREEN_COLOR);
+        cleared_rects = drawn_rects;
+    }
+
+    delete[] texture;
+    delete[] texture_full;
+    if (csv != nullptr)
+        fclose(csv);
+    return true;
+}
+
+static void print_summary(const HeadlessOptions& opt, const FrameSummary& sum)
+{
+    double total_s = sum.total_us / 1e6;
+    printf("frames:          %d\n",        opt.frames);
+    printf("scene load:      %.2f ms\n",   sum.load_us / 1000.0);
+    printf("render time:     %.3f s\n",     total_s);
+    printf("frame time:      avg %.1f us  min %.1f us  max %.1f us\n", sum.total_us / opt.frames, sum.min_us, sum.max_us);
+    printf("frames/sec:      %.1f\n",      opt.frames / total_s);
+    printf("triangles/sec:   %.0f\n",      sum.total_faces / total_s);
+    printf("faces/frame:     visible %.1f  culled %.1f\n", (double)sum.total_visible / opt.frames, (double)sum.total_culled / opt.frames);
+    printf("models/frame:    vertices transformed %.1f  reused transform %.1f\n", (double)sum.total_vertices / opt.frames, (double)sum.total_reused / opt.frames);
+    if (sum.total_skipped > 0)
+        printf("models skipped:  %llu (out of memory for scratch buffers)\n", sum.total_skipped);
+    printf("present:         %.1f KiB/frame (full frame %u KiB)  copy avg %.1f us (full frame %.1f us)  wrong frames %u\n",
+           sum.present_bytes / 1024.0 / opt.frames, (unsigned)(SCREEN_X * SCREEN_Y * sizeof(uint32_t) / 1024),
+           sum.present_us / opt.frames, sum.present_full_us / opt.frames, sum.present_mismatches);
+    printf("last frame hash: %08x\n",      sum.hash);
+    if (COUNT_MALLOC)
+        printf("steady-state heap allocations: %lu\n", sum.steady_allocations);
+    else
+        printf("steady-state heap allocations: not counted (needs HEADLESS_COUNT_MALLOC, no sanitizers)\n");
+}
+
+int main(int argc, const char * argv[])
+{
+    HeadlessOptions opt;
+    if (!parse_options(argc, argv, &opt)){
+        print_usage();
+        return 1;
+    }
+    if (opt.assert_no_alloc && !COUNT_MALLOC){
+        fprintf(stderr, "--assert-no-alloc needs a build with HEADLESS_COUNT_MALLOC and no sanitizers\n");
+        return 1;
+    }
+    file_blob_set_mmap(opt.mmap_assets);
+    if (!span_kernels_select(opt.span_kernels)){
+        fprintf(stderr, "CPU does not support the selected span kernels\n");
+        return 1;
+    }
+    if (opt.bench_sort)
+        return run_sort_benchmark();
+    if (opt.bench_transform)
+        return run_transform_benchmark();
+    if (opt.bench_fill)
+        return run_fill_benchmark();
+    if (opt.bench_layout)
+        return run_layout_benchmark();
+    if (opt.bench_threads){
+        unsigned max_threads = opt.threads > 0 ? opt.threads : std::thread::hardware_concurrency();
+        return run_thread_benchmark(max_threads < 2 ? 2 : max_threads);
+    }
+    if (opt.bench_simd)
+        return run_simd_benchmark();
+    if (opt.bench_instances)
+        return run_instance_benchmark();
+    if (opt.bench_obj)
+        return run_obj_benchmark();
+
+    screenPixels = new uint32_t[SCREEN_X * SCREEN_Y];
+
+    FrameSummary sum;
+    unsigned long steady_allocations = 0;
+    if (opt.compare_depth){
+        // Same frames with painter's algorithm (sorting) and with depth buffer
+        FrameSummary depth_sum;
+        if (!run_scene(opt, false, &sum) || !run_scene(opt, true, &depth_sum))
+            return 1;
+        printf("== painter's algorithm (sorted) ==\n");
+        print_summary(opt, sum);
+        printf("== depth buffer ==\n");
+        print_summary(opt, depth_sum);
+        printf("depth buffer / sorted frame time: %.3f\n", depth_sum.total_us / sum.total_us);
+        steady_allocations = sum.steady_allocations + depth_sum.steady_allocations;
+    }
+    else{
+        if (!run_scene(opt, opt.depth_buffer, &sum))
+            return 1;
+        print_summary(opt, sum);
+        steady_allocations = sum.steady_allocations;
+    }
+
+    delete[] screenPixels;
+    if (opt.assert_no_alloc && steady_allocations > 0){
+        fprintf(stderr, "Frame loop allocated heap memory after the first frame\n");
+        return 2;
+    }
+    return 0;
+}
+
+// Include guard PC headless
+#endif // PC && HEADLESS
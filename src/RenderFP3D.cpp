@@ -2,6 +2,10 @@
 
 #include "constants.hpp"
 
+#include "Mesh.hpp"
+
+#include "Clipping.hpp"
+
 #ifdef PC
 #   include <iostream>
 #endif
@@ -28,8 +32,6 @@ fix16_vec2 getScreenCoordinate(
     Fix16* z_depth_out,
     bool* is_valid
 ) {
-    Fix16 sx, sy;
-
     point.x *= scale.x;
     point.y *= scale.y;
     point.z *= scale.z;
@@ -52,14 +54,21 @@ fix16_vec2 getScreenCoordinate(
     // Output Z-Depth
     *z_depth_out = temp.z;
 
+    return projectToScreen(FOV, temp, is_valid);
+}
+
+fix16_vec2 projectToScreen(Fix16 FOV, fix16_vec3 point, bool* is_valid)
+{
+    Fix16 sx, sy;
+
     // Make sure there is no division with zero
-    if (temp.z == 0.0f){
-        temp.z = 0.001f;
+    if (point.z == 0.0f){
+        point.z = 0.001f;
     }
     // fov/z
-    auto focal = FOV/temp.z;
-    auto realx = ((temp.x)*focal);
-    auto realy = ((temp.y)*focal);
+    auto focal = FOV/point.z;
+    auto realx = ((point.x)*focal);
+    auto realy = ((point.y)*focal);
     // Shift to screen center (from coordinate center)
     sx = Fix16((int16_t) (SCREEN_X/2)) + (realx);
     sy = Fix16((int16_t) (SCREEN_Y/2)) + (realy);
@@ -67,7 +76,7 @@ fix16_vec2 getScreenCoordinate(
     // Some extra buffer around actual screen area, where we would still consider
     // pixel to be "visible".
     auto extra = 200.0f;
-    if( temp.z < 0.0f
+    if( point.z < 0.0f
         ||
         sx < (0.0f-extra) || sx > ((float)SCREEN_X+extra)
         ||
@@ -83,3 +92,89 @@ fix16_vec2 getScreenCoordinate(
 
     return fix16_vec2({sx, sy});
 }
+
+// Matrix of rotateOnPlane(x,z, rx) followed by rotateOnPlane(y,z, ry)
+static fix16_mat3x4 rotationMatrix(fix16_vec2 rotation)
+{
+    const Fix16 sx = rotation.x.sin();
+    const Fix16 cx = rotation.x.cos();
+    const Fix16 sy = rotation.y.sin();
+    const Fix16 cy = rotation.y.cos();
+    return fix16_mat3x4({{
+        { cx,     0.0f, -sx,     0.0f},
+        {-sy*sx,  cy,   -sy*cx,  0.0f},
+        { cy*sx,  sy,    cy*cx,  0.0f},
+    }});
+}
+
+fix16_mat3x4 buildTransformMatrix(
+    fix16_vec3 translate, fix16_vec2 rotation, fix16_vec3 scale,
+    fix16_vec3 camera_pos, fix16_vec2 camera_rot
+) {
+    const fix16_mat3x4 model = rotationMatrix(rotation);
+    const fix16_mat3x4 camera = rotationMatrix(camera_rot);
+    const Fix16 t[3] = {
+        translate.x - camera_pos.x,
+        translate.y - camera_pos.y,
+        translate.z - camera_pos.z,
+    };
+    const Fix16 s[3] = {scale.x, scale.y, scale.z};
+
+    fix16_mat3x4 out;
+    for (int r=0; r<3; r++){
+        for (int c=0; c<3; c++){
+            Fix16 sum = camera.m[r][0]*model.m[0][c]
+                      + camera.m[r][1]*model.m[1][c]
+                      + camera.m[r][2]*model.m[2][c];
+            out.m[r][c] = sum * s[c];
+        }
+        out.m[r][3] = camera.m[r][0]*t[0] + camera.m[r][1]*t[1] + camera.m[r][2]*t[2];
+    }
+    return out;
+}
+
+static inline fix16_vec3 stored_vertex(const fix16_vec3& p)
+{
+    return p;
+}
+
+static inline fix16_vec3 stored_vertex(const int16_vec3& q)
+{
+    return {Fix16((fix16_t) q.x), Fix16((fix16_t) q.y), Fix16((fix16_t) q.z)};
+}
+
+// One loop per stored vertex format, no format check per vertex
+template <typename Vertex>
+static void transform_vertices(
+    const Vertex* vertices, unsigned vertex_count, const fix16_mat3x4& mat, const ClipFrustum& frustum,
+    int16_t_vec2* out_screen, Fix16* out_depth, uint8_t* out_codes,
+    int16_t_vec2* bbox_max, int16_t_vec2* bbox_min
+) {
+    for (unsigned v_id=0; v_id<vertex_count; v_id++){
+        const fix16_vec3 p = transformPoint(mat, stored_vertex(vertices[v_id]));
+        const uint8_t code = clip_code(frustum, p);
+        out_depth[v_id] = p.z;
+        out_codes[v_id] = code;
+        // Cannot be projected, clipping takes care of the faces
+        if (code & CLIP_NEAR)
+            continue;
+        const int16_t_vec2 screen = projectInside(frustum.FOV, p);
+        out_screen[v_id] = screen;
+        // Check bbox. Clamped points still bound the clipped faces.
+        if (bbox_max->x < screen.x) bbox_max->x = screen.x;
+        if (bbox_max->y < screen.y) bbox_max->y = screen.y;
+        if (bbox_min->x > screen.x) bbox_min->x = screen.x;
+        if (bbox_min->y > screen.y) bbox_min->y = screen.y;
+    }
+}
+
+void transformVertices(
+    const Mesh* mesh, const fix16_mat3x4& mat, const ClipFrustum& frustum,
+    int16_t_vec2* out_screen, Fix16* out_depth, uint8_t* out_codes,
+    int16_t_vec2* bbox_max, int16_t_vec2* bbox_min
+) {
+    if (mesh->qvertices != nullptr)
+        transform_vertices(mesh->qvertices, mesh->vertex_count, mat, frustum, out_screen, out_depth, out_codes, bbox_max, bbox_min);
+    else
+        transform_vertices(mesh->vertices, mesh->vertex_count, mat, frustum, out_screen, out_depth, out_codes, bbox_max, bbox_min);
+}
@@ -14,6 +14,16 @@ struct int16_t_Point2d
     int16_t y;
     int16_t u;
     int16_t v;
+    uint16_t z; // Depth buffer value, only used by depth tested drawing
+};
+
+// Screen area [x0, x1) x [y0, y1)
+struct ScreenRect
+{
+    int16_t x0;
+    int16_t y0;
+    int16_t x1;
+    int16_t y1;
 };
 
 struct color8_vec
@@ -42,8 +52,19 @@ struct uint_fix16_t
     Fix16        fix16;
 };
 
+// Affine 3D transform. Rotation and scale in columns 0..2, translation in column 3.
+struct fix16_mat3x4
+{
+    Fix16 m[3][4];
+};
+
+struct Mesh;
+struct ClipFrustum;
+
 void rotateOnPlane(Fix16& a, Fix16& b, Fix16 radians);
 
+// Single point version of buildTransformMatrix + projectToScreen.
+// Evaluates 4 sin/cos pairs per call -> use transformVertices for meshes.
 fix16_vec2 getScreenCoordinate(
     Fix16 FOV, fix16_vec3 point,
     fix16_vec3 translate, fix16_vec2 rotation, fix16_vec3 scale,
@@ -51,3 +72,36 @@ fix16_vec2 getScreenCoordinate(
     Fix16* z_depth,
     bool* is_valid
 );
+
+// Object space -> camera space matrix: scale, model rotation, translation,
+// camera translation and camera rotation (same order as getScreenCoordinate).
+// The trigonometry is evaluated once per call instead of once per vertex.
+fix16_mat3x4 buildTransformMatrix(
+    fix16_vec3 translate, fix16_vec2 rotation, fix16_vec3 scale,
+    fix16_vec3 camera_pos, fix16_vec2 camera_rot
+);
+
+inline fix16_vec3 transformPoint(const fix16_mat3x4& mat, const fix16_vec3& p)
+{
+    return fix16_vec3({
+        mat.m[0][0]*p.x + mat.m[0][1]*p.y + mat.m[0][2]*p.z + mat.m[0][3],
+        mat.m[1][0]*p.x + mat.m[1][1]*p.y + mat.m[1][2]*p.z + mat.m[1][3],
+        mat.m[2][0]*p.x + mat.m[2][1]*p.y + mat.m[2][2]*p.z + mat.m[2][3],
+    });
+}
+
+// Camera space point to screen coordinates. Points behind the camera or far
+// outside the screen are invalid and get x = fix16_minimum.
+fix16_vec2 projectToScreen(Fix16 FOV, fix16_vec3 point, bool* is_valid);
+
+// Transforms and projects all vertices of the mesh with given matrix, which
+// takes the stored positions (see mesh_vertex_matrix) to camera space.
+// out_codes[i] gets the frustum outcode (see Clipping.hpp), out_depth[i] the
+// camera space depth and out_screen[i] the screen coordinates clamped to the
+// screen (exact for vertices with outcode 0, unset behind the near plane).
+// bbox is grown to contain every vertex in front of the near plane.
+void transformVertices(
+    const Mesh* mesh, const fix16_mat3x4& mat, const ClipFrustum& frustum,
+    int16_t_vec2* out_screen, Fix16* out_depth, uint8_t* out_codes,
+    int16_t_vec2* bbox_max, int16_t_vec2* bbox_min
+);
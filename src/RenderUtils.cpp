@@ -10,126 +10,620 @@
 #   include <sdk/calc/calc.hpp>
 #else
 #   include "PC_SDL_screen.hpp" // replaces "sdk/os/lcd.hpp"
+#   include "PC_SpanKernels.hpp"
 #endif
 
-// Light intensity range 1.0f - MIN_LIGHT_INTENSITY
-// It looks much better if colors wont go to full black
-#define MIN_LIGHT_INTENSITY 0.10f
+// -- Edge walking rasterizer
+// The triangle is split at its middle vertex into an upper and a lower half.
+// x of both edges and the attributes (u, v, z) of the left edge are stepped
+// once per scanline. Along the scanline the attributes are stepped with per
+// triangle gradients taken from the widest span (at the middle vertex).
+// Divisions only happen in the setup, none per scanline or per pixel.
 
-// -- Some Helper functions
-// -- TODO: Move these somewhere else
-Fix16 calculateLightIntensity(const fix16_vec3& lightPos, const fix16_vec3& surfacePos, const fix16_vec3& normal, Fix16 lightIntensity)
+// Edge from a to b. x, u and v in 16.16 fixed point, z in 24.8.
+struct RasterEdge
 {
-    fix16_vec3 lightDir = {lightPos.x - surfacePos.x, lightPos.y - surfacePos.y, lightPos.z - surfacePos.z};
-    normalize_fix16_vec3(lightDir);
+    int32_t x, u, v, z;
+    int32_t dx, du, dv, dz;
+};
 
-    // Intensity from 0.0f -> 1.0f
-    Fix16 intensity = lightIntensity * fix16_max(0, lightDir.x * normal.x + lightDir.y * normal.y + lightDir.z * normal.z);
+// Per pixel steps along a scanline (same fixed point as RasterEdge)
+struct RasterGradients
+{
+    int32_t du, dv, dz;
+};
+
+struct RasterTriangle
+{
+    int16_t_Point2d v0, v1, v2; // Sorted by y
+    RasterEdge long_edge;       // v0 -> v2
+    RasterEdge upper_edge;      // v0 -> v1
+    RasterEdge lower_edge;      // v1 -> v2
+    RasterGradients grad;
+    bool long_is_left;
+};
 
-    // Ensure intensity is at least minIntensity
-    intensity = fix16_max(intensity, Fix16(MIN_LIGHT_INTENSITY));
+static inline void raster_edge(RasterEdge& e, const int16_t_Point2d& a, const int16_t_Point2d& b, bool uv, bool z)
+{
+    const int dy = b.y - a.y;
+    e.x = a.x << 16;
+    e.u = a.u << 16;
+    e.v = a.v << 16;
+    e.z = a.z << 8;
+    e.dx = e.du = e.dv = e.dz = 0;
+    if (dy <= 0)
+        return;
+    e.dx = ((b.x - a.x) << 16) / dy;
+    if (uv) {
+        e.du = ((b.u - a.u) << 16) / dy;
+        e.dv = ((b.v - a.v) << 16) / dy;
+    }
+    if (z)
+        e.dz = ((b.z - a.z) << 8) / dy;
+}
 
-    // Mapping between target value
-    return intensity;
+static inline void raster_step(RasterEdge& e)
+{
+    e.x += e.dx;
+    e.u += e.du;
+    e.v += e.dv;
+    e.z += e.dz;
 }
 
-void drawHorizontalLine(
-    int x0, int x1, int y,
-    int u0, int u1, int v0, int v1,
-    uint32_t *texture, int textureWidth, int textureHeight,
-    Fix16 lightInstensity
+// n steps at once, same result as n raster_step calls
+static inline void raster_skip(RasterEdge& e, int n)
+{
+    e.x += e.dx * n;
+    e.u += e.du * n;
+    e.v += e.dv * n;
+    e.z += e.dz * n;
+}
+
+// Area the rasterizers draw to. The PC tile renderer draws one tile per
+// thread, on the calculator it is always the whole screen.
+static inline ScreenRect raster_clip()
+{
+#ifdef PC
+    return clipRect;
+#else
+    return ScreenRect({0, 0, SCREEN_X, SCREEN_Y});
+#endif
+}
+
+// Sorts the points and sets up edges and gradients. uv and z select the
+// attributes that are needed. Returns false if there is nothing to draw.
+static inline bool raster_setup(
+    RasterTriangle& t,
+    int16_t_Point2d v0, int16_t_Point2d v1, int16_t_Point2d v2,
+    bool uv, bool z
 ) {
-    if (x0 > x1) {
-        swap(x0, x1);
-        swap(u0, u1);
-        swap(v0, v1);
-    }
-
-    if (x0 == x1) {
-        int u = u0;
-        int v = v0;
-
-        if (u >= 0 && u < textureWidth && v >= 0 && v < textureHeight) {
-            auto texel = texture[u + v * textureWidth];
-            uint8_t r = (0xff & (texel>>16));
-            uint8_t g = (0xff & (texel>>8));
-            uint8_t b = (0xff & texel);
-            r = (uint8_t) ((int16_t)(Fix16((int16_t)r) * lightInstensity));
-            g = (uint8_t) ((int16_t)(Fix16((int16_t)g) * lightInstensity));
-            b = (uint8_t) ((int16_t)(Fix16((int16_t)b) * lightInstensity));
-            auto c = color(r,g,b);
-            setPixel(x0, y, c);
+    if (v0.y > v1.y) swap(v0, v1);
+    if (v0.y > v2.y) swap(v0, v2);
+    if (v1.y > v2.y) swap(v1, v2);
+
+    // If triangle happens to be just a line, lets avoid it completely
+    if (v2.y == v0.y)
+        return false;
+
+    t.v0 = v0; t.v1 = v1; t.v2 = v2;
+    raster_edge(t.long_edge,  v0, v2, uv, z);
+    raster_edge(t.upper_edge, v0, v1, uv, z);
+    raster_edge(t.lower_edge, v1, v2, uv, z);
+
+    // Long edge at the middle vertex: widest span of the triangle
+    const int32_t dy = v1.y - v0.y;
+    const int32_t width = ((v0.x << 16) + t.long_edge.dx * dy - (v1.x << 16)) >> 16;
+    t.long_is_left = width < 0;
+    t.grad = {0, 0, 0};
+    if (width != 0) {
+        if (uv) {
+            t.grad.du = ((v0.u << 16) + t.long_edge.du * dy - (v1.u << 16)) / width;
+            t.grad.dv = ((v0.v << 16) + t.long_edge.dv * dy - (v1.v << 16)) / width;
         }
+        if (z)
+            t.grad.dz = ((v0.z << 8) + t.long_edge.dz * dy - (v1.z << 8)) / width;
+    }
+    return true;
+}
+
+// Calls span(y, x_left, x_right, skip, left_edge) for every scanline inside
+// the clip rectangle. x_right is inclusive, skip is the number of pixels
+// from the left edge to x_left (attributes need to be stepped that much).
+template <typename SpanFn>
+static inline void raster_walk(RasterTriangle& t, SpanFn span)
+{
+    const ScreenRect clip = raster_clip();
+    if (t.v2.y < clip.y0 || t.v0.y >= clip.y1)
         return;
+    RasterEdge* short_edge = &t.upper_edge;
+    int y = t.v0.y;
+    if (y < clip.y0) {
+        // Jump the edges to the first row inside
+        raster_skip(t.long_edge, clip.y0 - y);
+        if (clip.y0 < t.v1.y) {
+            raster_skip(t.upper_edge, clip.y0 - y);
+        } else {
+            raster_skip(t.lower_edge, clip.y0 - t.v1.y);
+            short_edge = &t.lower_edge;
+        }
+        y = clip.y0;
+    }
+    const int y_end = t.v2.y < clip.y1 ? t.v2.y : clip.y1 - 1;
+    for (; y <= y_end; y++) {
+        if (y == t.v1.y)
+            short_edge = &t.lower_edge;
+        const RasterEdge& left  = t.long_is_left ? t.long_edge : *short_edge;
+        const RasterEdge& right = t.long_is_left ? *short_edge : t.long_edge;
+        int x0 = left.x >> 16;
+        int x1 = right.x >> 16;
+        int skip = 0;
+        if (x0 < clip.x0) {
+            skip = clip.x0 - x0;
+            x0 = clip.x0;
+        }
+        if (x1 > clip.x1 - 1)
+            x1 = clip.x1 - 1;
+        if (x0 <= x1)
+            span(y, x0, x1, skip, left);
+        raster_step(t.long_edge);
+        raster_step(*short_edge);
     }
+}
+
+// Lighting is quantized to LIGHT_LEVELS+1 levels (0.0f - 1.0f). Each level
+// has tables scaling the color channels, so a lit texel costs three lookups
+// instead of three Fix16 multiplies. Faces are lit as a whole, so the
+// quantization only shows as slightly coarser steps between faces.
+#define LIGHT_LEVELS 32
+// 8 bit channel -> 8 bit channel (RGB888 textures)
+static uint8_t light_lut[LIGHT_LEVELS + 1][256];
+// 5/6/5 bit channel -> color_t with only that channel set (RGB565 textures).
+// Red at [0], green at [32] and blue at [96].
+static color_t light_lut565[LIGHT_LEVELS + 1][32 + 64 + 32];
+static bool light_lut_ready = false;
+
+// Expands 5 or 6 bit channel to 8 bits
+static inline uint8_t expand5(unsigned c) { return (uint8_t) ((c << 3) | (c >> 2)); }
+static inline uint8_t expand6(unsigned c) { return (uint8_t) ((c << 2) | (c >> 4)); }
+
+static inline uint8_t scale_channel(unsigned c, int level)
+{
+    return (uint8_t) ((c * level + LIGHT_LEVELS/2) / LIGHT_LEVELS);
+}
 
-    for (int x = x0; x <= x1; x++) {
-        int alpha = (x - x0) * 65536 / (x1 - x0);
-        int u = ((u1 - u0) * alpha + u0 * 65536) >> 16;
-        int v = ((v1 - v0) * alpha + v0 * 65536) >> 16;
-
-        if (u >= 0 && u < textureWidth && v >= 0 && v < textureHeight) {
-            auto texel = texture[u + v * textureWidth];
-            uint8_t r = (0xff & (texel>>16));
-            uint8_t g = (0xff & (texel>>8));
-            uint8_t b = (0xff & texel);
-            r = (uint8_t) ((int16_t)(Fix16((int16_t)r) * lightInstensity));
-            g = (uint8_t) ((int16_t)(Fix16((int16_t)g) * lightInstensity));
-            b = (uint8_t) ((int16_t)(Fix16((int16_t)b) * lightInstensity));
-            auto c = color(r,g,b);
-            setPixel(x, y, c);
+void init_light_tables()
+{
+    if (light_lut_ready)
+        return;
+    for (int level = 0; level <= LIGHT_LEVELS; level++) {
+        for (int c = 0; c < 256; c++)
+            light_lut[level][c] = scale_channel(c, level);
+        for (int c = 0; c < 32; c++) {
+            light_lut565[level][c]      = color(scale_channel(expand5(c), level), 0, 0);
+            light_lut565[level][96 + c] = color(0, 0, scale_channel(expand5(c), level));
         }
+        for (int c = 0; c < 64; c++)
+            light_lut565[level][32 + c] = color(0, scale_channel(expand6(c), level), 0);
     }
+    light_lut_ready = true;
 }
 
-void drawTriangle(
-    int16_t_Point2d v0, int16_t_Point2d v1, int16_t_Point2d v2,
-    uint32_t *texture, int textureWidth, int textureHeight,
-    Fix16 lightInstensity
+// Light level 0 - LIGHT_LEVELS of the intensity. The tables are built on
+// first use (global constructors are not run on the calculator).
+static int light_level(Fix16 lightInstensity)
+{
+    if (!light_lut_ready)
+        init_light_tables();
+    int32_t level = (lightInstensity.value * LIGHT_LEVELS + 0x8000) >> 16;
+    if (level < 0) level = 0;
+    if (level > LIGHT_LEVELS) level = LIGHT_LEVELS;
+    return level;
+}
+
+// Texel shaders, turn a texel into the framebuffer color
+struct UnlitRGB888
+{
+    color_t operator()(uint32_t texel) const
+    {
+        return color(0xff & (texel>>16), 0xff & (texel>>8), 0xff & texel);
+    }
+};
+
+struct ShadeRGB888
+{
+    const uint8_t* lut;
+    int level;
+    color_t operator()(uint32_t texel) const
+    {
+        return color(lut[0xff & (texel>>16)], lut[0xff & (texel>>8)], lut[0xff & texel]);
+    }
+};
+
+struct UnlitRGB565
+{
+    color_t operator()(uint16_t texel) const
+    {
+#ifdef PC
+        return color(expand5(texel >> 11), expand6((texel >> 5) & 0x3f), expand5(texel & 0x1f));
+#else
+        return texel;
+#endif
+    }
+};
+
+struct ShadeRGB565
+{
+    const color_t* lut;
+    color_t operator()(uint16_t texel) const
+    {
+        return lut[texel >> 11] | lut[32 + ((texel >> 5) & 0x3f)] | lut[96 + (texel & 0x1f)];
+    }
+};
+
+// Framebuffer colors (palettes of the indexed formats) shaded like the
+// texels of the same format
+#ifdef PC
+typedef ShadeRGB888 ShadeColor;
+static inline ShadeColor shade_color(int level) { return ShadeRGB888({light_lut[level], level}); }
+#else
+typedef ShadeRGB565 ShadeColor;
+static inline ShadeColor shade_color(int level) { return ShadeRGB565({light_lut565[level]}); }
+#endif
+
+// Palette index to a color of the palette
+struct PaletteColor
+{
+    const color_t* palette;
+    color_t operator()(uint8_t index) const { return palette[index]; }
+};
+
+// Palette index to a color of the palette, shaded
+struct ShadePalette
+{
+    const color_t* palette;
+    ShadeColor shade;
+    color_t operator()(uint8_t index) const { return shade(palette[index]); }
+};
+
+// Texel fetches for the texture layouts (see Texture.hpp)
+template <typename Texel>
+struct LinearTexels
+{
+    const Texel* texels;
+    int width;
+    Texel operator()(int u, int v) const { return texels[u + v * width]; }
+};
+
+template <typename Texel>
+struct TiledTexels
+{
+    const Texel* texels;
+    int width;
+    Texel operator()(int u, int v) const { return texels[texture_tiled_index(u, v, width)]; }
+};
+
+// INDEX4 texels, always linear
+struct Index4Texels
+{
+    const uint8_t* texels;
+    int width;
+    uint8_t operator()(int u, int v) const
+    {
+        const int i = u + v * width;
+        return (texels[i >> 1] >> ((i & 1) << 2)) & 0xf;
+    }
+};
+
+// Textured span from x0 to x1 (inclusive). u, v and the per pixel steps
+// du, dv are texel coordinates in 16.16 fixed point.
+template <typename Fetch, typename Shader>
+static void texturedSpan(
+    int x0, int x1, int y,
+    int32_t u, int32_t v, int32_t du, int32_t dv,
+    Fetch fetch, int textureWidth, int textureHeight,
+    Shader shade
 ) {
-    if (v0.y > v1.y) swap(v0, v1);
-    if (v0.y > v2.y) swap(v0, v2);
-    if (v1.y > v2.y) swap(v1, v2);
+    color_t* pixel = &FRAMEBUFFER[y * SCREEN_X + x0];
+    for (int x = x0; x <= x1; x++, pixel++, u += du, v += dv) {
+        const int tu = u >> 16;
+        const int tv = v >> 16;
+        if (tu >= 0 && tu < textureWidth && tv >= 0 && tv < textureHeight)
+            *pixel = shade(fetch(tu, tv));
+    }
+}
 
-    int totalHeight = v2.y - v0.y;
+// Textured span with depth test
+template <typename Fetch, typename Shader>
+static void texturedSpan_depth(
+    int x0, int x1, int y,
+    int32_t u, int32_t v, int32_t z, const RasterGradients& grad,
+    Fetch fetch, int textureWidth, int textureHeight,
+    uint16_t *depthBuffer,
+    Shader shade
+) {
+    const int offset = y * SCREEN_X;
+    for (int x = x0; x <= x1; x++, u += grad.du, v += grad.dv, z += grad.dz) {
+        uint16_t& depth = depthBuffer[offset + x];
+        if ((z >> 8) > depth)
+            continue;
+        const int tu = u >> 16;
+        const int tv = v >> 16;
+        if (tu >= 0 && tu < textureWidth && tv >= 0 && tv < textureHeight) {
+            depth = z >> 8;
+            FRAMEBUFFER[offset + x] = shade(fetch(tu, tv));
+        }
+    }
+}
 
-    // If triangle happens to be just a line, lets avoid it completely
-    if (totalHeight == 0) return;
+#ifdef PC
+// RGB888 texture in linear layout (the PC default) goes through the vector
+// span kernels when the CPU has them (see PC_SpanKernels.hpp). Shorter
+// spans stay scalar, the vector setup costs more than it saves there
+// (--bench-simd).
+#define SPAN_KERNELS_MIN_COUNT 16
+static void texturedSpan(
+    int x0, int x1, int y,
+    int32_t u, int32_t v, int32_t du, int32_t dv,
+    LinearTexels<uint32_t> fetch, int textureWidth, int textureHeight,
+    ShadeRGB888 shade
+) {
+    const SpanKernels* kernels = span_kernels();
+    if (kernels == nullptr || x1 - x0 + 1 < SPAN_KERNELS_MIN_COUNT)
+        return texturedSpan<LinearTexels<uint32_t>, ShadeRGB888>(
+            x0, x1, y, u, v, du, dv, fetch, textureWidth, textureHeight, shade);
+    kernels->rgb888(&FRAMEBUFFER[y * SCREEN_X + x0], x1 - x0 + 1, u, v, du, dv,
+                    fetch.texels, textureWidth, textureHeight, shade.level);
+}
+
+static void texturedSpan(
+    int x0, int x1, int y,
+    int32_t u, int32_t v, int32_t du, int32_t dv,
+    LinearTexels<uint32_t> fetch, int textureWidth, int textureHeight,
+    UnlitRGB888 shade
+) {
+    const SpanKernels* kernels = span_kernels();
+    if (kernels == nullptr || x1 - x0 + 1 < SPAN_KERNELS_MIN_COUNT)
+        return texturedSpan<LinearTexels<uint32_t>, UnlitRGB888>(
+            x0, x1, y, u, v, du, dv, fetch, textureWidth, textureHeight, shade);
+    kernels->rgb888(&FRAMEBUFFER[y * SCREEN_X + x0], x1 - x0 + 1, u, v, du, dv,
+                    fetch.texels, textureWidth, textureHeight, LIGHT_LEVELS);
+}
+
+static void texturedSpan_depth(
+    int x0, int x1, int y,
+    int32_t u, int32_t v, int32_t z, const RasterGradients& grad,
+    LinearTexels<uint32_t> fetch, int textureWidth, int textureHeight,
+    uint16_t *depthBuffer,
+    ShadeRGB888 shade
+) {
+    const SpanKernels* kernels = span_kernels();
+    if (kernels == nullptr || x1 - x0 + 1 < SPAN_KERNELS_MIN_COUNT)
+        return texturedSpan_depth<LinearTexels<uint32_t>, ShadeRGB888>(
+            x0, x1, y, u, v, z, grad, fetch, textureWidth, textureHeight, depthBuffer, shade);
+    const int offset = y * SCREEN_X + x0;
+    kernels->rgb888_depth(&FRAMEBUFFER[offset], &depthBuffer[offset], x1 - x0 + 1,
+                          u, v, z, grad.du, grad.dv, grad.dz,
+                          fetch.texels, textureWidth, textureHeight, shade.level);
+}
+
+static void texturedSpan_depth(
+    int x0, int x1, int y,
+    int32_t u, int32_t v, int32_t z, const RasterGradients& grad,
+    LinearTexels<uint32_t> fetch, int textureWidth, int textureHeight,
+    uint16_t *depthBuffer,
+    UnlitRGB888 shade
+) {
+    const SpanKernels* kernels = span_kernels();
+    if (kernels == nullptr || x1 - x0 + 1 < SPAN_KERNELS_MIN_COUNT)
+        return texturedSpan_depth<LinearTexels<uint32_t>, UnlitRGB888>(
+            x0, x1, y, u, v, z, grad, fetch, textureWidth, textureHeight, depthBuffer, shade);
+    const int offset = y * SCREEN_X + x0;
+    kernels->rgb888_depth(&FRAMEBUFFER[offset], &depthBuffer[offset], x1 - x0 + 1,
+                          u, v, z, grad.du, grad.dv, grad.dz,
+                          fetch.texels, textureWidth, textureHeight, LIGHT_LEVELS);
+}
+#endif
+
+// Mip level for the triangle: the level where one pixel covers about one
+// texel. Affine texture mapping has the same texel/pixel area ratio over the
+// whole triangle, each level has 1/4 of the texel area of the previous.
+static unsigned texture_mip_level(
+    const Texture& texture,
+    const int16_t_Point2d& v0, const int16_t_Point2d& v1, const int16_t_Point2d& v2
+) {
+    int32_t screen_area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+    int32_t texel_area  = (v1.u - v0.u) * (v2.v - v0.v) - (v1.v - v0.v) * (v2.u - v0.u);
+    if (screen_area < 0) screen_area = -screen_area;
+    if (texel_area  < 0) texel_area  = -texel_area;
+    unsigned level = 0;
+    // Rounds to the nearest level (ratio above 2 is closer to the next one)
+    while (level + 1 < texture.levels && texel_area > 2 * screen_area) {
+        texel_area >>= 2;
+        level++;
+    }
+    return level < texture.first_level ? texture.first_level : level;
+}
+
+template <typename Fetch, typename Shader>
+static void texturedTriangle(
+    RasterTriangle& t, const TextureLevel& level, int shift, Fetch fetch,
+    uint16_t *depthBuffer, Shader shade
+) {
+    // Texture coordinates are in level 0 texels
+    const int w = level.width;
+    const int h = level.height;
+    RasterGradients grad = t.grad;
+    grad.du >>= shift;
+    grad.dv >>= shift;
+    if (depthBuffer) {
+        raster_walk(t, [&](int y, int x0, int x1, int skip, const RasterEdge& left) {
+            texturedSpan_depth(x0, x1, y,
+                               (left.u >> shift) + grad.du * skip, (left.v >> shift) + grad.dv * skip,
+                               left.z + grad.dz * skip, grad,
+                               fetch, w, h, depthBuffer, shade);
+        });
+    } else {
+        raster_walk(t, [&](int y, int x0, int x1, int skip, const RasterEdge& left) {
+            texturedSpan(x0, x1, y,
+                         (left.u >> shift) + grad.du * skip, (left.v >> shift) + grad.dv * skip,
+                         grad.du, grad.dv, fetch, w, h, shade);
+        });
+    }
+}
 
-    // Drawing the upper part of the triangle
-    for (int y = v0.y; y <= v1.y; y++) {
-        int segmentHeight = v1.y - v0.y + 1;
-        int alpha = ((y - v0.y) << 16) / totalHeight;
-        int beta = ((y - v0.y) << 16) / segmentHeight;
+template <typename Texel, typename Shader>
+static void texturedTriangle(
+    RasterTriangle& t, const TextureLevel& level, int shift,
+    uint16_t *depthBuffer, Shader shade
+) {
+    const Texel* texels = (const Texel*) level.pixels;
+    if (level.layout == TEXTURE_LAYOUT_TILED)
+        texturedTriangle(t, level, shift, TiledTexels<Texel>({texels, level.width}), depthBuffer, shade);
+    else
+        texturedTriangle(t, level, shift, LinearTexels<Texel>({texels, level.width}), depthBuffer, shade);
+}
+
+template <typename Shader>
+static void indexedTriangle(
+    RasterTriangle& t, const Texture& texture, const TextureLevel& level, int shift,
+    uint16_t *depthBuffer, Shader shade
+) {
+    if (texture.format == TEXTURE_FORMAT_INDEX4)
+        texturedTriangle(t, level, shift, Index4Texels({(const uint8_t*) level.pixels, level.width}), depthBuffer, shade);
+    else
+        texturedTriangle<uint8_t>(t, level, shift, depthBuffer, shade);
+}
 
-        int x0 = v0.x + ((v2.x - v0.x) * alpha >> 16);
-        int x1 = v0.x + ((v1.x - v0.x) * beta >> 16);
+// Indexed textures are lit by shading the palette once for the triangle,
+// unless the triangle covers fewer pixels than the palette has colors.
+static void indexedTriangle(
+    RasterTriangle& t, const Texture& texture, unsigned mip,
+    uint16_t *depthBuffer, int light
+) {
+    const TextureLevel& level = texture.level[mip];
+    const color_t* palette = texture.palette;
+    if (light == LIGHT_LEVELS)
+        return indexedTriangle(t, texture, level, mip, depthBuffer, PaletteColor({palette}));
 
-        int u0 = v0.u + ((v2.u - v0.u) * alpha >> 16);
-        int u1 = v0.u + ((v1.u - v0.u) * beta >> 16);
+    const ShadeColor shade = shade_color(light);
+    int32_t area2 = (t.v1.x - t.v0.x) * (t.v2.y - t.v0.y) - (t.v1.y - t.v0.y) * (t.v2.x - t.v0.x);
+    if (area2 < 0) area2 = -area2;
+    if ((uint32_t) area2 / 2 <= texture.palette_size)
+        return indexedTriangle(t, texture, level, mip, depthBuffer, ShadePalette({palette, shade}));
 
-        int v0_coord = v0.v + ((v2.v - v0.v) * alpha >> 16);
-        int v1_coord = v0.v + ((v1.v - v0.v) * beta >> 16);
+    color_t shaded[TEXTURE_PALETTE_MAX];
+    for (unsigned i = 0; i < texture.palette_size; i++)
+        shaded[i] = shade(palette[i]);
+    indexedTriangle(t, texture, level, mip, depthBuffer, PaletteColor({shaded}));
+}
 
-        drawHorizontalLine(x0, x1, y, u0, u1, v0_coord, v1_coord, texture, textureWidth, textureHeight, lightInstensity);
+// Picks the span loop for the texture format, layout and light level once
+// per triangle, so the loops themselves have no branches on any of them.
+static void texturedTriangle(
+    RasterTriangle& t, const Texture& texture, unsigned mip,
+    uint16_t *depthBuffer, Fix16 lightInstensity
+) {
+    const TextureLevel& level = texture.level[mip];
+    const int light = light_level(lightInstensity);
+    if (texture_format_indexed(texture.format)) {
+        indexedTriangle(t, texture, mip, depthBuffer, light);
+    } else if (texture.format == TEXTURE_FORMAT_RGB565) {
+        if (light == LIGHT_LEVELS)
+            texturedTriangle<uint16_t>(t, level, mip, depthBuffer, UnlitRGB565());
+        else
+            texturedTriangle<uint16_t>(t, level, mip, depthBuffer, ShadeRGB565({light_lut565[light]}));
+    } else {
+        if (light == LIGHT_LEVELS)
+            texturedTriangle<uint32_t>(t, level, mip, depthBuffer, UnlitRGB888());
+        else
+            texturedTriangle<uint32_t>(t, level, mip, depthBuffer, ShadeRGB888({light_lut[light], light}));
     }
+}
 
-    // Drawing the lower part of the triangle
-    for (int y = v1.y + 1; y <= v2.y; y++) {
-        int segmentHeight = v2.y - v1.y + 1;
-        int alpha = ((y - v0.y) << 16) / totalHeight;
-        int beta = ((y - v1.y) << 16) / segmentHeight;
+void drawTriangle(
+    int16_t_Point2d v0, int16_t_Point2d v1, int16_t_Point2d v2,
+    const Texture& texture,
+    Fix16 lightInstensity
+) {
+    const unsigned mip = texture_mip_level(texture, v0, v1, v2);
+    RasterTriangle t;
+    if (!raster_setup(t, v0, v1, v2, true, false))
+        return;
+    texturedTriangle(t, texture, mip, nullptr, lightInstensity);
+}
+
+void drawTriangle_depth(
+    int16_t_Point2d v0, int16_t_Point2d v1, int16_t_Point2d v2,
+    const Texture& texture,
+    uint16_t *depthBuffer,
+    Fix16 lightInstensity
+) {
+    const unsigned mip = texture_mip_level(texture, v0, v1, v2);
+    RasterTriangle t;
+    if (!raster_setup(t, v0, v1, v2, true, true))
+        return;
+    texturedTriangle(t, texture, mip, depthBuffer, lightInstensity);
+}
 
-        int x0 = v0.x + ((v2.x - v0.x) * alpha >> 16);
-        int x1 = v1.x + ((v2.x - v1.x) * beta >> 16);
+// Flat colored span with depth test, z in 24.8
+static void fillSpan_depth(int x0, int x1, int y, int32_t z, int32_t dz, color_t c, uint16_t *depthBuffer)
+{
+    const int offset = y * SCREEN_X;
+    for (int x = x0; x <= x1; x++, z += dz) {
+        uint16_t& depth = depthBuffer[offset + x];
+        if ((z >> 8) <= depth) {
+            depth = z >> 8;
+            FRAMEBUFFER[offset + x] = c;
+        }
+    }
+}
 
-        int u0 = v0.u + ((v2.u - v0.u) * alpha >> 16);
-        int u1 = v1.u + ((v2.u - v1.u) * beta >> 16);
+void line_depth(int16_t_Point2d a, int16_t_Point2d b, color_t c, uint16_t *depthBuffer)
+{
+    int dx = b.x > a.x ? b.x - a.x : a.x - b.x;
+    int dy = b.y > a.y ? b.y - a.y : a.y - b.y;
+    int ix = b.x > a.x ? 1 : -1;
+    int iy = b.y > a.y ? 1 : -1;
+    int steps = dx > dy ? dx : dy;
+    int err = dx - dy;
+    int x = a.x, y = a.y;
+    const ScreenRect clip = raster_clip();
+    for (int i = 0; i <= steps; i++) {
+        if (x >= clip.x0 && x < clip.x1 && y >= clip.y0 && y < clip.y1) {
+            int z = a.z + (steps ? ((b.z - a.z) * i) / steps : 0);
+            // Small bias so edges win over the face they belong to
+            if (z <= depthBuffer[y * SCREEN_X + x] + 1)
+                FRAMEBUFFER[y * SCREEN_X + x] = c;
+        }
+        int e2 = 2 * err;
+        if (e2 > -dy) { err -= dy; x += ix; }
+        if (e2 <  dx) { err += dx; y += iy; }
+    }
+}
 
-        int v0_coord = v0.v + ((v2.v - v0.v) * alpha >> 16);
-        int v1_coord = v1.v + ((v2.v - v1.v) * beta >> 16);
+void triangle_depth(
+    int16_t_Point2d v0, int16_t_Point2d v1, int16_t_Point2d v2,
+    color_t colorFill, color_t colorLine,
+    uint16_t *depthBuffer
+) {
+    RasterTriangle t;
+    if (raster_setup(t, v0, v1, v2, false, true)) {
+        const int32_t dz = t.grad.dz;
+        raster_walk(t, [&](int y, int x0, int x1, int skip, const RasterEdge& left) {
+            fillSpan_depth(x0, x1, y, left.z + dz * skip, dz, colorFill, depthBuffer);
+        });
+    }
+    line_depth(v0, v1, colorLine, depthBuffer);
+    line_depth(v1, v2, colorLine, depthBuffer);
+    line_depth(v2, v0, colorLine, depthBuffer);
+}
 
-        drawHorizontalLine(x0, x1, y, u0, u1, v0_coord, v1_coord, texture, textureWidth, textureHeight, lightInstensity);
+void clear_depth_buffer(uint16_t *depthBuffer, int16_t_vec2 min, int16_t_vec2 max)
+{
+    for (int y = min.y; y < max.y; y++) {
+        uint16_t* row = depthBuffer + y * SCREEN_X;
+        for (int x = min.x; x < max.x; x++)
+            row[x] = DEPTH_BUFFER_FAR;
     }
 }
 
@@ -170,4 +664,11 @@ void draw_RotationVisualizer(fix16_vec2 camera_rot)
     line(((int16_t) p_x.x)+offset_x,((int16_t) p_x.y)+offset_y, offset_x, offset_y, color(255,0,0));
     line(((int16_t) p_y.x)+offset_x,((int16_t) p_y.y)+offset_y, offset_x, offset_y, color(0,255,0));
     line(((int16_t) p_z.x)+offset_x,((int16_t) p_z.y)+offset_y, offset_x, offset_y, color(0,0,255));
+}
+
+ScreenRect rotationVisualizerRect()
+{
+    // Lines reach LINE_WIDTH around the center, which is EDGE_OFFSET + LINE_WIDTH from the corner
+    const int16_t size = (int16_t) ROTATION_VISUALIZER_LINE_WIDTH * 2 + ROTATION_VISALIZER_EDGE_OFFSET;
+    return {(int16_t)(SCREEN_X - size), 0, SCREEN_X, (int16_t)(size + 1)};
 }
\ No newline at end of file
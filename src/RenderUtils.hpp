@@ -5,23 +5,84 @@
 // TODO: Only needed for structs fix16_vec3. Move these somewhere else...
 #include "RenderFP3D.hpp"
 
+#include "Texture.hpp"
+
 // color_t
 #include "Renderer.hpp"
 
-Fix16 calculateLightIntensity(const fix16_vec3& lightPos, const fix16_vec3& surfacePos, const fix16_vec3& normal, Fix16 lightIntensity);
+#include "constants.hpp"
 
-void drawHorizontalLine(
-    int x0, int x1, int y,
-    int u0, int u1, int v0, int v1,
-    uint32_t *texture, int textureWidth, int textureHeight,
-    Fix16 lightInstensity = 1.0f
-);
+// Raw framebuffer for unchecked pixel writes
+#ifdef PC
+    extern uint32_t * screenPixels;
+#   define FRAMEBUFFER screenPixels
+#else
+#   define FRAMEBUFFER vram
+#endif
+
+// Depth buffer holds camera z as unsigned 8.8 fixed point (0 - 256 units).
+// Farther than that is clamped to DEPTH_BUFFER_FAR-1, DEPTH_BUFFER_FAR means empty.
+#define DEPTH_BUFFER_SHIFT 8
+#define DEPTH_BUFFER_FAR   0xffff
+
+inline uint16_t depth_to_uint16(Fix16 z)
+{
+    int32_t d = z.value >> DEPTH_BUFFER_SHIFT;
+    if (d < 0) d = 0;
+    if (d > DEPTH_BUFFER_FAR-1) d = DEPTH_BUFFER_FAR-1;
+    return (uint16_t) d;
+}
+
+// Light intensity range 1.0f - MIN_LIGHT_INTENSITY
+// It looks much better if colors wont go to full black
+#define MIN_LIGHT_INTENSITY 0.10f
+
+// Light of a surface, lightDir and normal unit vectors in the same space
+// (lightDir points towards the light)
+inline Fix16 calculateLightIntensity(const fix16_vec3& lightDir, const fix16_vec3& normal, Fix16 lightIntensity)
+{
+    // Intensity from 0.0f -> 1.0f
+    Fix16 intensity = lightIntensity * fix16_max(0, lightDir.x * normal.x + lightDir.y * normal.y + lightDir.z * normal.z);
+    // Ensure intensity is at least minIntensity
+    return fix16_max(intensity, Fix16(MIN_LIGHT_INTENSITY));
+}
+
+// Triangle drawing writes the framebuffer unchecked: all points must be on
+// the screen (see Clipping.hpp). On PC drawing is limited to clipRect.
 
+// Builds the lighting tables of the textured triangles. Done on the first
+// lit triangle, drawing from several threads needs it done before.
+void init_light_tables();
+
+// Textured triangle. Texture formats are described in Texture.hpp,
+// lighting is quantized to 33 levels (0.0f - 1.0f). Samples the mip level
+// matching the triangle's screen size.
 void drawTriangle(
     int16_t_Point2d v0, int16_t_Point2d v1, int16_t_Point2d v2,
-    uint32_t *texture, int textureWidth, int textureHeight,
+    const Texture& texture,
+    Fix16 lightInstensity = 1.0f
+);
+// Depth tested versions of drawTriangle and triangle. Pixels are only drawn
+// when closer (or equal) than depthBuffer (SCREEN_X*SCREEN_Y) and the depth
+// buffer is updated. z of the points must be set with depth_to_uint16.
+void drawTriangle_depth(
+    int16_t_Point2d v0, int16_t_Point2d v1, int16_t_Point2d v2,
+    const Texture& texture,
+    uint16_t *depthBuffer,
     Fix16 lightInstensity = 1.0f
 );
+void triangle_depth(
+    int16_t_Point2d v0, int16_t_Point2d v1, int16_t_Point2d v2,
+    color_t colorFill, color_t colorLine,
+    uint16_t *depthBuffer
+);
+// Bresenham line with depth test, depth buffer itself is not written
+void line_depth(int16_t_Point2d a, int16_t_Point2d b, color_t c, uint16_t *depthBuffer);
+// Sets depth buffer region [min, max) to DEPTH_BUFFER_FAR
+void clear_depth_buffer(uint16_t *depthBuffer, int16_t_vec2 min, int16_t_vec2 max);
+
 void draw_center_square(int16_t cx, int16_t cy, int16_t sx, int16_t sy, color_t color);
 
-void draw_RotationVisualizer(fix16_vec2 camera_rot);
\ No newline at end of file
+void draw_RotationVisualizer(fix16_vec2 camera_rot);
+// Screen area draw_RotationVisualizer draws into
+ScreenRect rotationVisualizerRect();
\ No newline at end of file
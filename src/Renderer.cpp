@@ -10,12 +10,15 @@
 
 #include "RenderUtils.hpp"
 
+#include "DepthSort.hpp"
+
 #ifndef PC
 #   include <sdk/os/lcd.hpp>
 #   include <sdk/calc/calc.hpp>
 #   include <sdk/os/input.hpp>
 #else
 #   include "PC_SDL_screen.hpp" // replaces "sdk/os/lcd.hpp"
+#   include "TileRenderer.hpp"
 #endif
 
 Renderer::Renderer()
@@ -24,6 +27,13 @@ Renderer::Renderer()
     FOV(300.0f),
     lightPos({0.0f, 0.0f, 0.0f}),
     lastLightScreenLocation({0, 0}),
+    stats(),
+    depthBuffer(nullptr),
+    depthDirtyMin({0, 0}),
+    depthDirtyMax({0, 0}),
+#ifdef PC
+    tileRenderer(nullptr),
+#endif
     camera_move_dirty(true)
 {
 
@@ -35,6 +45,249 @@ Renderer::~Renderer()
     for(unsigned int i=0; i<modelArray.getSize(); i++){
         delete modelArray[i].first;
     }
+    if (depthBuffer != nullptr)
+        free(depthBuffer);
+#ifdef PC
+    delete tileRenderer;
+#endif
+}
+
+bool Renderer::setDepthBufferEnabled(bool enabled)
+{
+    if (enabled == (depthBuffer != nullptr))
+        return true;
+    if (!enabled){
+        free(depthBuffer);
+        depthBuffer = nullptr;
+        // Painter's algorithm needs the model order again
+        camera_move_dirty = true;
+        return true;
+    }
+    depthBuffer = (uint16_t*) malloc(sizeof(uint16_t) * SCREEN_X * SCREEN_Y);
+    if (depthBuffer == nullptr)
+        return false;
+    depthDirtyMin = {0, 0};
+    depthDirtyMax = {SCREEN_X, SCREEN_Y};
+    return true;
+}
+
+bool Renderer::isDepthBufferEnabled()
+{
+    return depthBuffer != nullptr;
+}
+
+#ifdef PC
+void Renderer::setThreadCount(unsigned threads)
+{
+    delete tileRenderer;
+    tileRenderer = threads > 0 ? new TileRenderer(threads) : nullptr;
+}
+
+unsigned Renderer::getThreadCount()
+{
+    return tileRenderer != nullptr ? tileRenderer->getThreadCount() : 0;
+}
+#endif
+
+// Screen coordinates and depths of the face corners. Only valid when all
+// corners are inside the frustum.
+static inline void face_corners(const ModelFrame& mf, const u_triple& face, int16_t_Point2d p[3])
+{
+    const unsigned ids[3] = {face.First, face.Second, face.Third};
+    for (int i=0; i<3; i++){
+        p[i].x = mf.screen_coords[ids[i]].x;
+        p[i].y = mf.screen_coords[ids[i]].y;
+        p[i].z = depth_to_uint16(mf.vert_z_depths[ids[i]]);
+    }
+}
+
+// Texture coordinates of the face corners in texels
+static inline void face_texcoords(const Model* m, unsigned f_id, int16_t_Point2d p[3])
+{
+    const u_triple uv_face = mesh_uv_face(*m->mesh, f_id);
+    const unsigned ids[3] = {uv_face.First, uv_face.Second, uv_face.Third};
+    for (int i=0; i<3; i++){
+        auto uv_fix16_norm = mesh_uv(*m->mesh, ids[i]);
+        p[i].u = (int16_t) (uv_fix16_norm.x * (Fix16((int16_t)m->texture->width)));
+        p[i].v = (int16_t) (uv_fix16_norm.y * (Fix16((int16_t)m->texture->height)));
+    }
+}
+
+static inline bool face_crosses_frustum(const ModelFrame& mf, const u_triple& face)
+{
+    return (mf.clip_codes[face.First] | mf.clip_codes[face.Second] | mf.clip_codes[face.Third]) != 0;
+}
+
+unsigned Renderer::clip_face(
+    const ModelFrame& mf, unsigned f_id, const int16_t_Point2d corners[3], bool cull,
+    int16_t_Point2d out[], bool edges[]
+) {
+    const u_triple face = mesh_face(*mf.model->mesh, f_id);
+    const unsigned ids[3] = {face.First, face.Second, face.Third};
+    ClipVertex in[3];
+    uint8_t codes[3];
+    for (int i=0; i<3; i++){
+        // Near plane vertices were never projected, camera space is needed anyway
+        in[i].p = transformPoint(mf.vertex_to_camera, mesh_stored_vertex(*mf.model->mesh, ids[i]));
+        in[i].u = Fix16(corners[i].u);
+        in[i].v = Fix16(corners[i].v);
+        codes[i] = mf.clip_codes[ids[i]];
+    }
+    stats.faces_clipped++;
+    unsigned n = clip_triangle(frustum, in, codes, out, edges);
+    if (n == 0)
+        return 0;
+
+    if (cull && mf.model->backface_culling){
+        // Same winding rule as face_winding, polygon area
+        int32_t area = 0;
+        for (unsigned i=0; i<n; i++){
+            const int16_t_Point2d& a = out[i];
+            const int16_t_Point2d& b = out[(i+1) % n];
+            area += (int32_t)a.x * b.y - (int32_t)b.x * a.y;
+        }
+        if (area >= 0){
+            stats.faces_culled++;
+            stats.faces_visible--;
+            return 0;
+        }
+    }
+
+    // Check bbox
+    for (unsigned i=0; i<n; i++){
+        if (mf.bbox_max->x < out[i].x) mf.bbox_max->x = out[i].x;
+        if (mf.bbox_max->y < out[i].y) mf.bbox_max->y = out[i].y;
+        if (mf.bbox_min->x > out[i].x) mf.bbox_min->x = out[i].x;
+        if (mf.bbox_min->y > out[i].y) mf.bbox_min->y = out[i].y;
+    }
+    return n;
+}
+
+#ifdef PC
+#   define TILE_RECORDING (tileRenderer != nullptr && tileRenderer->isRecording())
+#endif
+
+void Renderer::draw_textured_triangle(
+    const int16_t_Point2d& v0, const int16_t_Point2d& v1, const int16_t_Point2d& v2,
+    Model* m, Fix16 light
+) {
+#ifdef PC
+    if (TILE_RECORDING){
+        tileRenderer->drawTriangle(v0, v1, v2, *m->texture, depthBuffer, light);
+        return;
+    }
+#endif
+    if (depthBuffer != nullptr)
+        drawTriangle_depth(
+            v0, v1, v2,
+            *m->texture,
+            depthBuffer, light
+        );
+    else
+        drawTriangle(
+            v0, v1, v2,
+            *m->texture,
+            light
+        );
+}
+
+void Renderer::draw_triangle(
+    const int16_t_Point2d& v0, const int16_t_Point2d& v1, const int16_t_Point2d& v2,
+    color_t colorFill, color_t colorLine
+) {
+#ifdef PC
+    if (TILE_RECORDING){
+        tileRenderer->triangle(v0, v1, v2, colorFill, colorLine, depthBuffer);
+        return;
+    }
+#endif
+    if (depthBuffer == nullptr)
+        triangle(v0.x,v0.y, v1.x,v1.y, v2.x,v2.y, colorFill, colorLine);
+    else
+        triangle_depth(v0, v1, v2, colorFill, colorLine, depthBuffer);
+}
+
+void Renderer::draw_line(const int16_t_Point2d& a, const int16_t_Point2d& b, color_t color, bool depthTest)
+{
+#ifdef PC
+    if (TILE_RECORDING){
+        tileRenderer->line(a, b, color, depthTest ? depthBuffer : nullptr);
+        return;
+    }
+#endif
+    if (!depthTest || depthBuffer == nullptr)
+        line(a.x,a.y, b.x,b.y, color);
+    else
+        line_depth(a, b, color, depthBuffer);
+}
+
+void Renderer::draw_square(int16_t cx, int16_t cy, int16_t sx, int16_t sy, color_t color)
+{
+#ifdef PC
+    if (TILE_RECORDING){
+        tileRenderer->draw_center_square(cx, cy, sx, sy, color);
+        return;
+    }
+#endif
+    draw_center_square(cx, cy, sx, sy, color);
+}
+
+void Renderer::draw_textured_face(const ModelFrame& mf, unsigned f_id, Fix16 light)
+{
+    const u_triple face = mesh_face(*mf.model->mesh, f_id);
+    int16_t_Point2d p[3];
+    face_texcoords(mf.model, f_id, p);
+    if (!face_crosses_frustum(mf, face)){
+        face_corners(mf, face, p);
+        draw_textured_triangle(p[0], p[1], p[2], mf.model, light);
+        return;
+    }
+    int16_t_Point2d poly[CLIP_MAX_VERTICES];
+    bool edges[CLIP_MAX_VERTICES];
+    unsigned n = clip_face(mf, f_id, p, true, poly, edges);
+    for (unsigned i=2; i<n; i++)
+        draw_textured_triangle(poly[0], poly[i-1], poly[i], mf.model, light);
+}
+
+void Renderer::draw_flat_face(const ModelFrame& mf, unsigned f_id, color_t colorFill, color_t colorLine)
+{
+    const u_triple face = mesh_face(*mf.model->mesh, f_id);
+    int16_t_Point2d p[3] = {};
+    if (!face_crosses_frustum(mf, face)){
+        face_corners(mf, face, p);
+        draw_triangle(p[0], p[1], p[2], colorFill, colorLine);
+        return;
+    }
+    int16_t_Point2d poly[CLIP_MAX_VERTICES];
+    bool edges[CLIP_MAX_VERTICES];
+    unsigned n = clip_face(mf, f_id, p, true, poly, edges);
+    // Fill the fan without its inner edges, then outline the original edges
+    for (unsigned i=2; i<n; i++)
+        draw_triangle(poly[0], poly[i-1], poly[i], colorFill, colorFill);
+    for (unsigned i=0; i<n; i++){
+        if (edges[i])
+            draw_line(poly[i], poly[(i+1) % n], colorLine, true);
+    }
+}
+
+void Renderer::draw_wire_face(const ModelFrame& mf, unsigned f_id, color_t colorLine)
+{
+    const u_triple face = mesh_face(*mf.model->mesh, f_id);
+    int16_t_Point2d p[3] = {};
+    if (!face_crosses_frustum(mf, face)){
+        face_corners(mf, face, p);
+        draw_line(p[0], p[1], colorLine, false);
+        draw_line(p[1], p[2], colorLine, false);
+        draw_line(p[2], p[0], colorLine, false);
+        return;
+    }
+    int16_t_Point2d poly[CLIP_MAX_VERTICES];
+    bool edges[CLIP_MAX_VERTICES];
+    unsigned n = clip_face(mf, f_id, p, false, poly, edges);
+    for (unsigned i=0; i<n; i++){
+        if (edges[i])
+            draw_line(poly[i], poly[(i+1) % n], colorLine, false);
+    }
 }
 
 DynamicArray<Pair<Model*, Fix16>>& Renderer::getModelArray()
@@ -42,16 +295,45 @@ DynamicArray<Pair<Model*, Fix16>>& Renderer::getModelArray()
     return modelArray;
 }
 
+AssetCache& Renderer::getAssetCache()
+{
+    return assets;
+}
+
 // If model has no texture, set it as NO_TEXTURE
-Model* Renderer::addModel(char* model_path, char* texture_path, bool centerVertices)
+Model* Renderer::addModel(char* model_path, char* texture_path, bool centerVertices, int textureMaxSize)
+{
+    return addModel(new Model(assets, model_path, texture_path, centerVertices, textureMaxSize));
+}
+
+Model* Renderer::addModel(const AssetBundle& bundle, char* mesh_name, char* texture_name, bool centerVertices, int textureMaxSize)
+{
+    return addModel(new Model(assets, mesh_name, texture_name, centerVertices, textureMaxSize, &bundle));
+}
+
+Model* Renderer::addModel(Model* m)
 {
-    // Create new object
-    auto m = new Model(model_path, texture_path, centerVertices);
+    if (m->mesh == nullptr){
+        delete m;
+        return nullptr;
+    }
     modelArray.push_back({m, 0.0f});
+    // Frame arena must fit the scratch buffers of the largest model
+    frameArena.reserve(frameBytesForModel(m));
     // Return pointer back for reference
     return m;
 }
 
+unsigned Renderer::frameBytesForModel(Model* m)
+{
+    return FrameArena::bytes_for<uint_fix16_t>(m->mesh->faces_count);   // sort_tmp
+}
+
+const FrameArena& Renderer::getFrameArena()
+{
+    return frameArena;
+}
+
 unsigned int Renderer::getModelCount()
 {
     return modelArray.getSize();
@@ -69,14 +351,98 @@ Fix16& Renderer::get_FOV(){
 fix16_vec3& Renderer::get_lightPos(){
     return lightPos;
 }
+const RenderStats& Renderer::get_stats(){
+    return stats;
+}
 
 inline void sort_modelRenderOrder(Pair<Model*, Fix16> a[], int n)
 {
-    // Bubble sort
-    for (int j = n; j > 1; --j)
-        for (int i = 1; i < j; ++i)
-            if (a[i - 1].second < a[i].second)
-                swap(a[i - 1], a[i]);
+    // modelArray keeps its order between frames -> almost sorted already
+    insertion_sort_depth(a, n, n * n);
+}
+
+static inline bool same_transform(const fix16_mat3x4& a, const fix16_mat3x4& b)
+{
+    for (int r=0; r<3; r++){
+        for (int c=0; c<4; c++){
+            if (a.m[r][c] != b.m[r][c])
+                return false;
+        }
+    }
+    return true;
+}
+
+// Fills depth keys of the model's persistent face_draw_order. Last frame's
+// order is kept, so the sort only has to fix the faces that moved.
+static void update_face_depths(Model* m, const Fix16* vert_z_depths, unsigned n)
+{
+    for (unsigned i=0; i<n; i++){
+        const u_triple f = mesh_face(*m->mesh, m->face_draw_order[i].uint);
+        // Sum instead of average: same order, no divisions
+        m->face_draw_order[i].fix16 =
+            vert_z_depths[f.First] + vert_z_depths[f.Second] + vert_z_depths[f.Third];
+    }
+}
+
+// Twice the signed screen space area of the face. Front faces are counter
+// clockwise on screen (y grows down) and have negative area.
+static inline int32_t face_winding(int16_t_vec2 v0, int16_t_vec2 v1, int16_t_vec2 v2)
+{
+    return (int32_t)(v1.x - v0.x) * (v2.y - v0.y) - (int32_t)(v1.y - v0.y) * (v2.x - v0.x);
+}
+
+// Moves the faces that need drawing to the front of the model's face_draw_order
+// (keeping last frame's relative order for the sort). Faces completely outside
+// of the frustum and, if enabled, back faces are moved behind them. Faces
+// crossing the frustum are kept, their winding is checked after clipping.
+// tmp must hold faces_count items. Returns the number of faces to draw.
+static unsigned cull_faces(const ModelFrame& mf, uint_fix16_t* tmp, unsigned* culled)
+{
+    Model* m = mf.model;
+    unsigned visible = 0;
+    unsigned dropped = 0;
+    for (unsigned i=0; i<m->mesh->faces_count; i++){
+        const u_triple f = mesh_face(*m->mesh, m->face_draw_order[i].uint);
+        const uint8_t c0 = mf.clip_codes[f.First];
+        const uint8_t c1 = mf.clip_codes[f.Second];
+        const uint8_t c2 = mf.clip_codes[f.Third];
+        // All corners outside of the same plane
+        bool draw = (c0 & c1 & c2) == 0;
+        if (draw && m->backface_culling && (c0 | c1 | c2) == 0 &&
+            face_winding(mf.screen_coords[f.First], mf.screen_coords[f.Second], mf.screen_coords[f.Third]) >= 0
+        ){
+            draw = false;
+            (*culled)++;
+        }
+        if (draw)
+            m->face_draw_order[visible++] = m->face_draw_order[i];
+        else
+            tmp[dropped++] = m->face_draw_order[i];
+    }
+    for (unsigned i=0; i<dropped; i++)
+        m->face_draw_order[visible + i] = tmp[i];
+    return visible;
+}
+
+// Direction from the model towards the light in model space (unit vector).
+// Face normals are in model space, so lighting a face is a dot product. The
+// light counts as directional over the model, seen from the model origin.
+static fix16_vec3 model_light_direction(const Model* m, const fix16_vec3& lightPos)
+{
+    const fix16_mat3x4 model_to_world = buildTransformMatrix(
+        m->position, m->rotation,
+        {1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f}
+    );
+    const fix16_vec3 d = {lightPos.x - m->position.x, lightPos.y - m->position.y, lightPos.z - m->position.z};
+    // Inverse of the rotation is its transpose
+    fix16_vec3 dir = {
+        model_to_world.m[0][0]*d.x + model_to_world.m[1][0]*d.y + model_to_world.m[2][0]*d.z,
+        model_to_world.m[0][1]*d.x + model_to_world.m[1][1]*d.y + model_to_world.m[2][1]*d.z,
+        model_to_world.m[0][2]*d.x + model_to_world.m[1][2]*d.y + model_to_world.m[2][2]*d.z
+    };
+    if (dir.x != 0.0f || dir.y != 0.0f || dir.z != 0.0f)
+        normalize_fix16_vec3(dir);
+    return dir;
 }
 
 void Renderer::draw_LightLocation()
@@ -92,7 +458,7 @@ void Renderer::draw_LightLocation()
     );
     int16_t x = (int16_t)screen_vec2.x;
     int16_t y = (int16_t)screen_vec2.y;
-    draw_center_square(x, y, 9,9, color(238,210,2));
+    draw_square(x, y, LIGHT_LOCATION_SIZE,LIGHT_LOCATION_SIZE, color(238,210,2));
     lastLightScreenLocation.x = x;
     lastLightScreenLocation.y = y;
 }
@@ -101,19 +467,170 @@ void Renderer::clear_LightLocation(color_t clearColor)
 {
     int16_t x = lastLightScreenLocation.x;
     int16_t y = lastLightScreenLocation.y;
-    draw_center_square(x, y, 9,9, clearColor);
+    draw_center_square(x, y, LIGHT_LOCATION_SIZE,LIGHT_LOCATION_SIZE, clearColor);
 }
 
+ScreenRect Renderer::get_LightLocationRect()
+{
+    // Same pixels as draw_center_square
+    const int16_t half = LIGHT_LOCATION_SIZE/2;
+    return {
+        (int16_t)(lastLightScreenLocation.x - half), (int16_t)(lastLightScreenLocation.y - half),
+        (int16_t)(lastLightScreenLocation.x + half), (int16_t)(lastLightScreenLocation.y + half)
+    };
+}
+
+// Fill color of face f_id, ordered_id-th face drawn
+template<FlatColor Color>
+static inline color_t flat_color(const Model* m, unsigned f_id, unsigned ordered_id, Fix16 light)
+{
+    if (Color == FLAT_COLOR_LIGHT){
+        const int16_t gray = (int16_t)(light*255.0f);
+        return color(gray, gray, gray);
+    }
+    if (Color == FLAT_COLOR_DRAW_ORDER){
+        uint32_t colorr = 0xff << (ordered_id*(24)/m->mesh->faces_count);
+        return color((colorr>>16)&0xcf, (colorr>>8)&0xcf, (colorr>>0)&0xcf);
+    }
+    return color( 255,(f_id*8)%255,(f_id*16)%255 );
+}
+
+template<bool Textured, bool Lit, bool Filled, bool Wire, FlatColor Color>
+void Renderer::draw_model(const ModelFrame& mf)
+{
+    Model* m = mf.model;
+    const Mesh* mesh = m->mesh;
+
+    // Nothing to draw of the faces: vertices as points
+    if (!Textured && !Filled && !Wire){
+        for (unsigned v_id=0; v_id<mesh->vertex_count; v_id++){
+            if(mf.clip_codes[v_id] != 0)
+                continue;
+            int16_t x = mf.screen_coords[v_id].x;
+            int16_t y = mf.screen_coords[v_id].y;
+            draw_square(x,y,5,5, color(0,0,0));
+            // Check bbox
+            if (mf.bbox_max->x < x+2) mf.bbox_max->x = x+2;
+            if (mf.bbox_max->y < y+2) mf.bbox_max->y = y+2;
+            if (mf.bbox_min->x > x-2) mf.bbox_min->x = x-2;
+            if (mf.bbox_min->y > y-2) mf.bbox_min->y = y-2;
+        }
+        return;
+    }
+
+    // Surfaces are drawn back to front, except for the face index colors
+    // which show the model's own face order. Wireframe has no surfaces.
+    const bool sorted = Textured || (Filled && Color != FLAT_COLOR_FACE_ID);
+
+    fix16_vec3 lightDir = {0.0f, 0.0f, 0.0f};
+    if (Lit)
+        lightDir = model_light_direction(m, lightPos);
+
+    uint_fix16_t * face_draw_order = m->face_draw_order;
+    unsigned face_count = mesh->faces_count;
+    if (sorted){
+        // Culling and sorting are kept with the vertex transform, redone
+        // only when the transform changed
+        ModelTransformCache& cache = m->transform_cache;
+        if (cache.faces_backface_culling != m->backface_culling)
+            cache.faces = ModelTransformCache::FACES_STALE;
+        uint_fix16_t * sort_tmp = frameArena.alloc_array<uint_fix16_t>(mesh->faces_count);
+        if (sort_tmp == nullptr && mesh->faces_count > 0){
+            stats.models_skipped++;
+            return;
+        }
+
+        // Faces outside of the frustum and back faces out of the way
+        if (cache.faces == ModelTransformCache::FACES_STALE){
+            cache.faces_culled = 0;
+            cache.faces_visible = cull_faces(mf, sort_tmp, &cache.faces_culled);
+            cache.faces_backface_culling = m->backface_culling;
+            cache.faces = ModelTransformCache::FACES_CULLED;
+        }
+        face_count = cache.faces_visible;
+        stats.faces_culled += cache.faces_culled;
+        stats.faces_visible += face_count;
+
+        // Depth buffer makes the draw order irrelevant
+        if (depthBuffer == nullptr && cache.faces != ModelTransformCache::FACES_SORTED){
+            // Depth of every visible face, kept in last frame's order
+            update_face_depths(m, mf.vert_z_depths, face_count);
+            // Sorting
+            sort_depth(face_draw_order, sort_tmp, face_count);
+            cache.faces = ModelTransformCache::FACES_SORTED;
+        }
+    }
+
+    // Draw faces
+    for (unsigned ordered_id=0; ordered_id<face_count; ordered_id++)
+    {
+        const unsigned f_id = sorted ? face_draw_order[ordered_id].uint : ordered_id;
+        if (!sorted){
+            const u_triple face = mesh_face(*mesh, f_id);
+            const uint8_t c0 = mf.clip_codes[face.First];
+            const uint8_t c1 = mf.clip_codes[face.Second];
+            const uint8_t c2 = mf.clip_codes[face.Third];
+            if ((c0 & c1 & c2) != 0)
+                continue;
+            // Wireframe shows the back faces too
+            if (Filled){
+                if (m->backface_culling && (c0 | c1 | c2) == 0 &&
+                    face_winding(mf.screen_coords[face.First], mf.screen_coords[face.Second], mf.screen_coords[face.Third]) >= 0
+                ){
+                    stats.faces_culled++;
+                    continue;
+                }
+                stats.faces_visible++;
+            }
+        }
+
+        Fix16 lightIntensity = 1.0f;
+        if (Lit)
+            lightIntensity = calculateLightIntensity(lightDir, mesh_face_normal(*mesh, f_id), Fix16(1.0f));
+
+        stats.faces_drawn++;
+        if (Textured)
+            draw_textured_face(mf, f_id, lightIntensity);
+        else if (Filled){
+            const color_t fill = flat_color<Color>(m, f_id, ordered_id, lightIntensity);
+            draw_flat_face(mf, f_id, fill, Wire ? color(0,0,0) : fill);
+        }
+        else
+            draw_wire_face(mf, f_id, color(0,0,0));
+    }
+
+    // Draw sun visualizer
+    if (Lit)
+        draw_LightLocation();
+}
+
+const Renderer::DrawModelFn Renderer::drawModelTable[RENDER_MODE_COUNT] = {
+    //                   Textured Lit    Filled Wire
+    &Renderer::draw_model<false,  false, false, false, FLAT_COLOR_NONE>,        // 0: Vertices
+    &Renderer::draw_model<true,   false, false, false, FLAT_COLOR_NONE>,        // 1: Texture
+    &Renderer::draw_model<false,  true,  true,  true,  FLAT_COLOR_LIGHT>,       // 2: Flat shaded
+    &Renderer::draw_model<false,  false, true,  true,  FLAT_COLOR_DRAW_ORDER>,  // 3: Draw order colors
+    &Renderer::draw_model<false,  false, true,  true,  FLAT_COLOR_FACE_ID>,     // 4: Face index colors
+    &Renderer::draw_model<false,  false, false, true,  FLAT_COLOR_NONE>,        // 5: Wireframe
+    &Renderer::draw_model<true,   true,  false, false, FLAT_COLOR_NONE>,        // 6: Lit texture
+};
+
 void Renderer::update(
     int16_t_vec2* bbox_max,
     int16_t_vec2* bbox_min
 ) {
-    // TODO: Different RENDER_MODEs have a lot in common and could therefore be
-    //       combined for cleaner code. BUT cleaner code does not mean faster code here
-    //       as we would want to avoid doing bunch of if checks if possible.
-    //       -> Too lazy right now to figure this out..
+    stats = RenderStats();
+
+    // Release all scratch buffers of the previous frame
+    const unsigned heap_allocations_start = frameArena.getHeapAllocations();
+    frameArena.reset();
 
-    if (camera_move_dirty)
+    // Only the area drawn last frame can hold depth values
+    if (depthBuffer != nullptr)
+        clear_depth_buffer(depthBuffer, depthDirtyMin, depthDirtyMax);
+
+    // Model order does not matter with depth buffer
+    if (camera_move_dirty && depthBuffer == nullptr)
     {
         camera_move_dirty = false;
         // Sort all models in order from camera. A cheap way to have alteast
@@ -131,570 +648,85 @@ void Renderer::update(
         sort_modelRenderOrder(modelArray.getRawArray(), modelArray.getSize());
     }
 
-    bool is_valid;
-    for (unsigned m_id=0; m_id<getModelCount(); m_id++)
-    {
-        auto RENDER_MODE = modelArray[m_id].first->render_mode;
-
-        //
-        if (RENDER_MODE == 0){
-            Fix16 fix16_sink;
-            // Get screen coordinates
-            for (unsigned v_id=0; v_id<modelArray[m_id].first->vertex_count; v_id++){
-                fix16_vec2 screen_vec2;
-                screen_vec2 = getScreenCoordinate(
-                    FOV, modelArray[m_id].first->vertices[v_id],
-                    modelArray[m_id].first->getPosition_ref(), modelArray[m_id].first->getRotation_ref(),
-                    modelArray[m_id].first->getScale_ref(),
-                    camera_pos, camera_rot,
-                    &fix16_sink, &is_valid
-                );
-                if(is_valid == false)
-                    continue;
-                int16_t x = (int16_t)screen_vec2.x;
-                int16_t y = (int16_t)screen_vec2.y;
-                draw_center_square(x,y,5,5, color(0,0,0));
-                // Check bbox
-                if (bbox_max->x < x+2) bbox_max->x = x+2;
-                if (bbox_max->y < y+2) bbox_max->y = y+2;
-                if (bbox_min->x > x-2) bbox_min->x = x-2;
-                if (bbox_min->y > y-2) bbox_min->y = y-2;
-            }
-        } // else if (RENDER_MODE == 0)
+    // FOV may have changed since last frame
+    frustum = makeClipFrustum(FOV);
 
-        else if (RENDER_MODE == 1)
-        {
-            // Check first if model has texture
-            if (!modelArray[m_id].first->has_texture){
-                modelArray[m_id].first->render_mode++;
-                continue;
-            }
+#ifdef PC
+    if (tileRenderer != nullptr)
+        tileRenderer->begin();
+#endif
 
-            // Allocate memory
-            int16_t_vec2* screen_coords = (int16_t_vec2*) malloc(sizeof(int16_t_vec2) * modelArray[m_id].first->vertex_count);
-            Fix16 * vert_z_depths = (Fix16*) malloc(sizeof(Fix16) * modelArray[m_id].first->vertex_count);
-            uint_fix16_t * face_draw_order = (uint_fix16_t*) malloc(sizeof(uint_fix16_t) * modelArray[m_id].first->faces_count);
-
-            // Get screen coordinates
-            for (unsigned v_id=0; v_id<modelArray[m_id].first->vertex_count; v_id++){
-                fix16_vec2 screen_vec2;
-                screen_vec2 = getScreenCoordinate(
-                    FOV, modelArray[m_id].first->vertices[v_id],
-                    modelArray[m_id].first->getPosition_ref(), modelArray[m_id].first->getRotation_ref(),
-                    modelArray[m_id].first->getScale_ref(),
-                    camera_pos, camera_rot,
-                    &vert_z_depths[v_id], &is_valid
-                );
-                int16_t x = (int16_t)screen_vec2.x;
-                int16_t y = (int16_t)screen_vec2.y;
-                screen_coords[v_id] = {x, y};
-                // Check bbox
-                if(is_valid == false)
-                    continue;
-                if (bbox_max->x < x) bbox_max->x = x;
-                if (bbox_max->y < y) bbox_max->y = y;
-                if (bbox_min->x > x) bbox_min->x = x;
-                if (bbox_min->y > y) bbox_min->y = y;
-            }
+    const unsigned arena_frame_start = frameArena.mark();
+    for (unsigned m_id=0; m_id<getModelCount(); m_id++)
+    {
+        // Scratch buffers of the previous model are not needed anymore
+        frameArena.rewind(arena_frame_start);
 
-            // Init the face_draw_order
-            for (unsigned f_id=0; f_id<modelArray[m_id].first->faces_count; f_id++)
-            {
-                unsigned int f_v0_id = modelArray[m_id].first->faces[f_id].First;
-                unsigned int f_v1_id = modelArray[m_id].first->faces[f_id].Second;
-                unsigned int f_v2_id = modelArray[m_id].first->faces[f_id].Third;
-                // Get face z-depth
-                Fix16 f_z_depth  = vert_z_depths[f_v0_id]/3.0f;
-                f_z_depth       += vert_z_depths[f_v1_id]/3.0f;
-                f_z_depth       += vert_z_depths[f_v2_id]/3.0f;
-
-                // Init index = f_id
-                face_draw_order[f_id].uint = f_id;
-                face_draw_order[f_id].fix16 = f_z_depth;
-            }
-            // Sorting
-            bubble_sort(face_draw_order, modelArray[m_id].first->faces_count);
-
-            // Draw face edges
-            for (unsigned int ordered_id=0; ordered_id<modelArray[m_id].first->faces_count; ordered_id++)
-            {
-                auto f_id = face_draw_order[ordered_id].uint;
-                const auto v0 = screen_coords[modelArray[m_id].first->faces[f_id].First];
-                const auto v1 = screen_coords[modelArray[m_id].first->faces[f_id].Second];
-                const auto v2 = screen_coords[modelArray[m_id].first->faces[f_id].Third];
-                const int16_t fix16_cast_int_min = (0xffff & (fix16_minimum>>16)) - 1;
-                if( v0.x == fix16_cast_int_min ||
-                    v1.x == fix16_cast_int_min ||
-                    v2.x == fix16_cast_int_min
-                ){
-                    continue;
-                }
-                auto uv0_fix16_norm = modelArray[m_id].first->uv_coords[modelArray[m_id].first->uv_faces[f_id].First];
-                auto uv1_fix16_norm = modelArray[m_id].first->uv_coords[modelArray[m_id].first->uv_faces[f_id].Second];
-                auto uv2_fix16_norm = modelArray[m_id].first->uv_coords[modelArray[m_id].first->uv_faces[f_id].Third];
-
-                auto v0_u = (int16_t) (uv0_fix16_norm.x * (Fix16((int16_t)modelArray[m_id].first->gen_textureWidth)));
-                auto v0_v = (int16_t) (uv0_fix16_norm.y * (Fix16((int16_t)modelArray[m_id].first->gen_textureHeight)));
-
-                auto v1_u = (int16_t) (uv1_fix16_norm.x * (Fix16((int16_t)modelArray[m_id].first->gen_textureWidth)));
-                auto v1_v = (int16_t) (uv1_fix16_norm.y * (Fix16((int16_t)modelArray[m_id].first->gen_textureHeight)));
-
-                auto v2_u = (int16_t) (uv2_fix16_norm.x * (Fix16((int16_t)modelArray[m_id].first->gen_textureWidth)));
-                auto v2_v = (int16_t) (uv2_fix16_norm.y * (Fix16((int16_t)modelArray[m_id].first->gen_textureHeight)));
-
-                int16_t_Point2d v0_screen = {v0.x,v0.y, v0_u, v0_v};
-                int16_t_Point2d v1_screen = {v1.x,v1.y, v1_u, v1_v};
-                int16_t_Point2d v2_screen = {v2.x,v2.y, v2_u, v2_v};
-
-                drawTriangle(
-                    v0_screen, v1_screen, v2_screen,
-                    //gen_uv_tex, gen_textureWidth, gen_textureHeight
-                    modelArray[m_id].first->gen_uv_tex,
-                    modelArray[m_id].first->gen_textureWidth,
-                    modelArray[m_id].first->gen_textureHeight
-                );
-            }
-            free(face_draw_order);
-            free(vert_z_depths);
-            free(screen_coords);
+        auto RENDER_MODE = modelArray[m_id].first->render_mode;
+        if (RENDER_MODE >= RENDER_MODE_COUNT)
+            continue;
+        stats.models_drawn++;
+
+        // Check first if model has texture
+        if (RENDER_MODE == 1 && !modelArray[m_id].first->has_texture){
+            modelArray[m_id].first->render_mode++;
+            continue;
         }
-
-        else if (RENDER_MODE == 2)
-        {
-            // Allocate memory
-            int16_t_vec2* screen_coords = (int16_t_vec2*) malloc(sizeof(int16_t_vec2) * modelArray[m_id].first->vertex_count);
-            Fix16 * vert_z_depths = (Fix16*) malloc(sizeof(Fix16) * modelArray[m_id].first->vertex_count);
-            uint_fix16_t * face_draw_order = (uint_fix16_t*) malloc(sizeof(uint_fix16_t) * modelArray[m_id].first->faces_count);
-            fix16_vec3* face_normals = (fix16_vec3*) malloc(sizeof(fix16_vec3) * modelArray[m_id].first->faces_count);
-
-            // Get screen coordinates
-            for (unsigned v_id=0; v_id<modelArray[m_id].first->vertex_count; v_id++){
-                fix16_vec2 screen_vec2;
-                screen_vec2 = getScreenCoordinate(
-                    FOV, modelArray[m_id].first->vertices[v_id],
-                    modelArray[m_id].first->getPosition_ref(), modelArray[m_id].first->getRotation_ref(),
-                    modelArray[m_id].first->getScale_ref(),
-                    camera_pos, camera_rot,
-                    &vert_z_depths[v_id], &is_valid
-                );
-                int16_t x = (int16_t)screen_vec2.x;
-                int16_t y = (int16_t)screen_vec2.y;
-                screen_coords[v_id] = {x, y};
-                // Check bbox
-                if(is_valid == false)
-                    continue;
-                if (bbox_max->x < x) bbox_max->x = x;
-                if (bbox_max->y < y) bbox_max->y = y;
-                if (bbox_min->x > x) bbox_min->x = x;
-                if (bbox_min->y > y) bbox_min->y = y;
-            }
-            // Init the face_draw_order
-            for (unsigned f_id=0; f_id<modelArray[m_id].first->faces_count; f_id++)
-            {
-                unsigned int f_v0_id = modelArray[m_id].first->faces[f_id].First;
-                unsigned int f_v1_id = modelArray[m_id].first->faces[f_id].Second;
-                unsigned int f_v2_id = modelArray[m_id].first->faces[f_id].Third;
-                // Get face z-depth
-                Fix16 f_z_depth  = vert_z_depths[f_v0_id]/3.0f;
-                f_z_depth       += vert_z_depths[f_v1_id]/3.0f;
-                f_z_depth       += vert_z_depths[f_v2_id]/3.0f;
-
-                // Init index = f_id
-                face_draw_order[f_id].uint = f_id;
-                face_draw_order[f_id].fix16 = f_z_depth;
-
-                // ----- Calculate also face normals here
-
-                // Face vertices
-                fix16_vec3 v0 = modelArray[m_id].first->vertices[f_v0_id];
-                fix16_vec3 v1 = modelArray[m_id].first->vertices[f_v1_id];
-                fix16_vec3 v2 = modelArray[m_id].first->vertices[f_v2_id];
-                // Model rotation
-                rotateOnPlane(v0.x, v0.z, modelArray[m_id].first->rotation.x);
-                rotateOnPlane(v0.y, v0.z, modelArray[m_id].first->rotation.y);
-                rotateOnPlane(v1.x, v1.z, modelArray[m_id].first->rotation.x);
-                rotateOnPlane(v1.y, v1.z, modelArray[m_id].first->rotation.y);
-                rotateOnPlane(v2.x, v2.z, modelArray[m_id].first->rotation.x);
-                rotateOnPlane(v2.y, v2.z, modelArray[m_id].first->rotation.y);
-                // Model translation
-                v0.x += modelArray[m_id].first->position.x;
-                v0.y += modelArray[m_id].first->position.y;
-                v0.z += modelArray[m_id].first->position.z;
-                v1.x += modelArray[m_id].first->position.x;
-                v1.y += modelArray[m_id].first->position.y;
-                v1.z += modelArray[m_id].first->position.z;
-                v2.x += modelArray[m_id].first->position.x;
-                v2.y += modelArray[m_id].first->position.y;
-                v2.z += modelArray[m_id].first->position.z;
-                // Calculate face normal
-                auto face_norm = calculateNormal(v0, v1, v2);
-                normalize_fix16_vec3(face_norm);
-                //
-                face_normals[f_id] = face_norm;
-            }
-            // Sorting
-            bubble_sort(face_draw_order, modelArray[m_id].first->faces_count);
-
-            // Optimization: Create temporary light position that has negative model position in it.
-            //               Reduces addition from once per face to once per model.
-            fix16_vec3 shifted_lightPos = {lightPos.x, lightPos.y, lightPos.z};
-            shifted_lightPos.x -= modelArray[m_id].first->getPosition_ref().x;
-            shifted_lightPos.y -= modelArray[m_id].first->getPosition_ref().y;
-            shifted_lightPos.z -= modelArray[m_id].first->getPosition_ref().z;
-
-            // Draw face edges
-            for (unsigned int ordered_id=0; ordered_id<modelArray[m_id].first->faces_count; ordered_id++)
-            {
-                auto f_id = face_draw_order[ordered_id].uint;
-                const auto v0 = screen_coords[modelArray[m_id].first->faces[f_id].First];
-                const auto v1 = screen_coords[modelArray[m_id].first->faces[f_id].Second];
-                const auto v2 = screen_coords[modelArray[m_id].first->faces[f_id].Third];
-                const int16_t fix16_cast_int_min = (0xffff & (fix16_minimum>>16)) - 1;
-                if( v0.x == fix16_cast_int_min ||
-                    v1.x == fix16_cast_int_min ||
-                    v2.x == fix16_cast_int_min
-                ){
-                    continue;
-                }
-
-                auto face_pos = modelArray[m_id].first->vertices[modelArray[m_id].first->faces[f_id].First];
-
-                Fix16 lightIntensity = calculateLightIntensity(
-                        shifted_lightPos, face_pos, face_normals[f_id], Fix16(1.0f)
-                );
-                triangle(
-                    v0.x,v0.y,v1.x,v1.y,v2.x,v2.y,
-                    color((int16_t)(lightIntensity*255.0f),(int16_t)(lightIntensity*255.0f),(int16_t)(lightIntensity*255.0f)),
-                    color(0,0,0)
-                );
-            }
-            free(face_draw_order);
-            free(vert_z_depths);
-            free(screen_coords);
-            free(face_normals);
-
-            // Draw sun visualizer
-            draw_LightLocation();
+        if (RENDER_MODE == 6 && !modelArray[m_id].first->has_texture){
+            modelArray[m_id].first->render_mode = 0;
+            continue;
         }
 
-        else if (RENDER_MODE == 3)
-        {
-            // Allocate memory
-            int16_t_vec2* screen_coords = (int16_t_vec2*) malloc(sizeof(int16_t_vec2) * modelArray[m_id].first->vertex_count);
-            Fix16 * vert_z_depths = (Fix16*) malloc(sizeof(Fix16) * modelArray[m_id].first->vertex_count);
-            uint_fix16_t * face_draw_order = (uint_fix16_t*) malloc(sizeof(uint_fix16_t) * modelArray[m_id].first->faces_count);
-
-            // Get screen coordinates
-            for (unsigned v_id=0; v_id<modelArray[m_id].first->vertex_count; v_id++){
-                fix16_vec2 screen_vec2;
-                screen_vec2 = getScreenCoordinate(
-                    FOV, modelArray[m_id].first->vertices[v_id],
-                    modelArray[m_id].first->getPosition_ref(), modelArray[m_id].first->getRotation_ref(),
-                    modelArray[m_id].first->getScale_ref(),
-                    camera_pos, camera_rot,
-                    &vert_z_depths[v_id], &is_valid
-                );
-                int16_t x = (int16_t)screen_vec2.x;
-                int16_t y = (int16_t)screen_vec2.y;
-                screen_coords[v_id] = {x, y};
-                // Check bbox
-                if(is_valid == false)
-                    continue;
-                if (bbox_max->x < x) bbox_max->x = x;
-                if (bbox_max->y < y) bbox_max->y = y;
-                if (bbox_min->x > x) bbox_min->x = x;
-                if (bbox_min->y > y) bbox_min->y = y;
-            }
-
-            // Init the face_draw_order
-            for (unsigned f_id=0; f_id<modelArray[m_id].first->faces_count; f_id++)
-            {
-                unsigned int f_v0_id = modelArray[m_id].first->faces[f_id].First;
-                unsigned int f_v1_id = modelArray[m_id].first->faces[f_id].Second;
-                unsigned int f_v2_id = modelArray[m_id].first->faces[f_id].Third;
-                // Get face z-depth
-                Fix16 f_z_depth  = vert_z_depths[f_v0_id]/3.0f;
-                f_z_depth       += vert_z_depths[f_v1_id]/3.0f;
-                f_z_depth       += vert_z_depths[f_v2_id]/3.0f;
-
-                // Init index = f_id
-                face_draw_order[f_id].uint = f_id;
-                face_draw_order[f_id].fix16 = f_z_depth;
-            }
-            // Sorting
-            bubble_sort(face_draw_order, modelArray[m_id].first->faces_count);
-
-            // Draw face edges
-            for (unsigned int ordered_id=0; ordered_id<modelArray[m_id].first->faces_count; ordered_id++)
-            {
-                auto f_id = face_draw_order[ordered_id].uint;
-                const auto v0 = screen_coords[modelArray[m_id].first->faces[f_id].First];
-                const auto v1 = screen_coords[modelArray[m_id].first->faces[f_id].Second];
-                const auto v2 = screen_coords[modelArray[m_id].first->faces[f_id].Third];
-                const int16_t fix16_cast_int_min = (0xffff & (fix16_minimum>>16)) - 1;
-                if( v0.x == fix16_cast_int_min ||
-                    v1.x == fix16_cast_int_min ||
-                    v2.x == fix16_cast_int_min
-                ){
-                    continue;
-                }
-                uint32_t colorr =
-                    0xff << (ordered_id*(24)/modelArray[m_id].first->faces_count);
-                triangle(
-                    v0.x,v0.y,v1.x,v1.y,v2.x,v2.y,
-                    color((colorr>>16)&0xcf, (colorr>>8)&0xcf, (colorr>>0)&0xcf),
-                    color(0,0,0)
-                );
-            }
-            free(face_draw_order);
-            free(vert_z_depths);
-            free(screen_coords);
-
-        }  // else if (RENDER_MODE == 3)
-
-        else if (RENDER_MODE == 4)
-        {
-            // Allocate memory
-            int16_t_vec2* screen_coords = (int16_t_vec2*) malloc(sizeof(int16_t_vec2) * modelArray[m_id].first->vertex_count);
-
-            Fix16 fix16_sink;
-            // Get screen coordinates
-            for (unsigned v_id=0; v_id<modelArray[m_id].first->vertex_count; v_id++){
-                fix16_vec2 screen_vec2;
-                screen_vec2 = getScreenCoordinate(
-                    FOV, modelArray[m_id].first->vertices[v_id],
-                    modelArray[m_id].first->getPosition_ref(), modelArray[m_id].first->getRotation_ref(),
-                    modelArray[m_id].first->getScale_ref(),
-                    camera_pos, camera_rot,
-                    &fix16_sink, &is_valid
-                );
-                int16_t x = (int16_t)screen_vec2.x;
-                int16_t y = (int16_t)screen_vec2.y;
-                screen_coords[v_id] = {x, y};
-                // Check bbox
-                if(is_valid == false)
-                    continue;
-                if (bbox_max->x < x) bbox_max->x = x;
-                if (bbox_max->y < y) bbox_max->y = y;
-                if (bbox_min->x > x) bbox_min->x = x;
-                if (bbox_min->y > y) bbox_min->y = y;
-            }
-
-            for (unsigned int f_id=0; f_id<modelArray[m_id].first->faces_count; f_id++)
-            {
-                const auto v0 = screen_coords[modelArray[m_id].first->faces[f_id].First];
-                const auto v1 = screen_coords[modelArray[m_id].first->faces[f_id].Second];
-                const auto v2 = screen_coords[modelArray[m_id].first->faces[f_id].Third];
-                const int16_t fix16_cast_int_min = (0xffff & (fix16_minimum>>16)) - 1;
-                if( v0.x == fix16_cast_int_min ||
-                    v1.x == fix16_cast_int_min ||
-                    v2.x == fix16_cast_int_min
-                ){
-                    continue;
-                }
-                triangle(
-                    v0.x,v0.y, v1.x,v1.y, v2.x,v2.y,
-                    color( 255,(f_id*8)%255,(f_id*16)%255 ),
-                    color(0,0,0)
-                );
-            }
-            free(screen_coords);
-
-        }  // else if (RENDER_MODE == 4)
-
-        else if (RENDER_MODE == 5)
-        {
-            // Allocate memory
-            int16_t_vec2* screen_coords = (int16_t_vec2*) malloc(sizeof(int16_t_vec2) * modelArray[m_id].first->vertex_count);
-
-            Fix16 fix16_sink;
-            // Get screen coordinates
-            for (unsigned v_id=0; v_id<modelArray[m_id].first->vertex_count; v_id++){
-                fix16_vec2 screen_vec2;
-                screen_vec2 = getScreenCoordinate(
-                    FOV, modelArray[m_id].first->vertices[v_id],
-                    modelArray[m_id].first->getPosition_ref(), modelArray[m_id].first->getRotation_ref(),
-                    modelArray[m_id].first->getScale_ref(),
-                    camera_pos, camera_rot,
-                    &fix16_sink, &is_valid
-                );
-                int16_t x = (int16_t)screen_vec2.x;
-                int16_t y = (int16_t)screen_vec2.y;
-                screen_coords[v_id] = {x, y};
-                // Check bbox
-                if(is_valid == false)
-                    continue;
-                if (bbox_max->x < x) bbox_max->x = x;
-                if (bbox_max->y < y) bbox_max->y = y;
-                if (bbox_min->x > x) bbox_min->x = x;
-                if (bbox_min->y > y) bbox_min->y = y;
-            }
-
-            for (unsigned int f_id=0; f_id<modelArray[m_id].first->faces_count; f_id++)
-            {
-                const auto v0 = screen_coords[modelArray[m_id].first->faces[f_id].First];
-                const auto v1 = screen_coords[modelArray[m_id].first->faces[f_id].Second];
-                const auto v2 = screen_coords[modelArray[m_id].first->faces[f_id].Third];
-                const int16_t fix16_cast_int_min = (0xffff & (fix16_minimum>>16)) - 1;
-                if( v0.x == fix16_cast_int_min ||
-                    v1.x == fix16_cast_int_min ||
-                    v2.x == fix16_cast_int_min
-                ){
-                    continue;
-                }
-                line(v0.x,v0.y, v1.x, v1.y, color(0,0,0));
-                line(v1.x,v1.y, v2.x, v2.y, color(0,0,0));
-                line(v2.x,v2.y, v0.x, v0.y, color(0,0,0));
-            }
-            free(screen_coords);
-
-        } // else if (RENDER_MODE == 5)
-
-        if (RENDER_MODE == 6)
-        {
-            // Check first if model has texture
-            if (!modelArray[m_id].first->has_texture){
-                modelArray[m_id].first->render_mode = 0;
-                continue;
-            }
-
-            // Allocate memory
-            int16_t_vec2* screen_coords = (int16_t_vec2*) malloc(sizeof(int16_t_vec2) * modelArray[m_id].first->vertex_count);
-            Fix16 * vert_z_depths = (Fix16*) malloc(sizeof(Fix16) * modelArray[m_id].first->vertex_count);
-            uint_fix16_t * face_draw_order = (uint_fix16_t*) malloc(sizeof(uint_fix16_t) * modelArray[m_id].first->faces_count);
-            fix16_vec3* face_normals = (fix16_vec3*) malloc(sizeof(fix16_vec3) * modelArray[m_id].first->faces_count);
-
-            // Get screen coordinates
-            for (unsigned v_id=0; v_id<modelArray[m_id].first->vertex_count; v_id++){
-                fix16_vec2 screen_vec2;
-                screen_vec2 = getScreenCoordinate(
-                    FOV, modelArray[m_id].first->vertices[v_id],
-                    modelArray[m_id].first->getPosition_ref(), modelArray[m_id].first->getRotation_ref(),
-                    modelArray[m_id].first->getScale_ref(),
-                    camera_pos, camera_rot,
-                    &vert_z_depths[v_id], &is_valid
-                );
-                int16_t x = (int16_t)screen_vec2.x;
-                int16_t y = (int16_t)screen_vec2.y;
-                screen_coords[v_id] = {x, y};
-                // Check bbox
-                if(is_valid == false)
-                    continue;
-                if (bbox_max->x < x) bbox_max->x = x;
-                if (bbox_max->y < y) bbox_max->y = y;
-                if (bbox_min->x > x) bbox_min->x = x;
-                if (bbox_min->y > y) bbox_min->y = y;
-            }
-
-            // Init the face_draw_order
-            for (unsigned f_id=0; f_id<modelArray[m_id].first->faces_count; f_id++)
-            {
-                unsigned int f_v0_id = modelArray[m_id].first->faces[f_id].First;
-                unsigned int f_v1_id = modelArray[m_id].first->faces[f_id].Second;
-                unsigned int f_v2_id = modelArray[m_id].first->faces[f_id].Third;
-
-                // Get face z-depth
-                Fix16 f_z_depth  = vert_z_depths[f_v0_id]/3.0f;
-                f_z_depth       += vert_z_depths[f_v1_id]/3.0f;
-                f_z_depth       += vert_z_depths[f_v2_id]/3.0f;
-
-                // Init index = f_id
-                face_draw_order[f_id].uint = f_id;
-                face_draw_order[f_id].fix16 = f_z_depth;
-                // ----- Calculate also face normals here
-
-                // Face vertices
-                fix16_vec3 v0 = modelArray[m_id].first->vertices[f_v0_id];
-                fix16_vec3 v1 = modelArray[m_id].first->vertices[f_v1_id];
-                fix16_vec3 v2 = modelArray[m_id].first->vertices[f_v2_id];
-                // Model rotation
-                rotateOnPlane(v0.x, v0.z, modelArray[m_id].first->rotation.x);
-                rotateOnPlane(v0.y, v0.z, modelArray[m_id].first->rotation.y);
-                rotateOnPlane(v1.x, v1.z, modelArray[m_id].first->rotation.x);
-                rotateOnPlane(v1.y, v1.z, modelArray[m_id].first->rotation.y);
-                rotateOnPlane(v2.x, v2.z, modelArray[m_id].first->rotation.x);
-                rotateOnPlane(v2.y, v2.z, modelArray[m_id].first->rotation.y);
-                // Model translation
-                v0.x += modelArray[m_id].first->position.x;
-                v0.y += modelArray[m_id].first->position.y;
-                v0.z += modelArray[m_id].first->position.z;
-                v1.x += modelArray[m_id].first->position.x;
-                v1.y += modelArray[m_id].first->position.y;
-                v1.z += modelArray[m_id].first->position.z;
-                v2.x += modelArray[m_id].first->position.x;
-                v2.y += modelArray[m_id].first->position.y;
-                v2.z += modelArray[m_id].first->position.z;
-                // Calculate face normal
-                auto face_norm = calculateNormal(v0, v1, v2);
-                normalize_fix16_vec3(face_norm);
-                //
-                face_normals[f_id] = face_norm;
-            }
-
-            // Sorting
-            bubble_sort(face_draw_order, modelArray[m_id].first->faces_count);
-
-            // Optimization: Create temporary light position that has negative model position in it.
-            //               Reduces addition from once per face to once per model.
-            fix16_vec3 shifted_lightPos = {lightPos.x, lightPos.y, lightPos.z};
-            shifted_lightPos.x -= modelArray[m_id].first->getPosition_ref().x;
-            shifted_lightPos.y -= modelArray[m_id].first->getPosition_ref().y;
-            shifted_lightPos.z -= modelArray[m_id].first->getPosition_ref().z;
-
-            // Draw face edges
-            for (unsigned int ordered_id=0; ordered_id<modelArray[m_id].first->faces_count; ordered_id++)
-            {
-                auto f_id = face_draw_order[ordered_id].uint;
-                const auto v0 = screen_coords[modelArray[m_id].first->faces[f_id].First];
-                const auto v1 = screen_coords[modelArray[m_id].first->faces[f_id].Second];
-                const auto v2 = screen_coords[modelArray[m_id].first->faces[f_id].Third];
-                const int16_t fix16_cast_int_min = (0xffff & (fix16_minimum>>16)) - 1;
-                if( v0.x == fix16_cast_int_min ||
-                    v1.x == fix16_cast_int_min ||
-                    v2.x == fix16_cast_int_min
-                ){
-                    continue;
-                }
-                auto uv0_fix16_norm = modelArray[m_id].first->uv_coords[modelArray[m_id].first->uv_faces[f_id].First];
-                auto uv1_fix16_norm = modelArray[m_id].first->uv_coords[modelArray[m_id].first->uv_faces[f_id].Second];
-                auto uv2_fix16_norm = modelArray[m_id].first->uv_coords[modelArray[m_id].first->uv_faces[f_id].Third];
-
-                auto v0_u = (int16_t) (uv0_fix16_norm.x * (Fix16((int16_t)modelArray[m_id].first->gen_textureWidth)));
-                auto v0_v = (int16_t) (uv0_fix16_norm.y * (Fix16((int16_t)modelArray[m_id].first->gen_textureHeight)));
-
-                auto v1_u = (int16_t) (uv1_fix16_norm.x * (Fix16((int16_t)modelArray[m_id].first->gen_textureWidth)));
-                auto v1_v = (int16_t) (uv1_fix16_norm.y * (Fix16((int16_t)modelArray[m_id].first->gen_textureHeight)));
-
-                auto v2_u = (int16_t) (uv2_fix16_norm.x * (Fix16((int16_t)modelArray[m_id].first->gen_textureWidth)));
-                auto v2_v = (int16_t) (uv2_fix16_norm.y * (Fix16((int16_t)modelArray[m_id].first->gen_textureHeight)));
-
-                int16_t_Point2d v0_screen = {v0.x,v0.y, v0_u, v0_v};
-                int16_t_Point2d v1_screen = {v1.x,v1.y, v1_u, v1_v};
-                int16_t_Point2d v2_screen = {v2.x,v2.y, v2_u, v2_v};
-
-                const auto face_pos = modelArray[m_id].first->vertices[modelArray[m_id].first->faces[f_id].First];
-                Fix16 lightIntensity = calculateLightIntensity(
-                        shifted_lightPos, face_pos, face_normals[f_id], Fix16(1.0f)
-                );
-
-                drawTriangle(
-                    v0_screen, v1_screen, v2_screen,
-                    modelArray[m_id].first->gen_uv_tex,
-                    modelArray[m_id].first->gen_textureWidth,
-                    modelArray[m_id].first->gen_textureHeight,
-                    lightIntensity
-                );
-            }
-            free(face_draw_order);
-            free(vert_z_depths);
-            free(screen_coords);
-            free(face_normals);
-
-            // Draw sun visualizer
-            draw_LightLocation();
-        }  // if (RENDER_MODE == 6)
+        ModelFrame mf;
+        mf.model = modelArray[m_id].first;
+        mf.screen_coords = mf.model->screen_coords;
+        mf.vert_z_depths = mf.model->vert_z_depths;
+        mf.clip_codes    = mf.model->clip_codes;
+        mf.bbox_max = bbox_max;
+        mf.bbox_min = bbox_min;
+
+        // Trigonometry once per model, vertices only need multiply-adds
+        mf.model_to_camera = buildTransformMatrix(
+            mf.model->getPosition_ref(), mf.model->getRotation_ref(),
+            mf.model->getScale_ref(),
+            camera_pos, camera_rot
+        );
+        // Stored vertex positions to camera space (see Mesh.hpp)
+        mf.vertex_to_camera = mesh_vertex_matrix(*mf.model->mesh, mf.model_to_camera);
+
+        // Get screen coordinates, unless neither the model nor the camera
+        // moved since the model was last drawn
+        ModelTransformCache& cache = mf.model->transform_cache;
+        if (!cache.valid || cache.FOV != FOV || !same_transform(cache.model_to_camera, mf.model_to_camera)){
+            cache.valid = true;
+            cache.model_to_camera = mf.model_to_camera;
+            cache.FOV = FOV;
+            cache.faces = ModelTransformCache::FACES_STALE;
+            cache.bbox_max = {INT16_MIN, INT16_MIN};
+            cache.bbox_min = {INT16_MAX, INT16_MAX};
+            stats.vertices_transformed += mf.model->mesh->vertex_count;
+            transformVertices(
+                mf.model->mesh, mf.vertex_to_camera, frustum,
+                mf.screen_coords, mf.vert_z_depths, mf.clip_codes, &cache.bbox_max, &cache.bbox_min
+            );
+        }
+        else
+            stats.models_reused++;
+        if (bbox_max->x < cache.bbox_max.x) bbox_max->x = cache.bbox_max.x;
+        if (bbox_max->y < cache.bbox_max.y) bbox_max->y = cache.bbox_max.y;
+        if (bbox_min->x > cache.bbox_min.x) bbox_min->x = cache.bbox_min.x;
+        if (bbox_min->y > cache.bbox_min.y) bbox_min->y = cache.bbox_min.y;
+
+        // Draw with the pipeline of the render mode
+        const DrawModelFn draw_model_fn = drawModelTable[RENDER_MODE];
+        (this->*draw_model_fn)(mf);
     }
 
+#ifdef PC
+    if (tileRenderer != nullptr)
+        tileRenderer->flush();
+#endif
+
     // Some buffer around bbox (as draw lines may draw over the bbox)
     bbox_min->x -= 2;
     bbox_min->y -= 2;
@@ -707,6 +739,11 @@ void Renderer::update(
     if(bbox_max->x > SCREEN_X) bbox_max->x = SCREEN_X;
     if(bbox_max->y > SCREEN_Y) bbox_max->y = SCREEN_Y;
 
+    depthDirtyMin = *bbox_min;
+    depthDirtyMax = *bbox_max;
+
     // Draw rotation visualizer in corner
     draw_RotationVisualizer(camera_rot);
+
+    stats.heap_allocations = frameArena.getHeapAllocations() - heap_allocations_start;
 }
\ No newline at end of file
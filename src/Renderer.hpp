@@ -2,20 +2,50 @@
 
 #include "Model.hpp"
 
+#include "AssetCache.hpp"
+
 #include "DynamicArray.hpp"
 
 #include "Pair.hpp"
 
+#include "FrameArena.hpp"
+
+#include "Clipping.hpp"
+
 #define _NO_TEXTURE_IMPL    (char*)NO_TEXTURE_PATH
 #define NO_TEXTURE          _NO_TEXTURE_IMPL
 
 const float   ROTATION_VISUALIZER_LINE_WIDTH = 20.0f;
 const int16_t ROTATION_VISALIZER_EDGE_OFFSET = 15;
 
+// Width and height of the light location box (draw_LightLocation)
+const int16_t LIGHT_LOCATION_SIZE = 9;
+
 const uint16_t RENDER_MODE_COUNT = 7;
 
 const char NO_TEXTURE_PATH[] = "\0";
 
+// Per-frame counters filled by Renderer::update. Reset at the start of every update.
+struct RenderStats
+{
+    unsigned models_drawn;
+    // Models drawn with last frame's vertex transform (see ModelTransformCache)
+    unsigned models_reused;
+    // Models not drawn, out of memory for their scratch buffers
+    unsigned models_skipped;
+    unsigned vertices_transformed;
+    unsigned faces_drawn;
+    // Faces facing away from the camera (see Model::backface_culling)
+    unsigned faces_culled;
+    // Faces left for sorting and drawing after culling
+    unsigned faces_visible;
+    // Faces crossing the view frustum, drawn clipped
+    unsigned faces_clipped;
+    // Heap allocations done by the frame arena. Zero once the arena has
+    // grown to fit the scene (steady state).
+    unsigned heap_allocations;
+};
+
 #ifdef PC
     typedef uint32_t color_t; // SDL2 uses 32b colors (24b colors + 8b alpha). Alpha not used.
 #else
@@ -23,9 +53,37 @@ const char NO_TEXTURE_PATH[] = "\0";
 #endif
 
 
+#ifdef PC
+class TileRenderer;
+#endif
+
+// Fill color of the flat (untextured) render modes
+enum FlatColor : uint8_t
+{
+    FLAT_COLOR_NONE,        // Textured or not filled
+    FLAT_COLOR_LIGHT,       // Gray by the light intensity of the face
+    FLAT_COLOR_DRAW_ORDER,  // By position in the sorted draw order
+    FLAT_COLOR_FACE_ID      // By face index, faces drawn in model order (unsorted)
+};
+
+// Vertex data of the model being drawn (the model's transform cache)
+struct ModelFrame
+{
+    Model*        model;
+    fix16_mat3x4  model_to_camera;
+    fix16_mat3x4  vertex_to_camera; // Stored vertex positions to camera space
+    int16_t_vec2* screen_coords;
+    Fix16*        vert_z_depths;
+    uint8_t*      clip_codes;
+    int16_t_vec2* bbox_max;
+    int16_t_vec2* bbox_min;
+};
+
 class Renderer
 {
 private:
+    // Meshes and textures of the models, shared between models of the same files
+    AssetCache assets;
     DynamicArray<Pair<Model*, Fix16>> modelArray;
 
     fix16_vec3 camera_pos;
@@ -36,25 +94,112 @@ private:
 
     int16_t_vec2 lastLightScreenLocation;
 
+    RenderStats stats;
+
+    // Per-frame scratch buffers (screen coordinates, depths, normals, ...)
+    FrameArena frameArena;
+
+    // Frame arena bytes needed to render given model
+    static unsigned frameBytesForModel(Model* m);
+    // Takes the new model into the scene
+    Model* addModel(Model* m);
+
+    // Optional depth buffer (SCREEN_X*SCREEN_Y), nullptr when disabled.
+    // Only the bbox drawn on the last frame is cleared every frame.
+    uint16_t* depthBuffer;
+    int16_t_vec2 depthDirtyMin;
+    int16_t_vec2 depthDirtyMax;
+
+    // View frustum of the current frame (FOV can change between frames)
+    ClipFrustum frustum;
+
+    // Face drawing. Faces inside the frustum are drawn straight from the
+    // transformed vertices, faces crossing it are clipped first. Depth
+    // tested when depth buffer is enabled.
+    void draw_textured_face(const ModelFrame& mf, unsigned f_id, Fix16 light);
+    void draw_flat_face(const ModelFrame& mf, unsigned f_id, color_t colorFill, color_t colorLine);
+    void draw_wire_face(const ModelFrame& mf, unsigned f_id, color_t colorLine);
+
+    // Draws one model (transformed into mf) with the render mode pipeline:
+    // texture mapped, light shaded, filled and/or outlined faces. Without
+    // any of them the vertices are drawn as points. Every combination is
+    // its own function, the flags cost nothing per face.
+    template<bool Textured, bool Lit, bool Filled, bool Wire, FlatColor Color>
+    void draw_model(const ModelFrame& mf);
+
+    // Pipeline of every render mode (Model::render_mode)
+    typedef void (Renderer::*DrawModelFn)(const ModelFrame& mf);
+    static const DrawModelFn drawModelTable[RENDER_MODE_COUNT];
+
+    // Clips face against the frustum (see clip_triangle) and grows the bbox.
+    // Returns 0 when nothing is left or, with cull, when it is a back face.
+    unsigned clip_face(
+        const ModelFrame& mf, unsigned f_id, const int16_t_Point2d corners[3], bool cull,
+        int16_t_Point2d out[], bool edges[]
+    );
+
+#ifdef PC
+    // Draws the frame on several threads when set (see setThreadCount)
+    TileRenderer* tileRenderer;
+#endif
+
+    // Primitive drawing. Recorded into the tile renderer during update()
+    // when it is enabled, drawn right away otherwise.
+    void draw_textured_triangle(
+        const int16_t_Point2d& v0, const int16_t_Point2d& v1, const int16_t_Point2d& v2,
+        Model* m, Fix16 light
+    );
+    void draw_triangle(
+        const int16_t_Point2d& v0, const int16_t_Point2d& v1, const int16_t_Point2d& v2,
+        color_t colorFill, color_t colorLine
+    );
+    // Depth tested only with depthTest and the depth buffer enabled
+    void draw_line(const int16_t_Point2d& a, const int16_t_Point2d& b, color_t color, bool depthTest);
+    void draw_square(int16_t cx, int16_t cy, int16_t sx, int16_t sy, color_t color);
+
 public:
 
     bool camera_move_dirty;
 
     DynamicArray<Pair<Model*, Fix16>>& getModelArray();
-    // If model has no texture, set as NO_TEXTURE
-    Model* addModel(char* model_path, char* texture_path, bool centerVertices=true);
+    AssetCache& getAssetCache();
+    // If model has no texture, set as NO_TEXTURE. Models of the same files
+    // share one copy of the mesh and texture. nullptr if the mesh could not
+    // be loaded, nothing is added then.
+    Model* addModel(char* model_path, char* texture_path, bool centerVertices=true, int textureMaxSize=0);
+    // Same with the mesh and texture of entries of an open bundle (see
+    // AssetBundle.hpp). The bundle can be closed once the models are added.
+    Model* addModel(const AssetBundle& bundle, char* mesh_name, char* texture_name, bool centerVertices=true, int textureMaxSize=0);
     unsigned int getModelCount();
 
     void update(int16_t_vec2* bbox_max, int16_t_vec2* bbox_min);
 
+    // Depth buffer replaces face and model sorting (painter's algorithm).
+    // Costs SCREEN_X*SCREEN_Y*2 bytes. Returns false if allocation failed.
+    bool setDepthBufferEnabled(bool enabled);
+    bool isDepthBufferEnabled();
+
+#ifdef PC
+    // Number of threads drawing the frame (screen split into tiles, see
+    // TileRenderer.hpp). 0 draws directly on the thread calling update().
+    void setThreadCount(unsigned threads);
+    unsigned getThreadCount();
+#endif
+
     fix16_vec3& get_camera_pos();
     fix16_vec2& get_camera_rot();
     Fix16     & get_FOV();
     fix16_vec3& get_lightPos();
 
+    // Counters of the last update() call
+    const RenderStats& get_stats();
+    const FrameArena& getFrameArena();
+
     // Draws box as light location
     void draw_LightLocation();
     void clear_LightLocation(color_t clearColor);
+    // Screen area of the last drawn light location box
+    ScreenRect get_LightLocationRect();
 
     Renderer();
     ~Renderer();
@@ -6,7 +6,8 @@
 #   include <sdk/os/lcd.hpp>
 #   include <sdk/os/debug.hpp>
 #else
-#   include <SDL2/SDL.h>
+#   include <cstdlib>   // malloc & free
+#   include <cstring>   // memset
 #   include <iostream>
 #   include <unistd.h>  // File open & close
 #   include <fcntl.h>   // File open & close
@@ -32,6 +33,110 @@ int custom_atoi(char* str)
     return (value * sign);
 }
 
+int custom_strtol(const char* str, const char** end)
+{
+    const char* s = str;
+    int sign = 1;
+    if (*s == '-' || *s == '+')
+    {
+        sign = (*s == '-') ? -1 : 1;
+        s++;
+    }
+    if (*s < '0' || *s > '9')
+    {
+        *end = str;
+        return 0;
+    }
+    int value = 0;
+    while (*s >= '0' && *s <= '9')
+    {
+        value = value * 10 + (int) (*s - '0');
+        s++;
+    }
+    *end = s;
+    return value * sign;
+}
+
+// Significant digits kept, the rest are below Fix16 precision
+#define ATOFIX16_DIGITS 24
+// Fraction digits summed (2^-24 precision)
+#define ATOFIX16_FRACTION_DIGITS 12
+
+fix16_t custom_atofix16(const char* str, const char** end)
+{
+    const char* s = str;
+    bool negative = false;
+    if (*s == '-' || *s == '+')
+    {
+        negative = (*s == '-');
+        s++;
+    }
+
+    // Value is 0.d[0]d[1]d[2]... * 10^point
+    uint8_t d[ATOFIX16_DIGITS];
+    int n = 0;
+    int point = 0;
+    bool any_digit = false;
+    for (; *s >= '0' && *s <= '9'; s++)
+    {
+        any_digit = true;
+        if (n == 0 && *s == '0')
+            continue; // Leading zero
+        if (n < ATOFIX16_DIGITS)
+            d[n++] = *s - '0';
+        point++;
+    }
+    if (*s == '.')
+    {
+        for (s++; *s >= '0' && *s <= '9'; s++)
+        {
+            any_digit = true;
+            if (n == 0 && *s == '0')
+                point--; // Zero after the point, before any other digit
+            else if (n < ATOFIX16_DIGITS)
+                d[n++] = *s - '0';
+        }
+    }
+    if (!any_digit)
+    {
+        *end = str;
+        return 0;
+    }
+    if ((*s == 'e' || *s == 'E'))
+    {
+        const char* exponent_end;
+        const int exponent = custom_strtol(s + 1, &exponent_end);
+        if (exponent_end != s + 1)
+        {
+            s = exponent_end;
+            // Beyond these the value saturates or is zero anyway
+            point += (exponent < -64) ? -64 : (exponent > 64 ? 64 : exponent);
+        }
+    }
+    *end = s;
+
+    // Integer part, saturated
+    int32_t integer = 0;
+    for (int i = 0; i < point; i++)
+    {
+        integer = integer * 10 + (i < n ? d[i] : 0);
+        if (integer > 0x7fff)
+            return negative ? fix16_minimum : fix16_maximum;
+    }
+    // Fraction in 1/2^24 from the last digit to the first: f = (f + digit) / 10
+    uint32_t fraction = 0;
+    for (int k = ATOFIX16_FRACTION_DIGITS - 1; k >= 0; k--)
+    {
+        const int i = point + k;
+        const uint32_t digit = (i >= 0 && i < n) ? d[i] : 0;
+        fraction = (fraction + (digit << 24)) / 10;
+    }
+    const uint32_t raw = ((uint32_t) integer << 16) + ((fraction + (1 << 7)) >> 8);
+    if (raw > (uint32_t) fix16_maximum)
+        return negative ? fix16_minimum : fix16_maximum;
+    return negative ? -(fix16_t) raw : (fix16_t) raw;
+}
+
 // Returns: true if could find target
 //          false could not find (Also seeks back to original location)
 bool seek_next_char(int fd, char target)
@@ -146,4 +251,64 @@ bool read_line(int fd, char* buf, int buf_size)
         return true;
     }
     return false;
-}
\ No newline at end of file
+}
+
+void line_reader_init(LineReader& reader, int fd, char* buf, int buf_size)
+{
+    reader.fd = fd;
+    reader.buf = buf;
+    reader.buf_size = buf_size;
+    reader.start = 0;
+    reader.end = 0;
+    reader.eof = false;
+    reader.too_long = false;
+}
+
+char* line_reader_next(LineReader& reader)
+{
+    char* buf = reader.buf;
+    while (true)
+    {
+        // Whole line in the buffer
+        for (int i = reader.start; i < reader.end; i++)
+        {
+            if (buf[i] == '\n')
+            {
+                char* line = buf + reader.start;
+                buf[i] = '\0';
+                if (i > reader.start && buf[i - 1] == '\r')
+                    buf[i - 1] = '\0';
+                reader.start = i + 1;
+                return line;
+            }
+        }
+        if (reader.eof)
+        {
+            // Last line without a newline
+            if (reader.start == reader.end)
+                return nullptr;
+            char* line = buf + reader.start;
+            buf[reader.end] = '\0';
+            reader.start = reader.end;
+            return line;
+        }
+        if (reader.start == 0 && reader.end == reader.buf_size - 1)
+        {
+            reader.too_long = true;
+            return nullptr;
+        }
+
+        // Rest of the line to the front, then fill the buffer up (one byte
+        // kept for the terminating NULL)
+        const int rest = reader.end - reader.start;
+        for (int i = 0; i < rest; i++)
+            buf[i] = buf[reader.start + i];
+        reader.start = 0;
+        reader.end = rest;
+        const int rd_bytes = read(reader.fd, buf + rest, reader.buf_size - 1 - rest);
+        if (rd_bytes <= 0)
+            reader.eof = true;
+        else
+            reader.end += rd_bytes;
+    }
+}
@@ -1,8 +1,19 @@
 #pragma once
 
+#include "libfixmath/fix16.hpp"
+
 // Does not require NULL termination
 int custom_atoi(char* str);
 
+// custom_atoi that also returns where the number ended (str when there
+// were no digits)
+int custom_strtol(const char* str, const char** end);
+
+// Decimal number (optional sign, fraction and exponent, e.g. "-1.25e-3")
+// to Fix16 without floats, rounded to the nearest 1/65536. Saturates at the
+// Fix16 range. end is where the number ended (str when there were no digits).
+fix16_t custom_atofix16(const char* str, const char** end);
+
 // Returns false could not find (Also seeks back to original location)
 // Returns true if could find target
 bool seek_next_char(int fd, char target);
@@ -22,3 +33,25 @@ bool read_until(int fd, char* buf, int buf_size, char target, bool include_targe
 // TODO: Add another read_until that has target
 //       string instead of single character.
 bool read_line(int fd, char* buf, int buf_size);
+
+// Reads a file line by line through buf, one read() per buffer full
+// instead of per character (see read_line). Lines end at '\n', a '\r'
+// before it is dropped.
+struct LineReader
+{
+    int fd;
+    char* buf;
+    int buf_size;
+    int start;      // Next line starts here
+    int end;        // Bytes read into buf
+    bool eof;
+    bool too_long;  // Stopped at a line longer than buf_size - 1
+};
+
+// Lines of fd from its current position
+void line_reader_init(LineReader& reader, int fd, char* buf, int buf_size);
+
+// Next line, NULL terminated in buf and valid until the next call.
+// nullptr at the end of the file or when the line does not fit into buf
+// (too_long).
+char* line_reader_next(LineReader& reader);
@@ -0,0 +1,249 @@
+#include "Texture.hpp"
+
+#include "constants.hpp"
+
+#ifndef PC
+#   include <sdk/os/file.hpp>
+#   include <sdk/os/mem.hpp>
+#else
+#   include <cstdlib>   // malloc & free
+#   include <cstring>   // memcpy
+#   include <iostream>
+#   include <unistd.h>  // File open & close
+#   include <fcntl.h>   // File open & close
+#endif
+
+static inline int texel_index(const TextureLevel& level, uint32_t layout, int u, int v)
+{
+    if (layout == TEXTURE_LAYOUT_TILED)
+        return texture_tiled_index(u, v, level.width);
+    return u + v * level.width;
+}
+
+// Layout the level ends up in when the texture is set to layout
+static uint32_t level_layout_for(const TextureLevel& level, uint32_t layout)
+{
+    if (level.width % TEXTURE_TILE != 0 || level.height % TEXTURE_TILE != 0)
+        return TEXTURE_LAYOUT_LINEAR;
+    return layout;
+}
+
+bool texture_set_layout(Texture& texture, uint32_t layout)
+{
+    // A band of TEXTURE_TILE rows takes the same memory range in both
+    // layouts, so levels are reordered band by band through a small copy.
+    const unsigned texel_size = texture_texel_size(texture.format);
+    // INDEX4 texels are not whole bytes
+    if (texel_size == 0)
+        return true;
+    unsigned band_width = 0;
+    for (unsigned l = texture.first_level; l < texture.levels; l++) {
+        const TextureLevel& level = texture.level[l];
+        if (level_layout_for(level, layout) != level.layout && (unsigned) level.width > band_width)
+            band_width = level.width;
+    }
+    if (band_width == 0)
+        return true;
+    uint8_t* band = (uint8_t*) malloc(texel_size * band_width * TEXTURE_TILE);
+    if (band == nullptr)
+        return false;
+
+    for (unsigned l = texture.first_level; l < texture.levels; l++) {
+        TextureLevel& level = texture.level[l];
+        const uint32_t level_layout = level_layout_for(level, layout);
+        if (level_layout == level.layout)
+            continue;
+
+        const unsigned band_bytes = texel_size * level.width * TEXTURE_TILE;
+        for (int band_v = 0; band_v < level.height; band_v += TEXTURE_TILE) {
+            uint8_t* pixels = (uint8_t*) level.pixels + band_v * level.width * texel_size;
+            memcpy(band, pixels, band_bytes);
+            for (int v = 0; v < TEXTURE_TILE; v++) {
+                for (int u = 0; u < level.width; u++) {
+                    const int from = texel_index(level, level.layout, u, v);
+                    const int to   = texel_index(level, level_layout, u, v);
+                    memcpy(pixels + to * texel_size, band + from * texel_size, texel_size);
+                }
+            }
+        }
+        level.layout = level_layout;
+    }
+
+    free(band);
+    return true;
+}
+
+// Every texel of the loaded levels has a palette color
+static bool palette_indices_valid(const Texture& texture)
+{
+    for (unsigned l = texture.first_level; l < texture.levels; l++) {
+        const TextureLevel& level = texture.level[l];
+        const uint8_t* texels = (const uint8_t*) level.pixels;
+        const int n = level.width * level.height;
+        for (int i = 0; i < n; i++) {
+            const unsigned index = texture.format == TEXTURE_FORMAT_INDEX4
+                ? (texels[i >> 1] >> ((i & 1) << 2)) & 0xf
+                : texels[i];
+            if (index >= texture.palette_size)
+                return false;
+        }
+    }
+    return true;
+}
+
+static palette_color_t palette_color(uint32_t rgb888)
+{
+#ifdef PC
+    return rgb888;
+#else
+    return (palette_color_t) (((rgb888 >> 8) & 0xf800) | ((rgb888 >> 5) & 0x07e0) | ((rgb888 >> 3) & 0x001f));
+#endif
+}
+
+bool texture_load(Texture& texture, const char* path, int maxSize)
+{
+    memset(&texture, 0, sizeof(Texture));
+
+    int fd = open(path, UNIVERSIAL_FILE_READ);
+    if (fd < 0){
+#ifdef PC
+        std::cout << "Could not open " << path << std::endl;
+#endif
+        return false;
+    }
+    const bool loaded = texture_load_region(texture, file_region(fd), path, maxSize);
+    close(fd);
+    return loaded;
+}
+
+bool texture_load_region(Texture& texture, const FileRegion& region, const char* name, int maxSize)
+{
+    (void) name; // Printed only on PC
+    memset(&texture, 0, sizeof(Texture));
+
+    const int fd = region.fd;
+    char buff[32] = {0};
+    lseek(fd, region.offset, SEEK_SET);
+    read(fd, buff, region.size < 31 ? region.size : 31);
+
+    unsigned lseek_texture_start;
+    if (*((uint32_t*)(buff+0)) == TEXTURE_MAGIC){
+        texture.width  = *((uint32_t*)(buff+4));
+        texture.height = *((uint32_t*)(buff+8));
+        texture.format = *((uint32_t*)(buff+12));
+        texture.levels = *((uint32_t*)(buff+16));
+        lseek_texture_start  = 20;
+        if (texture_format_indexed(texture.format)){
+            texture.palette_size = *((uint32_t*)(buff+20));
+            lseek_texture_start += 4 + texture.palette_size * sizeof(uint32_t);
+        }
+    } else {
+        // Original format without header
+        texture.width  = *((uint32_t*)(buff+0));
+        texture.height = *((uint32_t*)(buff+4));
+        texture.format = TEXTURE_FORMAT_RGB888;
+        texture.levels = 1;
+        lseek_texture_start  = 8;
+    }
+
+    const unsigned texel_bits = texture_texel_bits(texture.format);
+    const int max_width = 1 << (TEXTURE_MAX_LEVELS - 1);
+    const bool palette_ok = !texture_format_indexed(texture.format) ||
+        (texture.palette_size > 0 && texture.palette_size <= (1u << texel_bits));
+    if (texel_bits == 0 || !palette_ok || texture.levels == 0 || texture.levels > TEXTURE_MAX_LEVELS ||
+        texture.width <= 0 || texture.height <= 0 || texture.width > max_width || texture.height > max_width
+    ){
+#ifdef PC
+        std::cout << "Unknown texture format " << texture.format
+                  << ", palette size " << texture.palette_size
+                  << ", size " << texture.width << "x" << texture.height
+                  << " or level count " << texture.levels << ". Not loading texture." << std::endl;
+#endif
+        memset(&texture, 0, sizeof(Texture));
+        return false;
+    }
+
+#ifdef PC
+        std::cout
+                 << "tex_size_x = " << texture.width
+                 << " tex_size_y = " << texture.height
+                 << " format = " << texture.format
+                 << " levels = " << texture.levels
+                 << std::endl;
+#endif
+    // Levels larger than maxSize are skipped (smallest level is always loaded)
+    unsigned skipped_bytes = 0;
+    unsigned texture_bytes = 0;
+    texture.first_level = 0;
+    for (unsigned l = 0; l < texture.levels; l++) {
+        TextureLevel& level = texture.level[l];
+        level.width  = (texture.width  >> l) > 0 ? (texture.width  >> l) : 1;
+        level.height = (texture.height >> l) > 0 ? (texture.height >> l) : 1;
+        const unsigned level_bytes = texture_level_bytes(texture.format, level.width, level.height);
+        const bool too_large = maxSize > 0 &&
+            (level.width > maxSize || level.height > maxSize);
+        if (too_large && l + 1 < texture.levels) {
+            texture.first_level = l + 1;
+            skipped_bytes += level_bytes;
+        } else {
+            texture_bytes += level_bytes;
+        }
+    }
+
+    // Palette before the texels, converted into the block's scratch memory
+    uint32_t file_palette[TEXTURE_PALETTE_MAX];
+    const unsigned palette_bytes = texture.palette_size * sizeof(uint32_t);
+    bool read_ok = true;
+    if (palette_bytes > 0){
+        lseek(fd, region.offset + lseek_texture_start - palette_bytes, SEEK_SET);
+        read_ok = read(fd, file_palette, palette_bytes) == (int) palette_bytes;
+    }
+
+    // Loaded levels in one block
+    read_ok = read_ok && lseek_texture_start + skipped_bytes + texture_bytes <= region.size &&
+              file_blob_read(texture.file, fd, region.offset + lseek_texture_start + skipped_bytes, texture_bytes,
+                             texture.palette_size * sizeof(palette_color_t));
+    if (!read_ok){
+#ifdef PC
+        std::cout << "Could not read " << name << ", file shorter than its levels" << std::endl;
+#endif
+        memset(&texture, 0, sizeof(Texture));
+        return false;
+    }
+    texture.pixels = texture.file.data;
+
+    uint8_t* level_pixels = (uint8_t*) texture.pixels;
+    for (unsigned l = texture.first_level; l < texture.levels; l++) {
+        texture.level[l].pixels = level_pixels;
+        texture.level[l].layout = TEXTURE_LAYOUT_LINEAR;
+        level_pixels += texture_level_bytes(texture.format, texture.level[l].width, texture.level[l].height);
+    }
+
+    if (palette_bytes > 0){
+        texture.palette = (palette_color_t*) texture.file.extra;
+        for (unsigned i = 0; i < texture.palette_size; i++)
+            texture.palette[i] = palette_color(file_palette[i]);
+        if (!palette_indices_valid(texture)){
+#ifdef PC
+            std::cout << "Could not read " << name << ", palette index out of range" << std::endl;
+#endif
+            texture_free(texture);
+            return false;
+        }
+    }
+    // Out of memory for the reorder copy: linear levels draw the same, only
+    // slower
+    if (!texture_set_layout(texture, TEXTURE_LAYOUT_DEFAULT)){
+#ifdef PC
+        std::cout << "Could not tile " << name << ", out of memory. Keeping it linear." << std::endl;
+#endif
+    }
+
+    return true;
+}
+
+void texture_free(Texture& texture)
+{
+    file_blob_free(texture.file);
+    memset(&texture, 0, sizeof(Texture));
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+// Texture as loaded from a .texture file (see python/ObjTexConverter.py).
+//
+// File format: [1] 32b magic TEXTURE_MAGIC
+//              [1] 32b size x
+//              [1] 32b size y
+//              [1] 32b texel format (TEXTURE_FORMAT_*)
+//              [1] 32b mip level count
+//              Indexed formats only:
+//              [1] 32b palette size, at most 1 << texel bits
+//              [palette size] 32b palette colors 0x00RRGGBB
+//              [levels] texels of each mip level, 32b, 16b, 8b or 4b
+//                       depending on the format. Level l is
+//                       max(1, x>>l) * max(1, y>>l).
+// Files without the magic are the original format: size x, size y and
+// 32b RGB888 texels (single level).
+
+#include <stdint.h>
+
+#include "FileBlob.hpp"
+
+#define TEXTURE_MAGIC 0x504B5458 // "PKTX"
+
+// uint32_t texels 0x00RRGGBB
+#define TEXTURE_FORMAT_RGB888 0
+// uint16_t texels RRRRRGGGGGGBBBBB, same as the ClassPad framebuffer.
+// Half the memory of RGB888 and drawn unlit without any conversion.
+#define TEXTURE_FORMAT_RGB565 1
+// uint8_t palette indices
+#define TEXTURE_FORMAT_INDEX8 2
+// 4b palette indices, two texels per byte (first one in the low bits).
+// Rows are not padded, levels start on a byte.
+#define TEXTURE_FORMAT_INDEX4 3
+
+#define TEXTURE_PALETTE_MAX 256
+
+// Palette colors of the indexed formats in the framebuffer format (same
+// as color_t), converted from the file's RGB888 when loaded
+#ifdef PC
+typedef uint32_t palette_color_t;
+#else
+typedef uint16_t palette_color_t;
+#endif
+
+// Level 0 (full size) + 1 per halving of a 2048 px texture
+#define TEXTURE_MAX_LEVELS 12
+
+// Texel order in memory. Files are always row-major, the loader tiles the
+// levels afterwards (see texture_set_layout).
+#define TEXTURE_LAYOUT_LINEAR 0
+// TEXTURE_TILE x TEXTURE_TILE blocks of row-major texels, the blocks in
+// row-major order. A span crossing the texture at any angle stays within
+// a few blocks (4x4 RGB565 = 32 bytes, the SH4 cache line). INDEX4
+// textures are always linear.
+#define TEXTURE_LAYOUT_TILED  1
+#define TEXTURE_TILE_SHIFT 2
+#define TEXTURE_TILE       (1 << TEXTURE_TILE_SHIFT)
+
+// Layout textures are loaded in. The PC caches hold whole textures, there
+// the tile address math costs more than it saves (see --bench-layout).
+#ifdef PC
+#   define TEXTURE_LAYOUT_DEFAULT TEXTURE_LAYOUT_LINEAR
+#else
+#   define TEXTURE_LAYOUT_DEFAULT TEXTURE_LAYOUT_TILED
+#endif
+
+struct TextureLevel
+{
+    int width;
+    int height;
+    void* pixels;
+    uint32_t layout; // TEXTURE_LAYOUT_*
+};
+
+// Index of texel (u, v) in a tiled level of given width
+inline int texture_tiled_index(int u, int v, int width)
+{
+    const int mask = TEXTURE_TILE - 1;
+    return ((v & ~mask) * width) + ((u & ~mask) << TEXTURE_TILE_SHIFT)
+         + ((v & mask) << TEXTURE_TILE_SHIFT) + (u & mask);
+}
+
+struct Texture
+{
+    // Full size (level 0). Texture coordinates are in these units even
+    // when level 0 was not loaded.
+    int width;
+    int height;
+    uint32_t format;
+    void* pixels;          // Block holding all loaded levels
+    unsigned first_level;  // Largest loaded level
+    unsigned levels;       // Number of levels, first_level to levels-1 are loaded
+    TextureLevel level[TEXTURE_MAX_LEVELS];
+    // Colors of the indexed formats, every texel is below palette_size
+    // (checked when loaded). nullptr for the other formats.
+    palette_color_t* palette;
+    unsigned palette_size;
+    // The loaded levels of the file, pixels points into it and palette
+    // into its scratch memory (see texture_load)
+    FileBlob file;
+};
+
+// Loads a .texture file in TEXTURE_LAYOUT_DEFAULT, the loaded levels read
+// as one block (see FileBlob.hpp). Mip levels wider or taller than maxSize
+// (> 0) are not loaded, saves memory when the texture is never drawn
+// large. Returns false if the file could not be read or its format is
+// unknown.
+bool texture_load(Texture& texture, const char* path, int maxSize = 0);
+// Same from a region of an open file (e.g. a bundle entry), name is only
+// used in messages
+bool texture_load_region(Texture& texture, const FileRegion& region, const char* name, int maxSize = 0);
+void texture_free(Texture& texture);
+
+// Reorders the loaded levels to layout. Levels whose size is not a
+// multiple of TEXTURE_TILE and INDEX4 textures stay linear. Returns false
+// if memory for the reorder ran out, the levels are then unchanged.
+bool texture_set_layout(Texture& texture, uint32_t layout);
+
+// Bits per texel, 0 for unknown formats
+inline unsigned texture_texel_bits(uint32_t format)
+{
+    switch (format) {
+        case TEXTURE_FORMAT_RGB888: return 32;
+        case TEXTURE_FORMAT_RGB565: return 16;
+        case TEXTURE_FORMAT_INDEX8: return 8;
+        case TEXTURE_FORMAT_INDEX4: return 4;
+        default:                    return 0;
+    }
+}
+
+// Bytes per texel, 0 for unknown formats and INDEX4
+inline unsigned texture_texel_size(uint32_t format)
+{
+    return texture_texel_bits(format) / 8;
+}
+
+// Bytes of a level of given size
+inline unsigned texture_level_bytes(uint32_t format, int width, int height)
+{
+    return (texture_texel_bits(format) * width * height + 7) / 8;
+}
+
+inline bool texture_format_indexed(uint32_t format)
+{
+    return format == TEXTURE_FORMAT_INDEX8 || format == TEXTURE_FORMAT_INDEX4;
+}
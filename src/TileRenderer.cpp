@@ -0,0 +1,235 @@
+#ifdef PC
+// Include guard PC
+
+#include "TileRenderer.hpp"
+
+#include "RenderUtils.hpp"
+
+#include "PC_SDL_screen.hpp"
+
+#include "PC_SpanKernels.hpp"
+
+TileRenderer::TileRenderer(unsigned threads)
+:   recording(false),
+    thread_count(threads < 1 ? 1 : threads),
+    workers(nullptr),
+    generation(0),
+    busy(0),
+    quit(false),
+    next_tile(0)
+{
+    // Lighting tables and span kernels are picked lazily, not thread safe
+    init_light_tables();
+    span_kernels();
+    // Room for a few models, so that frames do not have to grow the arrays
+    commands.reserve(TILE_COMMANDS_RESERVE);
+    for (unsigned i=0; i<TILES_X * TILES_Y; i++)
+        bins[i].reserve(TILE_BIN_RESERVE);
+    if (thread_count > 1){
+        workers = new std::thread[thread_count - 1];
+        for (unsigned i=0; i<thread_count - 1; i++)
+            workers[i] = std::thread(&TileRenderer::worker_main, this);
+    }
+}
+
+TileRenderer::~TileRenderer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    start_cv.notify_all();
+    if (workers != nullptr){
+        for (unsigned i=0; i<thread_count - 1; i++)
+            workers[i].join();
+        delete[] workers;
+    }
+}
+
+unsigned TileRenderer::getThreadCount()
+{
+    return thread_count;
+}
+
+void TileRenderer::begin()
+{
+    recording = true;
+}
+
+bool TileRenderer::isRecording()
+{
+    return recording;
+}
+
+void TileRenderer::record(const TileCommand& c, int x0, int y0, int x1, int y1)
+{
+    if (x0 < 0)          x0 = 0;
+    if (y0 < 0)          y0 = 0;
+    if (x1 > SCREEN_X-1) x1 = SCREEN_X-1;
+    if (y1 > SCREEN_Y-1) y1 = SCREEN_Y-1;
+    if (x0 > x1 || y0 > y1)
+        return;
+    const unsigned id = commands.getSize();
+    commands.push_back(c);
+    for (int ty = y0 / TILE_SIZE; ty <= y1 / TILE_SIZE; ty++){
+        for (int tx = x0 / TILE_SIZE; tx <= x1 / TILE_SIZE; tx++)
+            bins[ty * TILES_X + tx].push_back(id);
+    }
+}
+
+// line() and triangle() round their steps so that they can end up a pixel
+// past the end points, their bboxes are grown by this much
+#define SCREEN_PRIMITIVE_PAD 2
+
+static inline int min3(int a, int b, int c) { return a < b ? (a < c ? a : c) : (b < c ? b : c); }
+static inline int max3(int a, int b, int c) { return a > b ? (a > c ? a : c) : (b > c ? b : c); }
+
+void TileRenderer::drawTriangle(
+    const int16_t_Point2d& v0, const int16_t_Point2d& v1, const int16_t_Point2d& v2,
+    const Texture& texture, uint16_t* depthBuffer, Fix16 lightInstensity
+) {
+    TileCommand c;
+    c.type = TileCommand::TEXTURED_TRIANGLE;
+    c.p[0] = v0; c.p[1] = v1; c.p[2] = v2;
+    c.texture = &texture;
+    c.light = lightInstensity;
+    c.depthBuffer = depthBuffer;
+    record(c, min3(v0.x, v1.x, v2.x), min3(v0.y, v1.y, v2.y),
+              max3(v0.x, v1.x, v2.x), max3(v0.y, v1.y, v2.y));
+}
+
+void TileRenderer::triangle(
+    const int16_t_Point2d& v0, const int16_t_Point2d& v1, const int16_t_Point2d& v2,
+    color_t colorFill, color_t colorLine, uint16_t* depthBuffer
+) {
+    TileCommand c;
+    c.type = TileCommand::TRIANGLE;
+    c.p[0] = v0; c.p[1] = v1; c.p[2] = v2;
+    c.color = colorFill;
+    c.colorLine = colorLine;
+    c.depthBuffer = depthBuffer;
+    const int pad = SCREEN_PRIMITIVE_PAD;
+    record(c, min3(v0.x, v1.x, v2.x) - pad, min3(v0.y, v1.y, v2.y) - pad,
+              max3(v0.x, v1.x, v2.x) + pad, max3(v0.y, v1.y, v2.y) + pad);
+}
+
+void TileRenderer::line(const int16_t_Point2d& a, const int16_t_Point2d& b, color_t color, uint16_t* depthBuffer)
+{
+    TileCommand c;
+    c.type = TileCommand::LINE;
+    c.p[0] = a; c.p[1] = b;
+    c.color = color;
+    c.depthBuffer = depthBuffer;
+    const int pad = SCREEN_PRIMITIVE_PAD;
+    record(c, (a.x < b.x ? a.x : b.x) - pad, (a.y < b.y ? a.y : b.y) - pad,
+              (a.x > b.x ? a.x : b.x) + pad, (a.y > b.y ? a.y : b.y) + pad);
+}
+
+void TileRenderer::draw_center_square(int16_t cx, int16_t cy, int16_t sx, int16_t sy, color_t color)
+{
+    TileCommand c;
+    c.type = TileCommand::CENTER_SQUARE;
+    c.p[0].x = cx; c.p[0].y = cy;
+    c.p[1].x = sx; c.p[1].y = sy;
+    c.color = color;
+    record(c, cx - sx/2, cy - sy/2, cx + sx/2 - 1, cy + sy/2 - 1);
+}
+
+void TileRenderer::draw_tile(unsigned tile)
+{
+    const int tx = tile % TILES_X;
+    const int ty = tile / TILES_X;
+    clipRect = {
+        (int16_t)(tx * TILE_SIZE), (int16_t)(ty * TILE_SIZE),
+        (int16_t)(tx * TILE_SIZE + TILE_SIZE < SCREEN_X ? tx * TILE_SIZE + TILE_SIZE : SCREEN_X),
+        (int16_t)(ty * TILE_SIZE + TILE_SIZE < SCREEN_Y ? ty * TILE_SIZE + TILE_SIZE : SCREEN_Y)
+    };
+    DynamicArray<unsigned>& bin = bins[tile];
+    for (unsigned i=0; i<bin.getSize(); i++){
+        const TileCommand& c = commands[bin[i]];
+        switch (c.type){
+            case TileCommand::TEXTURED_TRIANGLE:
+                if (c.depthBuffer != nullptr)
+                    ::drawTriangle_depth(c.p[0], c.p[1], c.p[2], *c.texture, c.depthBuffer, c.light);
+                else
+                    ::drawTriangle(c.p[0], c.p[1], c.p[2], *c.texture, c.light);
+                break;
+            case TileCommand::TRIANGLE:
+                if (c.depthBuffer != nullptr)
+                    ::triangle_depth(c.p[0], c.p[1], c.p[2], c.color, c.colorLine, c.depthBuffer);
+                else
+                    ::triangle(c.p[0].x,c.p[0].y, c.p[1].x,c.p[1].y, c.p[2].x,c.p[2].y, c.color, c.colorLine);
+                break;
+            case TileCommand::LINE:
+                if (c.depthBuffer != nullptr)
+                    ::line_depth(c.p[0], c.p[1], c.color, c.depthBuffer);
+                else
+                    ::line(c.p[0].x,c.p[0].y, c.p[1].x,c.p[1].y, c.color);
+                break;
+            case TileCommand::CENTER_SQUARE:
+                ::draw_center_square(c.p[0].x, c.p[0].y, c.p[1].x, c.p[1].y, c.color);
+                break;
+        }
+    }
+    clipRect = {0, 0, SCREEN_X, SCREEN_Y};
+}
+
+void TileRenderer::draw_tiles()
+{
+    for (;;){
+        const unsigned tile = next_tile.fetch_add(1);
+        if (tile >= TILES_X * TILES_Y)
+            return;
+        if (bins[tile].getSize() != 0)
+            draw_tile(tile);
+    }
+}
+
+void TileRenderer::worker_main()
+{
+    unsigned seen = 0;
+    for (;;){
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_cv.wait(lock, [&]{ return quit || generation != seen; });
+            if (quit)
+                return;
+            seen = generation;
+        }
+        draw_tiles();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0)
+                done_cv.notify_one();
+        }
+    }
+}
+
+void TileRenderer::flush()
+{
+    recording = false;
+    if (commands.getSize() == 0)
+        return;
+
+    next_tile = 0;
+    if (workers != nullptr){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy = thread_count - 1;
+            generation++;
+        }
+        start_cv.notify_all();
+    }
+    draw_tiles();
+    if (workers != nullptr){
+        std::unique_lock<std::mutex> lock(mutex);
+        done_cv.wait(lock, [&]{ return busy == 0; });
+    }
+
+    commands.clear();
+    for (unsigned i=0; i<TILES_X * TILES_Y; i++)
+        bins[i].clear();
+}
+
+// Include guard PC
+#endif // PC
@@ -0,0 +1,111 @@
+#pragma once
+
+#ifdef PC
+// Include guard PC
+
+// Multithreaded drawing for the PC build. The renderer transforms, sorts and
+// clips on the main thread as usual, but instead of drawing the primitives
+// it records them here, binned into TILE_SIZE x TILE_SIZE screen tiles.
+// flush() draws the tiles in parallel, each tile limited to its own pixels
+// with clipRect. Primitives are drawn in recording order within every tile,
+// so the painter's algorithm gives the same image as drawing them directly.
+
+#include "RenderFP3D.hpp"
+
+#include "Texture.hpp"
+
+#include "DynamicArray.hpp"
+
+// color_t
+#include "Renderer.hpp"
+
+#include "constants.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define TILE_SIZE 32
+#define TILES_X   ((SCREEN_X + TILE_SIZE - 1) / TILE_SIZE)
+#define TILES_Y   ((SCREEN_Y + TILE_SIZE - 1) / TILE_SIZE)
+
+// Initial capacity of the command list and of every tile bin. Both grow
+// when needed, they are never shrunk.
+#define TILE_COMMANDS_RESERVE 8192
+#define TILE_BIN_RESERVE      512
+
+// Recorded primitive, drawn with the RenderUtils / PC_SDL_screen function
+// of the same name (depth tested versions when depthBuffer is set).
+struct TileCommand
+{
+    enum : uint8_t { TEXTURED_TRIANGLE, TRIANGLE, LINE, CENTER_SQUARE } type;
+    // TEXTURED_TRIANGLE, TRIANGLE: 3 points. LINE: p[0] -> p[1].
+    // CENTER_SQUARE: center in p[0].x/y, size in p[1].x/y.
+    int16_t_Point2d p[3];
+    color_t color;      // Fill color of TRIANGLE, color of LINE and CENTER_SQUARE
+    color_t colorLine;  // Outline of TRIANGLE
+    const Texture* texture;
+    Fix16 light;
+    uint16_t* depthBuffer;
+};
+
+class TileRenderer
+{
+private:
+    DynamicArray<TileCommand> commands;
+    // Indices of the commands touching the tile, in recording order
+    DynamicArray<unsigned> bins[TILES_X * TILES_Y];
+    bool recording;
+
+    // Worker threads, the calling thread of flush() is the last worker
+    unsigned thread_count;
+    std::thread* workers;
+    std::mutex mutex;
+    std::condition_variable start_cv;
+    std::condition_variable done_cv;
+    unsigned generation;  // Incremented for every flush that has work
+    unsigned busy;        // Workers still drawing the current flush
+    bool quit;
+    // Next tile to draw. Threads take tiles one by one until all are taken,
+    // a thread stuck in a heavy tile does not hold up the others.
+    std::atomic<unsigned> next_tile;
+
+    // Stores the command and adds it to the bins of the tiles overlapping
+    // the inclusive bbox (x0, y0) - (x1, y1) of the pixels it can draw
+    void record(const TileCommand& c, int x0, int y0, int x1, int y1);
+    void draw_tiles();
+    void draw_tile(unsigned tile);
+    void worker_main();
+
+public:
+    // threads: number of threads drawing tiles (including the caller of flush)
+    TileRenderer(unsigned threads);
+    ~TileRenderer();
+
+    unsigned getThreadCount();
+
+    // Starts recording a frame
+    void begin();
+    // True between begin() and flush()
+    bool isRecording();
+
+    // Same arguments as the draw functions, depthBuffer nullptr draws
+    // without depth test.
+    void drawTriangle(
+        const int16_t_Point2d& v0, const int16_t_Point2d& v1, const int16_t_Point2d& v2,
+        const Texture& texture, uint16_t* depthBuffer, Fix16 lightInstensity
+    );
+    void triangle(
+        const int16_t_Point2d& v0, const int16_t_Point2d& v1, const int16_t_Point2d& v2,
+        color_t colorFill, color_t colorLine, uint16_t* depthBuffer
+    );
+    void line(const int16_t_Point2d& a, const int16_t_Point2d& b, color_t color, uint16_t* depthBuffer);
+    void draw_center_square(int16_t cx, int16_t cy, int16_t sx, int16_t sy, color_t color);
+
+    // Draws everything recorded since begin(), returns when done
+    void flush();
+};
+
+// Include guard PC
+#endif // PC
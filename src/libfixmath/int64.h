@@ -42,7 +42,7 @@ typedef struct {
 } _int64_t;
 
 static inline _int64_t int64_const(int32_t hi, uint32_t lo) { return (_int64_t){ hi, lo }; }
-static inline _int64_t int64_from_int32(int32_t x) { return (_int64_t){ (x < 0 ? -1 : 0), x }; }
+static inline _int64_t int64_from_int32(int32_t x) { return (_int64_t){ (x < 0 ? -1 : 0), (uint32_t) x }; }
 static inline   int32_t int64_hi(_int64_t x) { return x.hi; }
 static inline  uint32_t int64_lo(_int64_t x) { return x.lo; }
 
@@ -100,8 +100,8 @@ static inline _int64_t int64_shift(_int64_t x, int8_t y) {
 }
 
 static inline _int64_t int64_mul_i32_i32(int32_t x, int32_t y) {
-	 int16_t hi[2] = { (x >> 16), (y >> 16) };
-	uint16_t lo[2] = { (x & 0xFFFF), (y & 0xFFFF) };
+	 int16_t hi[2] = { (int16_t) (x >> 16), (int16_t) (y >> 16) };
+	uint16_t lo[2] = { (uint16_t) (x & 0xFFFF), (uint16_t) (y & 0xFFFF) };
 
 	 int32_t r_hi = hi[0] * hi[1];
 	 int32_t r_md = (hi[0] * lo[1]) + (hi[1] * lo[0]);
@@ -119,7 +119,7 @@ static inline _int64_t int64_mul_i64_i32(_int64_t x, int32_t y) {
 		x = int64_neg(x);
 	uint32_t ypos = (y < 0)? (-y) : (y);
 
-	uint32_t _x[4] = { (x.lo & 0xFFFF), (x.lo >> 16), (x.hi & 0xFFFF), (x.hi >> 16) };
+	uint32_t _x[4] = { (x.lo & 0xFFFF), (x.lo >> 16), (uint32_t) (x.hi & 0xFFFF), (uint32_t) (x.hi >> 16) };
 	uint32_t _y[2] = { (ypos & 0xFFFF), (ypos >> 16) };
 
 	uint32_t r[4];
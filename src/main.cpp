@@ -1,3 +1,5 @@
+#ifndef HEADLESS
+// Headless PC build has its own main in PC_headless.cpp
 
 #include "libfixmath/fix16.hpp"
 
@@ -15,6 +17,12 @@
 
 #include "DynamicArray.hpp"
 
+#include "RenderUtils.hpp"
+
+#include "DirtyRects.hpp"
+
+#include "AssetBundle.hpp"
+
 #ifndef PC
 #   include "app_description.hpp"
 #   include <sdk/calc/calc.hpp>
@@ -35,6 +43,8 @@
 #   include <iostream>  // std::string
 #   include <unistd.h>  // File open & close
 #   include <fcntl.h>   // File open & close
+#   include <cstdlib>   // atoi
+#   include <cstring>   // strcmp
 #endif
 
 // Keymappings, both ClassPad and SDL2
@@ -124,10 +134,33 @@ int custom_init(SDL_Window **window, SDL_Renderer **sdl_renderer, SDL_Texture **
         return -1;
     }
 
-    *texture = SDL_CreateTexture(*sdl_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, SCREEN_X, SCREEN_Y);
+    // Streaming: updated rect by rect with SDL_LockTexture (present_dirty_rects)
+    *texture = SDL_CreateTexture(*sdl_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, SCREEN_X, SCREEN_Y);
+    if (*texture == nullptr) {
+        SDL_Log("Could not create a texture: %s", SDL_GetError());
+        return -1;
+    }
 
     return 0;
 }
+
+// Uploads the changed areas of screenPixels into the texture and shows it
+void present_dirty_rects(SDL_Renderer* sdl_renderer, SDL_Texture* texture, const DirtyRects& rects)
+{
+    for (unsigned i=0; i<rects.count; i++){
+        const ScreenRect& r = rects.rects[i];
+        const SDL_Rect area = {r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0};
+        void* pixels;
+        int pitch;
+        if (SDL_LockTexture(texture, &area, &pixels, &pitch) != 0)
+            continue;
+        copyScreenRect(r, pixels, pitch);
+        SDL_UnlockTexture(texture);
+    }
+    SDL_RenderClear(sdl_renderer);
+    SDL_RenderCopy(sdl_renderer, texture, NULL, NULL);
+    SDL_RenderPresent(sdl_renderer);
+}
 #endif
 
 #ifndef PC
@@ -184,6 +217,16 @@ int main(int argc, const char * argv[])
         "\\fls0\\big_endian_cube.pkObj";
 #endif
 
+    // All of the above in one file (python/bundle_manifest.txt), used when present
+    char bundle_path[] =
+#ifdef PC
+        "./3D_Converted_Models/little_endian_assets.pkBundle";
+#else
+        "\\fls0\\big_endian_assets.pkBundle";
+#endif
+    char pika_name[] = "pika";
+    char cube_name[] = "cube";
+
     fillScreen(FILL_SCREEN_COLOR);
 #ifndef PC
     // Let user know that program has not crashed and we are loading model
@@ -198,10 +241,25 @@ int main(int argc, const char * argv[])
 
     // Create renderer
     Renderer renderer;
+#ifdef PC
+    // Direct drawing unless --threads N is given: tiled rendering has not
+    // been measured faster yet (pc_headless --bench-threads)
+    for (int i = 1; i + 1 < argc; i++)
+        if (!strcmp(argv[i], "--threads"))
+            renderer.setThreadCount(atoi(argv[i + 1]));
+#endif
+
+    AssetBundle bundle;
+    const bool use_bundle = asset_bundle_open(bundle, bundle_path);
 
     // Add model to renderer and modify its initial rotation
-    auto model = renderer.addModel(model1_path, model1_texture_path);
-    model->getRotation_ref().y = Fix16(3.145f/2.0f);
+    auto model = use_bundle
+        ? renderer.addModel(bundle, pika_name, pika_name)
+        : renderer.addModel(model1_path, model1_texture_path);
+    // Program ends if a model could not be loaded
+    bool models_loaded = model != nullptr;
+    if (models_loaded)
+        model->getRotation_ref().y = Fix16(3.145f/2.0f);
 
 
     Fix16 place_in_circle = 0.0f;
@@ -209,10 +267,16 @@ int main(int argc, const char * argv[])
     const Fix16 radius = 13.0f;
     Model* autoplaced_models[place_count];
     uint16_t rend_mod = 0;
-    for(int16_t i=0; i<place_count; i++){
+    for(int16_t i=0; models_loaded && i<place_count; i++){
         place_in_circle = ((Fix16(fix16_pi)) * 2.0f * Fix16(i) / place_count);
 
-        auto m = renderer.addModel(model2_path, NO_TEXTURE);
+        auto m = use_bundle
+            ? renderer.addModel(bundle, cube_name, NO_TEXTURE)
+            : renderer.addModel(model2_path, NO_TEXTURE);
+        if (m == nullptr){
+            models_loaded = false;
+            break;
+        }
         autoplaced_models[i] = m;
 
         // Position
@@ -228,6 +292,8 @@ int main(int argc, const char * argv[])
         // between furthest vertices is 7.0f
         m->_scaleModelTo(7.0f);
     }
+    if (use_bundle)
+        asset_bundle_close(bundle);
 #ifdef PC
     uint32_t time_t0 = SDL_GetTicks();
     int accumulative_frames  = 0;
@@ -236,6 +302,12 @@ int main(int argc, const char * argv[])
 
     Fix16 lightRotation = 0.0f;
 
+    // Areas drawn this frame, and the ones cleared after the previous frame.
+    // Whole screen was filled above.
+    DirtyRects drawn_rects;
+    DirtyRects cleared_rects;
+    cleared_rects.add(0, 0, SCREEN_X, SCREEN_Y);
+
     // Delta-time
     Fix16 last_dt = Fix16((int16_t) 0.0016f);
 
@@ -245,7 +317,7 @@ int main(int argc, const char * argv[])
 
     bool done = false;
 
-    done = DEBUG_TEST();
+    done = DEBUG_TEST() || !models_loaded;
 
     while(!done)
     {
@@ -450,6 +522,15 @@ int main(int argc, const char * argv[])
 
 #endif
 
+        // Everything drawn this frame
+        drawn_rects.clear();
+        drawn_rects.add(bbox_min.x, bbox_min.y, bbox_max.x, bbox_max.y);
+        drawn_rects.add(rotationVisualizerRect());
+        drawn_rects.add(renderer.get_LightLocationRect());
+#ifdef PC
+        drawn_rects.add(10, 10, 50, 6*4); // FPS text
+#endif
+
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // ~~~~~~~~~~~~~~~~~~~ Refresh screen ~~~~~~~~~~~~~~~~~~
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -457,52 +538,17 @@ int main(int argc, const char * argv[])
 #ifndef PC
         LCD_Refresh();
 #else
-        SDL_UpdateTexture(texture, NULL, screenPixels, SCREEN_X * sizeof(Uint32));
-        SDL_RenderClear(sdl_renderer);
-        SDL_RenderCopy(sdl_renderer, texture, NULL, NULL);
-        SDL_RenderPresent(sdl_renderer);
+        // Changed since the last present: drawn now or cleared after last frame
+        cleared_rects.add(drawn_rects);
+        present_dirty_rects(sdl_renderer, texture, cleared_rects);
 #endif
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // ~~~~~~~~~~~~~  Clear VRAM for new frame ~~~~~~~~~~~~~
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// #ifdef PC
-//         std::cout << "bbox_min.x: " << bbox_min.x << " | bbox_min.y: " << bbox_min.y << std::endl;
-//         std::cout << "bbox_max.x: " << bbox_max.x << " | bbox_max.y: " << bbox_max.y << std::endl;
-// #endif
-        // Clear models
-        for(int x=bbox_min.x; x<bbox_max.x; x++){
-            for(int y=bbox_min.y; y<bbox_max.y; y++){
-                // UNSAFE Pixel setting (not checking if the pixel is inside)
-#ifdef PC
-                setPixel_Unsafe(x,y, FILL_SCREEN_COLOR);
-#else
-                vram[width*y + x] = FILL_SCREEN_COLOR;
-#endif
-            }
-        }
-
-        // Clear rotation visualizer
-        for(int x=SCREEN_X-ROTATION_VISUALIZER_LINE_WIDTH*2-ROTATION_VISALIZER_EDGE_OFFSET; x<SCREEN_X; x++){
-            for(int y=0; y<=ROTATION_VISUALIZER_LINE_WIDTH*2+ROTATION_VISALIZER_EDGE_OFFSET; y++){
-#ifdef PC
-                setPixel_Unsafe(x,y, FILL_SCREEN_COLOR);
-#else
-                vram[width*y + x] = FILL_SCREEN_COLOR;
-#endif
-            }
-        }
-
-        // Clear FPS Text (only for pc as pc draws on screen differently)
-#ifdef PC
-        for(int x=10; x < 50; x++){
-            for(int y=10; y < 6*4; y++){
-                setPixel_Unsafe(x,y, FILL_SCREEN_COLOR);
-            }
-        }
-#endif
-        // Clear light box
-        renderer.clear_LightLocation(FILL_SCREEN_COLOR);
+        // Back to background where the frame drew
+        drawn_rects.fill(FILL_SCREEN_COLOR);
+        cleared_rects = drawn_rects;
 
         // fillScreen(FILL_SCREEN_COLOR);
 
@@ -523,3 +569,5 @@ int main(int argc, const char * argv[])
     SDL_Quit();
 #endif
 }
+
+#endif // HEADLESS
@@ -0,0 +1,49 @@
+#pragma once
+
+// Output file of one byte order built in memory, written in one go
+
+#include <stdint.h>
+#include <vector>
+
+struct ByteWriter
+{
+    bool big_endian;
+    std::vector<uint8_t> data;
+
+    explicit ByteWriter(bool big_endian) : big_endian(big_endian) {}
+
+    void u32(uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+            data.push_back(value >> (big_endian ? 24 - 8*i : 8*i));
+    }
+    void u16(uint16_t value)
+    {
+        for (int i = 0; i < 2; i++)
+            data.push_back(value >> (big_endian ? 8 - 8*i : 8*i));
+    }
+    void bytes(const void* src, unsigned n)
+    {
+        data.insert(data.end(), (const uint8_t*) src, (const uint8_t*) src + n);
+    }
+    // Zeros up to a multiple of n bytes
+    void pad(unsigned n)
+    {
+        data.resize((data.size() + n - 1) / n * n, 0);
+    }
+};
+
+// Same values into the big and the little endian file
+struct EndianPair
+{
+    ByteWriter big;
+    ByteWriter little;
+
+    EndianPair() : big(true), little(false) {}
+
+    void u32(uint32_t value) { big.u32(value); little.u32(value); }
+    void u16(uint16_t value) { big.u16(value); little.u16(value); }
+    void pad(unsigned n)     { big.pad(n);     little.pad(n); }
+};
+
+bool write_file(const char* path, const std::vector<uint8_t>& data);
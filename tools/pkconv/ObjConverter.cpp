@@ -0,0 +1,262 @@
+#include "ObjConverter.hpp"
+
+#include "../../src/Mesh.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Read block, lines longer than this are an error
+const unsigned OBJ_READ_BLOCK = 1 << 20;
+
+static const char* skip_spaces(const char* s)
+{
+    while (*s == ' ' || *s == '\t' || *s == '\r')
+        s++;
+    return s;
+}
+
+// Whitespace separated numbers, as many as there are room for in values
+static unsigned parse_numbers(const char* s, double* values, unsigned max_count, bool& ok)
+{
+    unsigned n = 0;
+    ok = true;
+    for (s = skip_spaces(s); *s != '\0' && n < max_count; s = skip_spaces(s)) {
+        char* end;
+        values[n++] = strtod(s, &end);
+        if (end == s || (*end != '\0' && *end != ' ' && *end != '\t' && *end != '\r')) {
+            ok = false;
+            return n;
+        }
+        s = end;
+    }
+    return n;
+}
+
+// OBJ index (1 based, negative counts back from the last one) to 0 based
+static bool obj_index(const char* s, char** end, unsigned count, uint32_t& index)
+{
+    const long i = strtol(s, end, 10);
+    if (*end == s || i == 0)
+        return false;
+    index = (uint32_t) (i > 0 ? i - 1 : (long) count + i);
+    return true;
+}
+
+static bool parse_face(const char* s, ObjData& obj, std::string& error)
+{
+    const unsigned vertex_count = obj.positions.size() / 3;
+    const unsigned uv_count     = obj.uvs.size() / 2;
+    std::vector<uint32_t> corners;
+    std::vector<uint32_t> uv_corners;
+    for (s = skip_spaces(s); *s != '\0'; s = skip_spaces(s)) {
+        char* end;
+        uint32_t v, vt;
+        if (!obj_index(s, &end, vertex_count, v)) {
+            error = "bad vertex index";
+            return false;
+        }
+        corners.push_back(v);
+        // v/vt, v/vt/vn or v//vn
+        if (*end == '/' && end[1] != '/') {
+            if (!obj_index(end + 1, &end, uv_count, vt)) {
+                error = "bad uv coord index";
+                return false;
+            }
+            uv_corners.push_back(vt);
+        }
+        if (*end == '/')
+            strtol(end + (end[1] == '/' ? 2 : 1), &end, 10);
+        if (*end != '\0' && *end != ' ' && *end != '\t' && *end != '\r') {
+            error = "bad face corner";
+            return false;
+        }
+        s = end;
+    }
+    if (corners.size() < 3 || (!uv_corners.empty() && uv_corners.size() != corners.size())) {
+        error = "face needs 3 or more corners, all or none with uv coords";
+        return false;
+    }
+
+    // Fan around the first corner
+    if (corners.size() > 3)
+        obj.polygons++;
+    for (unsigned i = 1; i + 1 < corners.size(); i++) {
+        obj.faces.insert(obj.faces.end(), {corners[0], corners[i], corners[i + 1]});
+        if (!uv_corners.empty())
+            obj.uv_faces.insert(obj.uv_faces.end(), {uv_corners[0], uv_corners[i], uv_corners[i + 1]});
+    }
+    return true;
+}
+
+static bool parse_line(char* line, ObjData& obj, std::string& error)
+{
+    const char* s = skip_spaces(line);
+    double values[3];
+    bool ok;
+    if (s[0] == 'v' && (s[1] == ' ' || s[1] == '\t')) {
+        ok = parse_numbers(s + 2, values, 3, ok) == 3 && ok;
+        obj.positions.insert(obj.positions.end(), values, values + 3);
+    } else if (s[0] == 'v' && s[1] == 't') {
+        ok = parse_numbers(s + 2, values, 2, ok) == 2 && ok;
+        obj.uvs.push_back(values[0]);
+        obj.uvs.push_back(1.0 - values[1]);
+    } else if (s[0] == 'f' && (s[1] == ' ' || s[1] == '\t')) {
+        return parse_face(s + 2, obj, error);
+    } else {
+        return true;
+    }
+    if (!ok)
+        error = "bad number";
+    return ok;
+}
+
+static bool indices_valid(const std::vector<uint32_t>& indices, unsigned count)
+{
+    for (uint32_t i : indices)
+        if (i >= count)
+            return false;
+    return true;
+}
+
+bool obj_parse(const char* path, ObjData& obj, std::string& error)
+{
+    obj = ObjData();
+    FILE* f = fopen(path, "rb");
+    if (f == nullptr) {
+        error = std::string("could not open ") + path;
+        return false;
+    }
+
+    std::vector<char> block(OBJ_READ_BLOCK + 1);
+    unsigned filled = 0;
+    unsigned line_number = 0;
+    bool ok = true;
+    bool eof = false;
+    while (ok && !eof) {
+        const size_t n = fread(block.data() + filled, 1, OBJ_READ_BLOCK - filled, f);
+        filled += n;
+        eof = n == 0;
+        if (eof && filled > 0)
+            block[filled++] = '\n'; // Last line without a newline
+        if (!eof && filled == OBJ_READ_BLOCK && memchr(block.data(), '\n', filled) == nullptr) {
+            error = "line longer than the read block";
+            ok = false;
+        }
+
+        // Whole lines of the block, the rest moves to its start
+        char* line = block.data();
+        char* block_end = block.data() + filled;
+        for (char* nl; ok && (nl = (char*) memchr(line, '\n', block_end - line)) != nullptr; line = nl + 1) {
+            *nl = '\0';
+            line_number++;
+            ok = parse_line(line, obj, error);
+        }
+        filled = block_end - line;
+        memmove(block.data(), line, filled);
+    }
+    fclose(f);
+    if (!ok) {
+        error = "line " + std::to_string(line_number) + ": " + error;
+        return false;
+    }
+
+    // The loader takes uv faces for all faces or none
+    if (obj.uv_faces.size() != obj.faces.size())
+        obj.uv_faces.clear();
+    if (!indices_valid(obj.faces, obj.positions.size() / 3) || !indices_valid(obj.uv_faces, obj.uvs.size() / 2)) {
+        error = "face index outside of the vertices or uv coords";
+        return false;
+    }
+    return true;
+}
+
+// Offset and scale (Fix16 raw values) quantizing one axis of values.
+// Rounding like python round() (half to even), see quantization in
+// ObjTexConverter.py.
+static void quantization(const std::vector<double>& values, unsigned axis, unsigned stride,
+                         int64_t& offset, int64_t& scale)
+{
+    if (values.empty()) {
+        offset = 0;
+        scale = fix16_one;
+        return;
+    }
+    double lo = values[axis], hi = values[axis];
+    for (size_t i = axis; i < values.size(); i += stride) {
+        lo = values[i] < lo ? values[i] : lo;
+        hi = values[i] > hi ? values[i] : hi;
+    }
+    offset = (int64_t) nearbyint((lo + hi) / 2 * fix16_one);
+    const int64_t hi_raw = (int64_t) nearbyint(hi * fix16_one) - offset;
+    const int64_t lo_raw = offset - (int64_t) nearbyint(lo * fix16_one);
+    scale = 2 * (hi_raw > lo_raw ? hi_raw : lo_raw);
+    scale = scale > 1 ? scale : 1;
+}
+
+static uint16_t quantize(double value, int64_t offset, int64_t scale)
+{
+    const double q = nearbyint((value * fix16_one - (double) offset) * fix16_one / (double) scale);
+    return (uint16_t) (int16_t) (q < -32768 ? -32768 : q > 32767 ? 32767 : q);
+}
+
+// Fix16 truncated towards zero, as the python converter writes version 1
+static uint32_t float_to_fix16(double value)
+{
+    return (uint32_t) (int64_t) (value * fix16_one);
+}
+
+static void write_v1(const ObjData& obj, EndianPair& out)
+{
+    out.u32(obj.positions.size() / 3);
+    out.u32(obj.faces.size() / 3);
+    out.u32(obj.uv_faces.size() / 3);
+    out.u32(obj.uvs.size() / 2);
+    for (double p : obj.positions) out.u32(float_to_fix16(p));
+    for (uint32_t i : obj.faces)    out.u32(i);
+    for (uint32_t i : obj.uv_faces) out.u32(i);
+    for (double uv : obj.uvs)       out.u32(float_to_fix16(uv));
+}
+
+static void write_v2(const ObjData& obj, EndianPair& out)
+{
+    const unsigned vertex_count = obj.positions.size() / 3;
+    const unsigned uv_count     = obj.uvs.size() / 2;
+    const unsigned index_size   = vertex_count <= 65536 && uv_count <= 65536 ? 2 : 4;
+    int64_t offset[5], scale[5];
+    for (unsigned a = 0; a < 3; a++) quantization(obj.positions, a, 3, offset[a], scale[a]);
+    for (unsigned a = 0; a < 2; a++) quantization(obj.uvs, a, 2, offset[3 + a], scale[3 + a]);
+
+    out.u32(MESH_MAGIC_V2);
+    out.u32(vertex_count);
+    out.u32(obj.faces.size() / 3);
+    out.u32(obj.uv_faces.size() / 3);
+    out.u32(uv_count);
+    out.u32(index_size);
+    for (unsigned a = 0; a < 3; a++) out.u32((uint32_t) offset[a]);
+    for (unsigned a = 0; a < 3; a++) out.u32((uint32_t) scale[a]);
+    for (unsigned a = 3; a < 5; a++) out.u32((uint32_t) offset[a]);
+    for (unsigned a = 3; a < 5; a++) out.u32((uint32_t) scale[a]);
+
+    for (size_t i = 0; i < obj.positions.size(); i++)
+        out.u16(quantize(obj.positions[i], offset[i % 3], scale[i % 3]));
+    out.pad(4);
+    for (const std::vector<uint32_t>* indices : {&obj.faces, &obj.uv_faces}) {
+        for (uint32_t i : *indices) {
+            if (index_size == 2) out.u16(i);
+            else                 out.u32(i);
+        }
+        out.pad(4);
+    }
+    for (size_t i = 0; i < obj.uvs.size(); i++)
+        out.u16(quantize(obj.uvs[i], offset[3 + i % 2], scale[3 + i % 2]));
+}
+
+void obj_write(const ObjData& obj, int version, EndianPair& out)
+{
+    if (version == 1)
+        write_v1(obj, out);
+    else
+        write_v2(obj, out);
+}
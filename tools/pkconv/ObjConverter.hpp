@@ -0,0 +1,25 @@
+#pragma once
+
+// .obj to .pkObj (see Mesh.hpp and python/ObjTexConverter.py for the
+// format). Same output as the python converter.
+
+#include "ByteWriter.hpp"
+
+#include <string>
+
+struct ObjData
+{
+    std::vector<double>   positions; // x, y, z of every vertex
+    std::vector<double>   uvs;       // u, v (v flipped) of every uv coord
+    std::vector<uint32_t> faces;     // 3 vertex indices (0 based) per triangle
+    std::vector<uint32_t> uv_faces;  // 3 uv coord indices per triangle with uvs
+    unsigned polygons;               // Faces with more than 3 corners, triangulated
+};
+
+// Reads v, vt and f records of the file in large blocks. Faces with more
+// than 3 corners are split into a fan of triangles. False with error set
+// on a malformed record or an index outside of the arrays.
+bool obj_parse(const char* path, ObjData& obj, std::string& error);
+
+// .pkObj of given format version (1 or 2) in both byte orders
+void obj_write(const ObjData& obj, int version, EndianPair& out);
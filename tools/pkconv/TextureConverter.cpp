@@ -0,0 +1,284 @@
+#include "TextureConverter.hpp"
+
+#include "../../src/Texture.hpp"
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <png.h>
+#include <unordered_map>
+
+bool png_read(const char* path, Image& image, std::string& error)
+{
+    image = Image();
+    FILE* f = fopen(path, "rb");
+    if (f == nullptr) {
+        error = std::string("could not open ") + path;
+        return false;
+    }
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info = png != nullptr ? png_create_info_struct(png) : nullptr;
+    std::vector<uint8_t> row;
+    if (info == nullptr || setjmp(png_jmpbuf(png))) {
+        error = std::string("could not decode ") + path;
+        png_destroy_read_struct(&png, &info, nullptr);
+        fclose(f);
+        return false;
+    }
+    png_init_io(png, f);
+    png_read_info(png, info);
+
+    // Everything to 8b RGB
+    png_set_expand(png);
+    png_set_strip_16(png);
+    png_set_strip_alpha(png);
+    png_set_gray_to_rgb(png);
+    const int passes = png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+
+    image.width  = png_get_image_width(png, info);
+    image.height = png_get_image_height(png, info);
+    image.pixels.assign(image.width * image.height, 0);
+    row.resize(png_get_rowbytes(png, info));
+    for (int pass = 0; pass < passes; pass++) {
+        for (unsigned y = 0; y < image.height; y++) {
+            uint32_t* pixels = &image.pixels[y * image.width];
+            // Interlaced passes fill in the row read so far
+            if (passes > 1)
+                for (unsigned x = 0; x < image.width; x++)
+                    for (int c = 0; c < 3; c++)
+                        row[x*3 + c] = pixels[x] >> (16 - 8*c);
+            png_read_row(png, row.data(), nullptr);
+            for (unsigned x = 0; x < image.width; x++)
+                pixels[x] = row[x*3] << 16 | row[x*3 + 1] << 8 | row[x*3 + 2];
+        }
+    }
+    png_read_end(png, nullptr);
+    png_destroy_read_struct(&png, &info, nullptr);
+    fclose(f);
+    return true;
+}
+
+// Averages n pixels step apart per channel, rounding half up
+static uint32_t box_average(const uint32_t* p, unsigned n, unsigned step)
+{
+    uint32_t result = 0;
+    for (int shift = 0; shift < 24; shift += 8) {
+        unsigned sum = 0;
+        for (unsigned i = 0; i < n; i++)
+            sum += (p[i * step] >> shift) & 0xff;
+        result |= ((sum + n / 2) / n) << shift;
+    }
+    return result;
+}
+
+// Mip level l of the image. Rows then columns like PIL's BOX resize (each
+// pass rounded to 8b), which the python converter uses.
+static Image mip_level(const Image& image, unsigned l)
+{
+    const unsigned width  = std::max(1u, image.width  >> l);
+    const unsigned height = std::max(1u, image.height >> l);
+    const unsigned nx = image.width / width;
+    const unsigned ny = image.height / height;
+
+    Image rows = {width, image.height, std::vector<uint32_t>(width * image.height)};
+    for (unsigned y = 0; y < image.height; y++)
+        for (unsigned x = 0; x < width; x++)
+            rows.pixels[y * width + x] = box_average(&image.pixels[y * image.width + x * nx], nx, 1);
+
+    Image level = {width, height, std::vector<uint32_t>(width * height)};
+    for (unsigned y = 0; y < height; y++)
+        for (unsigned x = 0; x < width; x++)
+            level.pixels[y * width + x] = box_average(&rows.pixels[y * ny * width + x], ny, width);
+    return level;
+}
+
+// Distinct color and how many pixels have it
+struct ColorCount
+{
+    uint32_t color;
+    unsigned count;
+};
+
+static int channel(uint32_t color, int c)
+{
+    return (color >> (16 - 8*c)) & 0xff;
+}
+
+// Colors [begin, end) and their widest channel
+struct ColorBox
+{
+    unsigned begin;
+    unsigned end;
+    int channel;
+    int range;
+};
+
+static ColorBox color_box(const std::vector<ColorCount>& colors, unsigned begin, unsigned end)
+{
+    ColorBox box = {begin, end, 0, 0};
+    for (int c = 0; c < 3; c++) {
+        int lo = 255, hi = 0;
+        for (unsigned i = begin; i < end; i++) {
+            lo = std::min(lo, channel(colors[i].color, c));
+            hi = std::max(hi, channel(colors[i].color, c));
+        }
+        if (hi - lo > box.range) {
+            box.channel = c;
+            box.range = hi - lo;
+        }
+    }
+    return box;
+}
+
+// Median cut of the image colors into at most max_colors boxes, the
+// palette is the pixel weighted mean of each box
+static std::vector<uint32_t> median_cut(const Image& image, unsigned max_colors)
+{
+    std::vector<uint32_t> sorted = image.pixels;
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<ColorCount> colors;
+    for (uint32_t c : sorted) {
+        if (colors.empty() || colors.back().color != c)
+            colors.push_back({c, 0});
+        colors.back().count++;
+    }
+
+    std::vector<ColorBox> boxes = {color_box(colors, 0, colors.size())};
+    while (boxes.size() < max_colors) {
+        // Box of the widest channel range is split at its pixel median
+        unsigned best = 0;
+        for (unsigned b = 1; b < boxes.size(); b++)
+            if (boxes[b].range > boxes[best].range)
+                best = b;
+        const ColorBox box = boxes[best];
+        if (box.range == 0)
+            break; // Every box is a single color
+        std::sort(colors.begin() + box.begin, colors.begin() + box.end,
+            [&box](const ColorCount& a, const ColorCount& b) {
+                return channel(a.color, box.channel) < channel(b.color, box.channel);
+            });
+        unsigned total = 0, below = 0;
+        for (unsigned i = box.begin; i < box.end; i++)
+            total += colors[i].count;
+        unsigned split = box.begin + 1;
+        for (unsigned i = box.begin; i + 1 < box.end && below + colors[i].count <= total / 2; i++) {
+            below += colors[i].count;
+            split = i + 1;
+        }
+        boxes[best] = color_box(colors, box.begin, split);
+        boxes.push_back(color_box(colors, split, box.end));
+    }
+
+    std::vector<uint32_t> palette;
+    for (const ColorBox& box : boxes) {
+        uint64_t sum[3] = {0, 0, 0};
+        uint64_t count = 0;
+        for (unsigned i = box.begin; i < box.end; i++) {
+            for (int c = 0; c < 3; c++)
+                sum[c] += (uint64_t) channel(colors[i].color, c) * colors[i].count;
+            count += colors[i].count;
+        }
+        uint32_t color = 0;
+        for (int c = 0; c < 3; c++)
+            color |= (uint32_t) ((sum[c] + count / 2) / count) << (16 - 8*c);
+        palette.push_back(color);
+    }
+    return palette;
+}
+
+// Palette entry closest to the color, remembered per color
+static unsigned palette_index(const std::vector<uint32_t>& palette, uint32_t color,
+                              std::unordered_map<uint32_t, unsigned>& closest)
+{
+    auto it = closest.find(color);
+    if (it != closest.end())
+        return it->second;
+    unsigned best = 0;
+    int best_distance = 1 << 30;
+    for (unsigned i = 0; i < palette.size(); i++) {
+        int distance = 0;
+        for (int c = 0; c < 3; c++) {
+            const int d = channel(color, c) - channel(palette[i], c);
+            distance += d * d;
+        }
+        if (distance < best_distance) {
+            best = i;
+            best_distance = distance;
+        }
+    }
+    closest[color] = best;
+    return best;
+}
+
+static void write_texture(const Image& image, const std::vector<Image>& levels, uint32_t format, ByteWriter& out)
+{
+    out.u32(TEXTURE_MAGIC);
+    out.u32(image.width);
+    out.u32(image.height);
+    out.u32(format);
+    out.u32(levels.size());
+
+    if (texture_format_indexed(format)) {
+        // One palette for all levels, taken from the full size image
+        const std::vector<uint32_t> palette = median_cut(image, 1u << texture_texel_bits(format));
+        std::unordered_map<uint32_t, unsigned> closest;
+        std::vector<std::vector<uint8_t>> indices(levels.size());
+        unsigned palette_size = 0;
+        for (size_t l = 0; l < levels.size(); l++) {
+            for (uint32_t c : levels[l].pixels) {
+                indices[l].push_back(palette_index(palette, c, closest));
+                palette_size = std::max(palette_size, indices[l].back() + 1u);
+            }
+        }
+        out.u32(palette_size);
+        for (unsigned i = 0; i < palette_size; i++)
+            out.u32(palette[i]);
+        for (std::vector<uint8_t>& level : indices) {
+            if (format == TEXTURE_FORMAT_INDEX4) {
+                // Two texels per byte, first one in the low bits
+                level.resize((level.size() + 1) & ~1u, 0);
+                for (size_t i = 0; i < level.size(); i += 2)
+                    level[i / 2] = level[i] | level[i + 1] << 4;
+                level.resize(level.size() / 2);
+            }
+            out.bytes(level.data(), level.size());
+        }
+        return;
+    }
+
+    for (const Image& level : levels) {
+        for (uint32_t rgb : level.pixels) {
+            if (format == TEXTURE_FORMAT_RGB565)
+                out.u16(((rgb >> 8) & 0xf800) | ((rgb >> 5) & 0x07e0) | ((rgb >> 3) & 0x001f));
+            else
+                out.u32(rgb);
+        }
+    }
+}
+
+static bool power_of_two(unsigned n)
+{
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+bool texture_write(const Image& image, const TextureSettings& settings, EndianPair& out, std::string& error)
+{
+    const unsigned max_size = 1u << (TEXTURE_MAX_LEVELS - 1);
+    if (image.width == 0 || image.height == 0 || image.width > max_size || image.height > max_size) {
+        error = "texture larger than " + std::to_string(max_size) + "x" + std::to_string(max_size);
+        return false;
+    }
+    if (settings.mips && !(power_of_two(image.width) && power_of_two(image.height))) {
+        error = "mip levels need a power of two texture size";
+        return false;
+    }
+
+    std::vector<Image> levels = {image};
+    while (settings.mips && ((image.width >> levels.size()) > 0 || (image.height >> levels.size()) > 0))
+        levels.push_back(mip_level(image, levels.size()));
+
+    write_texture(image, levels, settings.big_format, out.big);
+    write_texture(image, levels, settings.little_format, out.little);
+    return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+// .png to .texture (see Texture.hpp and python/ObjTexConverter.py for the
+// format). RGB888 and RGB565 files are the same as the python converter
+// writes. INDEX8 / INDEX4 palettes come from a median cut of their own, so
+// those differ from the python (PIL) ones.
+
+#include "ByteWriter.hpp"
+
+#include <string>
+
+struct TextureSettings
+{
+    uint32_t big_format;    // TEXTURE_FORMAT_* of the big endian file
+    uint32_t little_format; // and of the little endian one
+    bool mips;              // Store the mip chain down to 1x1
+};
+
+// 0x00RRGGBB pixels, rows top to bottom
+struct Image
+{
+    unsigned width;
+    unsigned height;
+    std::vector<uint32_t> pixels;
+};
+
+// Decodes the png row by row into RGB888 (alpha dropped, gray and
+// palette images expanded)
+bool png_read(const char* path, Image& image, std::string& error);
+
+// Texture files of the image in both byte orders. Mip levels are box
+// filtered from the full size image (sizes must be powers of two).
+bool texture_write(const Image& image, const TextureSettings& settings, EndianPair& out, std::string& error);
@@ -0,0 +1,287 @@
+// Native asset converter, the same conversions as python/ObjTexConverter.py
+// many times faster. Converts .obj models to .pkObj and .png textures to
+// .texture in both byte orders, several files at a time, and can pack the
+// results into asset bundles (see src/AssetBundle.hpp).
+//
+// Build with "./makepkconv", run "./pkconv --help".
+
+#include "ByteWriter.hpp"
+
+#include "ObjConverter.hpp"
+
+#include "TextureConverter.hpp"
+
+#include "../../src/AssetBundle.hpp"
+
+#include "../../src/Texture.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+static_assert(sizeof(AssetBundleEntry) == ASSET_BUNDLE_NAME_SIZE + 12, "Bundle entry written field by field");
+
+struct ConvertOptions
+{
+    const char* out_dir;
+    int mesh_version;          // .pkObj format version, 1 or 2
+    TextureSettings texture;
+    unsigned jobs;             // Files converted at the same time
+    const char* bundle_manifest; // Pack the files listed here, nullptr = no bundle
+    const char* bundle_name;
+    std::vector<std::string> inputs; // FILE or FILE=NAME
+};
+
+// One input file
+struct ConvertJob
+{
+    std::string path;
+    std::string name;   // Output NAME of {big,little}_endian_NAME.ext
+    std::string result; // Printed when all jobs are done
+    bool ok;
+};
+
+static void print_usage()
+{
+    printf(
+        "Usage: pkconv [options] FILE[=NAME]...\n"
+        "Converts .obj models and .png textures into OUT_DIR/big_endian_NAME.pkObj / .texture\n"
+        "and little_endian_NAME.pkObj / .texture. NAME defaults to the file name without extension.\n"
+        "  --out-dir DIR       Output directory (default 3D_Converted_Models)\n"
+        "  --mesh-version V    .pkObj format version 1 or 2 (default 2)\n"
+        "  --big-format F      Big endian texel format RGB888, RGB565, INDEX8 or INDEX4 (default RGB565)\n"
+        "  --little-format F   Little endian texel format (default RGB888)\n"
+        "  --no-mips           Store only the full size texture level\n"
+        "  --jobs N            Files converted at the same time (default all cores)\n"
+        "  --bundle MANIFEST   Then pack the files of the manifest (see python/bundle_manifest.txt)\n"
+        "                      into OUT_DIR/big_endian_NAME.pkBundle and little_endian_NAME.pkBundle\n"
+        "  --bundle-name NAME  NAME of the bundles (default assets)\n"
+    );
+}
+
+static bool parse_format(const char* s, uint32_t& format)
+{
+    if      (!strcmp(s, "RGB888")) format = TEXTURE_FORMAT_RGB888;
+    else if (!strcmp(s, "RGB565")) format = TEXTURE_FORMAT_RGB565;
+    else if (!strcmp(s, "INDEX8")) format = TEXTURE_FORMAT_INDEX8;
+    else if (!strcmp(s, "INDEX4")) format = TEXTURE_FORMAT_INDEX4;
+    else return false;
+    return true;
+}
+
+static bool parse_options(int argc, const char* argv[], ConvertOptions* opt)
+{
+    *opt = {"3D_Converted_Models", 2, {TEXTURE_FORMAT_RGB565, TEXTURE_FORMAT_RGB888, true},
+            std::thread::hardware_concurrency(), nullptr, "assets", {}};
+    for (int i=1; i<argc; i++){
+        const char* a = argv[i];
+        bool has_value = (i+1 < argc);
+        if      (!strcmp(a, "--out-dir")      && has_value) opt->out_dir         = argv[++i];
+        else if (!strcmp(a, "--mesh-version") && has_value) opt->mesh_version    = atoi(argv[++i]);
+        else if (!strcmp(a, "--jobs")         && has_value) opt->jobs            = atoi(argv[++i]);
+        else if (!strcmp(a, "--bundle")       && has_value) opt->bundle_manifest = argv[++i];
+        else if (!strcmp(a, "--bundle-name")  && has_value) opt->bundle_name     = argv[++i];
+        else if (!strcmp(a, "--big-format")   && has_value){
+            if (!parse_format(argv[++i], opt->texture.big_format)) return false;
+        }
+        else if (!strcmp(a, "--little-format") && has_value){
+            if (!parse_format(argv[++i], opt->texture.little_format)) return false;
+        }
+        else if (!strcmp(a, "--no-mips")) opt->texture.mips = false;
+        else if (a[0] == '-') return false;
+        else opt->inputs.push_back(a);
+    }
+    if (opt->jobs == 0)
+        opt->jobs = 1;
+    return (opt->mesh_version == 1 || opt->mesh_version == 2) &&
+           (!opt->inputs.empty() || opt->bundle_manifest != nullptr);
+}
+
+bool write_file(const char* path, const std::vector<uint8_t>& data)
+{
+    FILE* f = fopen(path, "wb");
+    if (f == nullptr)
+        return false;
+    const bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return fclose(f) == 0 && ok;
+}
+
+static bool ends_with(const std::string& s, const char* suffix)
+{
+    const size_t n = strlen(suffix);
+    if (s.size() < n)
+        return false;
+    for (size_t i = 0; i < n; i++)
+        if (tolower(s[s.size() - n + i]) != suffix[i])
+            return false;
+    return true;
+}
+
+static std::string out_path(const ConvertOptions& opt, const char* endian, const std::string& name, const char* ext)
+{
+    return std::string(opt.out_dir) + "/" + endian + "_endian_" + name + ext;
+}
+
+static void convert(const ConvertOptions& opt, ConvertJob& job)
+{
+    EndianPair out;
+    std::string error;
+    char info[128];
+    const char* ext = "";
+    if (ends_with(job.path, ".obj")) {
+        ObjData obj;
+        job.ok = obj_parse(job.path.c_str(), obj, error);
+        if (job.ok)
+            obj_write(obj, opt.mesh_version, out);
+        snprintf(info, sizeof(info), "%zu vertices, %zu faces (%u polygons triangulated), %zu uv coords",
+                 obj.positions.size() / 3, obj.faces.size() / 3, obj.polygons, obj.uvs.size() / 2);
+        ext = ".pkObj";
+    } else if (ends_with(job.path, ".png")) {
+        Image image;
+        job.ok = png_read(job.path.c_str(), image, error) && texture_write(image, opt.texture, out, error);
+        snprintf(info, sizeof(info), "%ux%u", image.width, image.height);
+        ext = ".texture";
+    } else {
+        job.ok = false;
+        error = "not a .obj or .png file";
+    }
+
+    if (job.ok) {
+        const std::string big = out_path(opt, "big", job.name, ext);
+        const std::string little = out_path(opt, "little", job.name, ext);
+        job.ok = write_file(big.c_str(), out.big.data) && write_file(little.c_str(), out.little.data);
+        error = "could not write " + big + " or " + little;
+        job.result = job.path + " -> " + job.name + ext + ": " + info;
+    }
+    if (!job.ok)
+        job.result = job.path + ": " + error;
+}
+
+// Packs the manifest files (already converted, in out_dir) of one byte order
+static bool build_bundle(const ConvertOptions& opt, bool big_endian)
+{
+    const char* endian = big_endian ? "big" : "little";
+    FILE* f = fopen(opt.bundle_manifest, "r");
+    if (f == nullptr) {
+        fprintf(stderr, "Could not open %s\n", opt.bundle_manifest);
+        return false;
+    }
+
+    // Manifest: "name type file" per line, see ObjTexConverter.py
+    struct Entry { std::string name; uint32_t type; std::vector<uint8_t> data; };
+    std::vector<Entry> entries;
+    char line[512];
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f) != nullptr) {
+        char name[128], type[32], file[256];
+        if (line[0] == '#' || sscanf(line, "%127s %31s %255s", name, type, file) != 3)
+            continue;
+        std::string path = file;
+        const size_t at = path.find("{endian}");
+        if (at != std::string::npos)
+            path.replace(at, 8, std::string(endian) + "_endian");
+        path = std::string(opt.out_dir) + "/" + path;
+
+        Entry e = {name, !strcmp(type, "mesh") ? (uint32_t) ASSET_TYPE_MESH : (uint32_t) ASSET_TYPE_TEXTURE, {}};
+        FILE* asset = fopen(path.c_str(), "rb");
+        ok = asset != nullptr && e.name.size() < ASSET_BUNDLE_NAME_SIZE &&
+             (!strcmp(type, "mesh") || !strcmp(type, "texture"));
+        if (asset != nullptr) {
+            uint8_t block[1 << 16];
+            for (size_t n; (n = fread(block, 1, sizeof(block), asset)) > 0; )
+                e.data.insert(e.data.end(), block, block + n);
+            fclose(asset);
+        }
+        if (!ok)
+            fprintf(stderr, "Bundle entry %s %s: could not read %s, or name longer than %d characters\n",
+                    name, type, path.c_str(), ASSET_BUNDLE_NAME_SIZE - 1);
+        entries.push_back(e);
+    }
+    fclose(f);
+    if (!ok)
+        return false;
+
+    ByteWriter out(big_endian);
+    out.u32(ASSET_BUNDLE_MAGIC);
+    out.u32(entries.size());
+    uint32_t offset = 8 + entries.size() * sizeof(AssetBundleEntry);
+    for (const Entry& e : entries) {
+        offset = (offset + 7) & ~7u;
+        char name[ASSET_BUNDLE_NAME_SIZE] = {0};
+        memcpy(name, e.name.c_str(), e.name.size());
+        out.bytes(name, sizeof(name));
+        out.u32(e.type);
+        out.u32(offset);
+        out.u32(e.data.size());
+        offset += e.data.size();
+    }
+    for (const Entry& e : entries) {
+        out.pad(8);
+        out.bytes(e.data.data(), e.data.size());
+    }
+
+    const std::string path = out_path(opt, endian, opt.bundle_name, ".pkBundle");
+    if (!write_file(path.c_str(), out.data)) {
+        fprintf(stderr, "Could not write %s\n", path.c_str());
+        return false;
+    }
+    printf("Bundle %s: %zu entries, %zu bytes\n", path.c_str(), entries.size(), out.data.size());
+    return true;
+}
+
+int main(int argc, const char* argv[])
+{
+    ConvertOptions opt;
+    if (!parse_options(argc, argv, &opt)){
+        print_usage();
+        return 1;
+    }
+
+    std::vector<ConvertJob> jobs;
+    for (const std::string& input : opt.inputs) {
+        ConvertJob job = {input, "", "", false};
+        const size_t eq = input.find('=');
+        if (eq != std::string::npos) {
+            job.path = input.substr(0, eq);
+            job.name = input.substr(eq + 1);
+        } else {
+            const size_t slash = input.find_last_of('/');
+            job.name = input.substr(slash == std::string::npos ? 0 : slash + 1);
+            job.name = job.name.substr(0, job.name.find_last_of('.'));
+        }
+        jobs.push_back(job);
+    }
+
+    // Every thread takes the next file until none are left
+    typedef std::chrono::steady_clock clock;
+    const auto t0 = clock::now();
+    std::atomic<unsigned> next(0);
+    auto worker = [&]() {
+        for (unsigned j; (j = next++) < jobs.size(); )
+            convert(opt, jobs[j]);
+    };
+    std::vector<std::thread> threads;
+    const unsigned thread_count = opt.jobs < jobs.size() ? opt.jobs : jobs.size();
+    for (unsigned t = 1; t < thread_count; t++)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& t : threads)
+        t.join();
+    const double seconds = std::chrono::duration<double>(clock::now() - t0).count();
+
+    bool ok = true;
+    for (const ConvertJob& job : jobs) {
+        printf("%s\n", job.result.c_str());
+        ok = ok && job.ok;
+    }
+    if (!jobs.empty())
+        printf("Converted %zu files in %.3f s on %u threads\n", jobs.size(), seconds, thread_count);
+
+    if (ok && opt.bundle_manifest != nullptr)
+        ok = build_bundle(opt, true) && build_bundle(opt, false);
+    return ok ? 0 : 1;
+}